@@ -25,8 +25,15 @@
 #include <apr_strings.h>
 #include <svn_dirent_uri.h>
 #include <svn_hash.h>
+#include <svn_pools.h>
 #include <svn_string.h>
 
+// Maximal number of directories memoized between branch additions.
+#define BRANCH_MEMO_MAX_DIRS 65536
+
+// Memoized value of directories outside of any branch.
+static branch_t no_branch;
+
 svn_boolean_t
 branch_path_is_root(const branch_t *b, const char *path)
 {
@@ -59,6 +66,9 @@ branch_storage_create(apr_pool_t *pool)
     bs->tree = tree_create(pool);
     bs->pfx = tree_create(pool);
     bs->refnames = apr_hash_make(pool);
+    bs->paths = apr_array_make(pool, 0, sizeof(branch_t *));
+    bs->memo_pool = svn_pool_create(pool);
+    bs->memo = apr_hash_make(bs->memo_pool);
 
     return bs;
 }
@@ -69,7 +79,28 @@ branch_storage_add_prefix(branch_storage_t *bs,
                           svn_boolean_t is_tag,
                           apr_pool_t *pool)
 {
-    tree_insert(bs->pfx, pfx, pfx, pool);
+    tree_insert(bs->pfx, pfx, pfx);
+    bs->version++;
+}
+
+// Returns index of the first branch in paths not ordered before path.
+static int
+lower_bound(const apr_array_header_t *paths, const char *path)
+{
+    int lo = 0, hi = paths->nelts;
+
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        const branch_t *b = APR_ARRAY_IDX(paths, mid, const branch_t *);
+
+        if (strcmp(b->path, path) < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    return lo;
 }
 
 branch_t *
@@ -79,34 +110,81 @@ branch_storage_add_branch(branch_storage_t *bs,
                           apr_pool_t *pool)
 {
     branch_t *b = apr_pcalloc(bs->pool, sizeof(branch_t));
+    int pos;
+
     b->refname = apr_pstrdup(bs->pool, refname);
     b->path = apr_pstrdup(bs->pool, path);
     b->dirty = TRUE;
 
-    tree_insert(bs->tree, b->path, b, pool);
+    tree_insert(bs->tree, b->path, b);
     svn_hash_sets(bs->refnames, b->refname, b);
 
+    pos = lower_bound(bs->paths, b->path);
+    if (pos < bs->paths->nelts &&
+        strcmp(APR_ARRAY_IDX(bs->paths, pos, branch_t *)->path, b->path) == 0) {
+        APR_ARRAY_IDX(bs->paths, pos, branch_t *) = b;
+    } else {
+        apr_array_push(bs->paths);
+        memmove(bs->paths->elts + (pos + 1) * sizeof(branch_t *),
+                bs->paths->elts + pos * sizeof(branch_t *),
+                (bs->paths->nelts - pos - 1) * sizeof(branch_t *));
+        APR_ARRAY_IDX(bs->paths, pos, branch_t *) = b;
+    }
+    bs->version++;
+
     return b;
 }
 
+apr_array_header_t *
+branch_storage_lookup_subbranches(branch_storage_t *bs, const char *path, apr_pool_t *pool)
+{
+    apr_array_header_t *branches = apr_array_make(pool, 0, sizeof(branch_t *));
+    const char *dir = "";
+    apr_size_t len;
+    int i;
+
+    if (*path != '\0') {
+        i = lower_bound(bs->paths, path);
+        if (i < bs->paths->nelts &&
+            strcmp(APR_ARRAY_IDX(bs->paths, i, branch_t *)->path, path) == 0) {
+            APR_ARRAY_PUSH(branches, branch_t *) = APR_ARRAY_IDX(bs->paths, i, branch_t *);
+        }
+        dir = apr_pstrcat(pool, path, "/", NULL);
+    }
+
+    // Paths below path share the prefix dir, so they form a range.
+    len = strlen(dir);
+    for (i = lower_bound(bs->paths, dir); i < bs->paths->nelts; i++) {
+        branch_t *b = APR_ARRAY_IDX(bs->paths, i, branch_t *);
+
+        if (strncmp(b->path, dir, len) != 0) {
+            break;
+        }
+
+        APR_ARRAY_PUSH(branches, branch_t *) = b;
+    }
+
+    return branches;
+}
+
 branch_t *
 branch_storage_lookup_refname(branch_storage_t *bs, const char *refname)
 {
     return svn_hash_gets(bs->refnames, refname);
 }
 
-branch_t *
-branch_storage_lookup_path(branch_storage_t *bs, const char *path, apr_pool_t *pool)
+static branch_t *
+lookup_path(branch_storage_t *bs, const char *path, apr_pool_t *pool)
 {
     branch_t *branch;
     const char *branch_path, *prefix, *refname, *root, *subpath;
 
-    branch = (branch_t *) tree_match(bs->tree, path, pool);
+    branch = (branch_t *) tree_match(bs->tree, path);
     if (branch != NULL) {
         return branch;
     }
 
-    prefix = tree_match(bs->pfx, path, pool);
+    prefix = tree_match(bs->pfx, path);
     if (prefix == NULL) {
         return NULL;
     }
@@ -132,6 +210,72 @@ branch_storage_lookup_path(branch_storage_t *bs, const char *path, apr_pool_t *p
     return branch_storage_add_branch(bs, refname, branch_path, pool);
 }
 
+// Tests if every child of dir resolves to branch, the branch of dir
+// itself: no branch roots lie below dir and, outside of branches,
+// dir is neither a branch prefix nor inside or above one.
+static svn_boolean_t
+is_memoizable(const branch_storage_t *bs, const char *dir, const branch_t *branch)
+{
+    const tree_t *subtree = tree_subtree(bs->tree, dir);
+
+    if (subtree != NULL && subtree->nodes->nelts > 0) {
+        return FALSE;
+    }
+
+    if (branch != NULL) {
+        return TRUE;
+    }
+
+    if (tree_match(bs->pfx, dir) != NULL) {
+        return FALSE;
+    }
+
+    subtree = tree_subtree(bs->pfx, dir);
+
+    return (subtree == NULL || subtree->nodes->nelts == 0);
+}
+
+branch_t *
+branch_storage_lookup_path(branch_storage_t *bs, const char *path, apr_pool_t *pool)
+{
+    branch_t *branch;
+    const char *slash = strrchr(path, '/');
+    apr_ssize_t dir_len;
+    const char *dir;
+
+    // Leave absolute root alone, its name is a component of its own.
+    if (slash == NULL || slash == path) {
+        return lookup_path(bs, path, pool);
+    }
+
+    if (bs->memo_version != bs->version ||
+        apr_hash_count(bs->memo) >= BRANCH_MEMO_MAX_DIRS) {
+        svn_pool_clear(bs->memo_pool);
+        bs->memo = apr_hash_make(bs->memo_pool);
+        bs->memo_version = bs->version;
+    }
+
+    dir_len = slash - path;
+    branch = apr_hash_get(bs->memo, path, dir_len);
+    if (branch != NULL) {
+        return (branch == &no_branch) ? NULL : branch;
+    }
+
+    // Resolve parent directory first, it might add a branch
+    // containing both the directory and path.
+    dir = apr_pstrmemdup(pool, path, dir_len);
+    branch = lookup_path(bs, dir, pool);
+    if (bs->memo_version != bs->version ||
+        !is_memoizable(bs, dir, branch)) {
+        return lookup_path(bs, path, pool);
+    }
+
+    apr_hash_set(bs->memo, apr_pstrmemdup(bs->memo_pool, dir, dir_len), dir_len,
+                 branch != NULL ? branch : &no_branch);
+
+    return branch;
+}
+
 svn_error_t *
 branch_storage_dump(branch_storage_t *bs, svn_stream_t *dst, apr_pool_t *pool)
 {
@@ -49,6 +49,15 @@ typedef struct
     // Branch and tag path prefixes.
     tree_t *pfx;
     apr_hash_t *refnames;
+    // Branches ordered by path.
+    apr_array_header_t *paths;
+    // Incremented whenever a branch or a prefix is added.
+    apr_uint32_t version;
+    // Branches of parent directories of looked up paths, valid
+    // while version stays the same.
+    apr_pool_t *memo_pool;
+    apr_hash_t *memo;
+    apr_uint32_t memo_version;
 } branch_storage_t;
 
 // Create new branch storage.
@@ -62,10 +71,15 @@ branch_storage_add_prefix(branch_storage_t *bs, const char *pfx, svn_boolean_t i
 branch_t *
 branch_storage_add_branch(branch_storage_t *bs, const char *ref, const char *path, apr_pool_t *pool);
 
-// Lookup a branch by path.
+// Lookup a branch by path. Branches of parent directories are
+// memoized, so that paths of the same directory cost one hash lookup.
 branch_t *
 branch_storage_lookup_path(branch_storage_t *bs, const char *path, apr_pool_t *pool);
 
+// Returns branches rooted at path or below it, ordered by path.
+apr_array_header_t *
+branch_storage_lookup_subbranches(branch_storage_t *bs, const char *path, apr_pool_t *pool);
+
 // Lookup a branch by refname.
 branch_t *
 branch_storage_lookup_refname(branch_storage_t *bs, const char *refname);
@@ -21,159 +21,1184 @@
  */
 
 #include "checksum.h"
+#include "hex.h"
 #include "node.h"
+#include "sha1.h"
 #include "sorts.h"
+#include "utils.h"
+#include <apr_mmap.h>
+#include <apr_strings.h>
 #include <svn_dirent_uri.h>
 #include <svn_hash.h>
-#include <svn_props.h>
+#include <svn_pools.h>
+
+// Binary checksum cache file layout:
+//
+//   magic       8 bytes, CHECKSUM_CACHE_MAGIC
+//   version     4 bytes, big-endian
+//   record size 4 bytes, big-endian
+//   count       8 bytes, big-endian
+//   records     count * record size bytes
+//
+// Every record is a raw Subversion SHA-1 digest followed by a raw
+// Git SHA-1 digest. Records are sorted by Subversion digest.
+#define CHECKSUM_CACHE_MAGIC "SVNGITCC"
+#define CHECKSUM_CACHE_MAGIC_LEN 8
+#define CHECKSUM_CACHE_VERSION 1
+#define CHECKSUM_CACHE_HEADER_LEN 24
+#define CHECKSUM_DIGEST_LEN APR_SHA1_DIGESTSIZE
+#define CHECKSUM_RECORD_LEN (2 * CHECKSUM_DIGEST_LEN)
+
+// Checksum cache journal file layout:
+//
+//   magic       8 bytes, CHECKSUM_JOURNAL_MAGIC
+//   version     4 bytes, big-endian
+//   record size 4 bytes, big-endian
+//   records     record size bytes each, appended as entries are added
+//
+// Journal records have the same layout as binary cache file records,
+// but they are not sorted. A trailing partial record left by a killed
+// process is ignored on load and cut off before appending.
+#define CHECKSUM_JOURNAL_MAGIC "SVNGITCJ"
+#define CHECKSUM_JOURNAL_SUFFIX ".journal"
+#define CHECKSUM_JOURNAL_HEADER_LEN 16
+// Journal is folded into the cache file when it has at least
+// CHECKSUM_JOURNAL_MIN_RECORDS records and more than
+// 1/CHECKSUM_JOURNAL_RATIO of the cache file records.
+#define CHECKSUM_JOURNAL_MIN_RECORDS 4096
+#define CHECKSUM_JOURNAL_RATIO 16
+// Number of journal records read at once.
+#define CHECKSUM_JOURNAL_READ_RECORDS 1024
+
+// Tree cache file is stored next to the checksum cache file and has
+// records of a "git-sha1 key" line, see tree_cache_key() for key format,
+// followed by "\tmode git-sha1 name" lines of tree entries in Git order
+// and an empty line. Only non-empty trees written into Git are stored.
+// Trees written by every export are appended to it. Entries of a record
+// without the final empty line, left by a killed process, are ignored.
+#define CHECKSUM_TREES_SUFFIX ".trees"
+
+// Entries and trees written by an export are kept in files with this
+// suffix next to the journal and tree cache file until git fast-import
+// stores them, see checksum_cache_commit_pending().
+#define CHECKSUM_PENDING_SUFFIX ".pending"
+
+// Number of interpolation steps before falling back to bisection.
+#define INTERPOLATION_STEPS 8
+
+// Minimal number of hash table slots, must be a power of two.
+#define CHECKSUM_TABLE_MIN_SLOTS 1024
+// Number of entries allocated at once.
+#define CHECKSUM_CHUNK_ENTRIES 4096
+// Length of a text cache file line: two hex digests, a space and a newline.
+#define CHECKSUM_TEXT_LINE_LEN (2 * 2 * CHECKSUM_DIGEST_LEN + 2)
+
+// Cache entry keyed by raw Subversion digest. Git checksum points
+// to the inline value digest, so lookups can return it as is.
+typedef struct
+{
+    unsigned char key[CHECKSUM_DIGEST_LEN];
+    unsigned char val[CHECKSUM_DIGEST_LEN];
+    svn_checksum_t checksum;
+} checksum_entry_t;
+
+// Entry of a cached tree.
+typedef struct
+{
+    const char *name;
+    node_mode_t mode;
+    unsigned char val[CHECKSUM_DIGEST_LEN];
+    svn_checksum_t checksum;
+} tree_child_t;
+
+// Git checksum of a non-empty tree keyed by node revision id
+// of a directory and fingerprint of paths ignored below it.
+typedef struct
+{
+    const char *key;
+    unsigned char val[CHECKSUM_DIGEST_LEN];
+    svn_checksum_t checksum;
+    // Entries of the tree, NULL if they are not known.
+    tree_child_t *children;
+    int nchildren;
+} tree_entry_t;
+
+struct checksum_cache_t
+{
+    apr_pool_t *pool;
+    checksum_cache_format_t format;
+    // Open-addressing hash table with linear probing.
+    // Number of slots is a power of two, empty slots are NULL.
+    checksum_entry_t **slots;
+    apr_size_t nslots;
+    apr_size_t nentries;
+    // Entries are allocated in chunks and never move.
+    checksum_entry_t *chunk;
+    apr_size_t chunk_free;
+    // Memory-mapped records of a binary cache file.
+    const unsigned char *records;
+    apr_uint64_t nrecords;
+    // Number of entries loaded from cache file.
+    apr_uint64_t base_nentries;
+    // Journal of entries added since the cache file was written.
+    apr_file_t *journal;
+    apr_uint64_t journal_nrecords;
+    // Journal and tree cache file are pending files.
+    svn_boolean_t journal_pending;
+    // Entries added since the last checksum_cache_flush().
+    apr_array_header_t *pending;
+    // Checksums of trees written into Git, keyed by tree_cache_key().
+    apr_hash_t *trees;
+    // Trees computed since the last checksum_cache_commit_trees(),
+    // they are not known to be written yet.
+    apr_array_header_t *pending_trees;
+    // Tree cache file trees are appended to, NULL if it is not open.
+    apr_file_t *trees_file;
+    // Tree cache file records of pending trees and of trees cached
+    // since the last checksum_cache_flush().
+    svn_stringbuf_t *pending_records;
+    svn_stringbuf_t *unsaved_records;
+    // Number of pending entries and length of unsaved records
+    // marked by checksum_cache_mark().
+    int marked_entries;
+    apr_size_t marked_records;
+    // Blobs hashed ahead of time, keyed by Subversion digest.
+    apr_hash_t *prefetched;
+};
+
+checksum_cache_t *
+checksum_cache_create(apr_pool_t *pool)
+{
+    checksum_cache_t *c = apr_pcalloc(pool, sizeof(checksum_cache_t));
+    c->pool = pool;
+    c->format = checksum_cache_format_text;
+    c->nslots = CHECKSUM_TABLE_MIN_SLOTS;
+    c->slots = apr_pcalloc(pool, c->nslots * sizeof(checksum_entry_t *));
+    c->pending = apr_array_make(pool, 0, sizeof(checksum_entry_t *));
+    c->trees = apr_hash_make(pool);
+    c->pending_trees = apr_array_make(pool, 0, sizeof(tree_entry_t *));
+    c->pending_records = svn_stringbuf_create_empty(pool);
+    c->unsaved_records = svn_stringbuf_create_empty(pool);
+
+    return c;
+}
+
+// Digests are uniformly distributed, so their leading bytes
+// are good enough as a hash value.
+static apr_size_t
+digest_hash(const unsigned char *digest)
+{
+    apr_size_t hash;
+    memcpy(&hash, digest, sizeof(hash));
+
+    return hash;
+}
+
+// Resizes hash table to hold at least n entries
+// while keeping load factor under 1/2.
+static void
+checksum_table_reserve(checksum_cache_t *c, apr_size_t n)
+{
+    checksum_entry_t **slots;
+    apr_size_t nslots = c->nslots;
+
+    while (nslots < 2 * n) {
+        nslots *= 2;
+    }
+
+    if (nslots == c->nslots) {
+        return;
+    }
+
+    slots = apr_pcalloc(c->pool, nslots * sizeof(checksum_entry_t *));
+
+    for (apr_size_t i = 0; i < c->nslots; i++) {
+        checksum_entry_t *entry = c->slots[i];
+        apr_size_t j;
+
+        if (entry == NULL) {
+            continue;
+        }
+
+        j = digest_hash(entry->key) & (nslots - 1);
+        while (slots[j] != NULL) {
+            j = (j + 1) & (nslots - 1);
+        }
+        slots[j] = entry;
+    }
+
+    c->slots = slots;
+    c->nslots = nslots;
+}
+
+static checksum_entry_t *
+checksum_table_get(const checksum_cache_t *c, const unsigned char *digest)
+{
+    apr_size_t i = digest_hash(digest) & (c->nslots - 1);
+
+    while (c->slots[i] != NULL) {
+        if (memcmp(c->slots[i]->key, digest, CHECKSUM_DIGEST_LEN) == 0) {
+            return c->slots[i];
+        }
+        i = (i + 1) & (c->nslots - 1);
+    }
+
+    return NULL;
+}
+
+// Sets val of key, setting changed, unless it is NULL, to whether
+// key is added or its value differs.
+static checksum_entry_t *
+checksum_table_set(checksum_cache_t *c,
+                   const unsigned char *key,
+                   const unsigned char *val,
+                   svn_boolean_t *changed)
+{
+    checksum_entry_t *entry;
+    apr_size_t i;
+
+    entry = checksum_table_get(c, key);
+    if (entry != NULL) {
+        if (changed != NULL) {
+            *changed = (memcmp(entry->val, val, CHECKSUM_DIGEST_LEN) != 0);
+        }
+        memcpy(entry->val, val, CHECKSUM_DIGEST_LEN);
+        return entry;
+    }
+
+    if (changed != NULL) {
+        *changed = TRUE;
+    }
+
+    checksum_table_reserve(c, c->nentries + 1);
+
+    if (c->chunk_free == 0) {
+        c->chunk = apr_palloc(c->pool, CHECKSUM_CHUNK_ENTRIES * sizeof(checksum_entry_t));
+        c->chunk_free = CHECKSUM_CHUNK_ENTRIES;
+    }
+
+    entry = c->chunk++;
+    c->chunk_free--;
+
+    memcpy(entry->key, key, CHECKSUM_DIGEST_LEN);
+    memcpy(entry->val, val, CHECKSUM_DIGEST_LEN);
+    entry->checksum.kind = svn_checksum_sha1;
+    entry->checksum.digest = entry->val;
+
+    i = digest_hash(key) & (c->nslots - 1);
+    while (c->slots[i] != NULL) {
+        i = (i + 1) & (c->nslots - 1);
+    }
+    c->slots[i] = entry;
+    c->nentries++;
+
+    return entry;
+}
+
+checksum_cache_format_t
+checksum_cache_get_format(const checksum_cache_t *c)
+{
+    return c->format;
+}
+
+void
+checksum_cache_set_format(checksum_cache_t *c, checksum_cache_format_t format)
+{
+    c->format = format;
+}
+
+// Looks up a record by Subversion digest in the sorted records.
+// SHA-1 digests are uniformly distributed, so interpolation search
+// on the leading 8 bytes finds a record in a few probes. It falls back
+// to bisection if the interpolation does not converge quickly.
+static const unsigned char *
+checksum_records_find(const unsigned char *records,
+                      apr_uint64_t nrecords,
+                      const unsigned char *digest)
+{
+    apr_uint64_t lo = 0, hi = nrecords;
+    apr_uint64_t key = decode_uint64(digest);
+    int steps = 0;
+
+    while (lo < hi) {
+        const unsigned char *rec;
+        apr_uint64_t mid;
+        int cmp;
+
+        if (steps++ < INTERPOLATION_STEPS) {
+            apr_uint64_t lo_key = decode_uint64(records + lo * CHECKSUM_RECORD_LEN);
+            apr_uint64_t hi_key = decode_uint64(records + (hi - 1) * CHECKSUM_RECORD_LEN);
+
+            if (key < lo_key || key > hi_key) {
+                return NULL;
+            }
+
+            if (hi_key == lo_key) {
+                mid = lo + (hi - lo) / 2;
+            } else {
+                double ratio = (double)(key - lo_key) / (double)(hi_key - lo_key);
+                mid = lo + (apr_uint64_t)(ratio * (double)(hi - 1 - lo));
+                if (mid >= hi) {
+                    mid = hi - 1;
+                }
+            }
+        } else {
+            mid = lo + (hi - lo) / 2;
+        }
+
+        rec = records + mid * CHECKSUM_RECORD_LEN;
+        cmp = memcmp(digest, rec, CHECKSUM_DIGEST_LEN);
+        if (cmp == 0) {
+            return rec;
+        } else if (cmp < 0) {
+            hi = mid;
+        } else {
+            lo = mid + 1;
+        }
+    }
+
+    return NULL;
+}
+
+// Sets Git checksum for Subversion checksum, returns FALSE if it is
+// not cached. Digest of git_checksum points into the cache.
+static svn_boolean_t
+checksum_cache_get(svn_checksum_t *git_checksum,
+                   checksum_cache_t *c,
+                   const svn_checksum_t *svn_checksum)
+{
+    const unsigned char *rec;
+    checksum_entry_t *entry;
+
+    entry = checksum_table_get(c, svn_checksum->digest);
+    if (entry != NULL) {
+        *git_checksum = entry->checksum;
+        return TRUE;
+    }
+
+    if (c->records == NULL) {
+        return FALSE;
+    }
+
+    rec = checksum_records_find(c->records, c->nrecords, svn_checksum->digest);
+    if (rec == NULL) {
+        return FALSE;
+    }
+
+    // Point straight into the mapped file, it lives as long as the cache.
+    git_checksum->kind = svn_checksum_sha1;
+    git_checksum->digest = rec + CHECKSUM_DIGEST_LEN;
+
+    return TRUE;
+}
+
+svn_boolean_t
+checksum_cache_contains(const checksum_cache_t *c,
+                        const svn_checksum_t *svn_checksum)
+{
+    if (checksum_table_get(c, svn_checksum->digest) != NULL) {
+        return TRUE;
+    }
+
+    return (c->records != NULL &&
+            checksum_records_find(c->records, c->nrecords, svn_checksum->digest) != NULL);
+}
+
+void
+checksum_cache_set(checksum_cache_t *c,
+                   const svn_checksum_t *svn_checksum,
+                   const svn_checksum_t *git_checksum)
+{
+    checksum_entry_t *entry;
+    svn_boolean_t changed;
+
+    entry = checksum_table_set(c, svn_checksum->digest, git_checksum->digest, &changed);
+    if (changed && c->journal != NULL) {
+        APR_ARRAY_PUSH(c->pending, checksum_entry_t *) = entry;
+    }
+}
+
+svn_error_t *
+checksum_cache_dump(checksum_cache_t *c,
+                    svn_stream_t *dst,
+                    apr_pool_t *pool)
+{
+    char line[CHECKSUM_TEXT_LINE_LEN];
+    apr_size_t len;
+
+    line[2 * CHECKSUM_DIGEST_LEN] = ' ';
+    line[CHECKSUM_TEXT_LINE_LEN - 1] = '\n';
+
+    for (apr_uint64_t i = 0; i < c->nrecords; i++) {
+        const unsigned char *record = c->records + i * CHECKSUM_RECORD_LEN;
+
+        hex_encode(line, record, CHECKSUM_DIGEST_LEN);
+        hex_encode(line + 2 * CHECKSUM_DIGEST_LEN + 1, record + CHECKSUM_DIGEST_LEN,
+                   CHECKSUM_DIGEST_LEN);
+        len = CHECKSUM_TEXT_LINE_LEN;
+        SVN_ERR(svn_stream_write(dst, line, &len));
+    }
+
+    for (apr_size_t i = 0; i < c->nslots; i++) {
+        const checksum_entry_t *entry = c->slots[i];
+        if (entry == NULL) {
+            continue;
+        }
+
+        hex_encode(line, entry->key, CHECKSUM_DIGEST_LEN);
+        hex_encode(line + 2 * CHECKSUM_DIGEST_LEN + 1, entry->checksum.digest,
+                   CHECKSUM_DIGEST_LEN);
+        len = CHECKSUM_TEXT_LINE_LEN;
+        SVN_ERR(svn_stream_write(dst, line, &len));
+    }
+
+    return SVN_NO_ERROR;
+}
+
+static int
+compare_records(const void *a, const void *b)
+{
+    return memcmp(a, b, CHECKSUM_DIGEST_LEN);
+}
+
+static svn_error_t *
+checksum_cache_dump_binary(checksum_cache_t *c,
+                           svn_stream_t *dst,
+                           apr_pool_t *pool)
+{
+    apr_size_t len, nentries = c->nentries;
+    apr_uint64_t i = 0, j = 0, nduplicates = 0;
+    unsigned char hdr[CHECKSUM_CACHE_HEADER_LEN];
+    unsigned char *entries, *rec;
+    const unsigned char *next;
+
+    // Collect in-memory entries as records and sort them,
+    // so they can be merged with already sorted file records.
+    entries = apr_palloc(pool, nentries * CHECKSUM_RECORD_LEN + 1);
+    rec = entries;
+    for (apr_size_t k = 0; k < c->nslots; k++) {
+        const checksum_entry_t *entry = c->slots[k];
+        if (entry == NULL) {
+            continue;
+        }
+
+        memcpy(rec, entry->key, CHECKSUM_DIGEST_LEN);
+        memcpy(rec + CHECKSUM_DIGEST_LEN, entry->val, CHECKSUM_DIGEST_LEN);
+        rec += CHECKSUM_RECORD_LEN;
+    }
+
+    qsort(entries, nentries, CHECKSUM_RECORD_LEN, compare_records);
+
+    // Entries that shadow file records are written once.
+    for (apr_size_t k = 0; k < nentries && c->records != NULL; k++) {
+        if (checksum_records_find(c->records, c->nrecords,
+                                  entries + k * CHECKSUM_RECORD_LEN)) {
+            nduplicates++;
+        }
+    }
+
+    memcpy(hdr, CHECKSUM_CACHE_MAGIC, CHECKSUM_CACHE_MAGIC_LEN);
+    encode_uint32(hdr + 8, CHECKSUM_CACHE_VERSION);
+    encode_uint32(hdr + 12, CHECKSUM_RECORD_LEN);
+    encode_uint64(hdr + 16, c->nrecords + nentries - nduplicates);
+
+    len = CHECKSUM_CACHE_HEADER_LEN;
+    SVN_ERR(svn_stream_write(dst, (const char *)hdr, &len));
+
+    while (i < c->nrecords || j < nentries) {
+        int cmp = -1;
+
+        if (i < c->nrecords && j < nentries) {
+            cmp = compare_records(c->records + i * CHECKSUM_RECORD_LEN,
+                                  entries + j * CHECKSUM_RECORD_LEN);
+        } else if (j < nentries) {
+            cmp = 1;
+        }
+
+        if (cmp < 0) {
+            next = c->records + i++ * CHECKSUM_RECORD_LEN;
+        } else {
+            // In-memory entry takes precedence over a file record.
+            i += (cmp == 0);
+            next = entries + j++ * CHECKSUM_RECORD_LEN;
+        }
+
+        len = CHECKSUM_RECORD_LEN;
+        SVN_ERR(svn_stream_write(dst, (const char *)next, &len));
+    }
+
+    return SVN_NO_ERROR;
+}
+
+svn_error_t *
+checksum_cache_dump_path(checksum_cache_t *c,
+                         const char *path,
+                         apr_pool_t *pool)
+{
+    apr_file_t *fd;
+    svn_stream_t *dst;
+    const char *tmp_path;
+
+    // Write into a temporary file first, the cache file itself
+    // may be still mapped into memory.
+    tmp_path = apr_pstrcat(pool, path, ".tmp", NULL);
+
+    SVN_ERR(svn_io_file_open(&fd, tmp_path,
+                             APR_CREATE | APR_TRUNCATE | APR_BUFFERED | APR_WRITE | APR_BINARY,
+                             APR_OS_DEFAULT, pool));
+
+    dst = svn_stream_from_aprfile2(fd, FALSE, pool);
+    if (c->format == checksum_cache_format_binary) {
+        SVN_ERR(checksum_cache_dump_binary(c, dst, pool));
+    } else {
+        SVN_ERR(checksum_cache_dump(c, dst, pool));
+    }
+    SVN_ERR(svn_stream_close(dst));
+
+    SVN_ERR(svn_io_file_rename(tmp_path, path, pool));
+
+    return SVN_NO_ERROR;
+}
+
+svn_error_t *
+checksum_cache_load(checksum_cache_t *c,
+                    svn_stream_t *src,
+                    apr_pool_t *pool)
+{
+    apr_pool_t *iterpool = svn_pool_create(pool);
+    svn_boolean_t eof;
+    int lineno = 0;
+
+    while (TRUE) {
+        const char *next;
+        unsigned char svn_digest[CHECKSUM_DIGEST_LEN], git_digest[CHECKSUM_DIGEST_LEN];
+        svn_stringbuf_t *buf;
+
+        svn_pool_clear(iterpool);
+
+        SVN_ERR(svn_stream_readline(src, &buf, "\n", &eof, iterpool));
+        if (eof) {
+            break;
+        }
+
+        lineno++;
+
+        // Parse Subversion checksum, then Git one.
+        next = strchr(buf->data, ' ');
+        if (next == NULL ||
+            buf->len < 2 * CHECKSUM_DIGEST_LEN ||
+            buf->data + buf->len - (next + 1) < 2 * CHECKSUM_DIGEST_LEN ||
+            !hex_decode(svn_digest, buf->data, CHECKSUM_DIGEST_LEN) ||
+            !hex_decode(git_digest, next + 1, CHECKSUM_DIGEST_LEN)) {
+            return svn_error_createf(SVN_ERR_MALFORMED_FILE, NULL,
+                                     "line %d: %s", lineno, buf->data);
+        }
+
+        checksum_table_set(c, svn_digest, git_digest, NULL);
+    }
+
+    svn_pool_destroy(iterpool);
+
+    return SVN_NO_ERROR;
+}
+
+static svn_error_t *
+checksum_cache_load_binary(checksum_cache_t *c,
+                           apr_file_t *fd,
+                           apr_pool_t *pool)
+{
+    apr_finfo_t finfo;
+    apr_mmap_t *mm;
+    apr_status_t status;
+    const unsigned char *hdr;
+    apr_uint64_t nrecords;
+
+    SVN_ERR(svn_io_file_info_get(&finfo, APR_FINFO_SIZE, fd, pool));
+    if (finfo.size < CHECKSUM_CACHE_HEADER_LEN) {
+        return svn_error_create(SVN_ERR_MALFORMED_FILE, NULL,
+                                "Truncated header");
+    }
+
+    status = apr_mmap_create(&mm, fd, 0, (apr_size_t)finfo.size,
+                             APR_MMAP_READ, c->pool);
+    if (status) {
+        return svn_error_wrap_apr(status, "Can't map checksum cache file");
+    }
+
+    hdr = mm->mm;
+    if (decode_uint32(hdr + 8) != CHECKSUM_CACHE_VERSION) {
+        return svn_error_createf(SVN_ERR_MALFORMED_FILE, NULL,
+                                 "Unsupported version %u",
+                                 decode_uint32(hdr + 8));
+    }
+
+    if (decode_uint32(hdr + 12) != CHECKSUM_RECORD_LEN) {
+        return svn_error_createf(SVN_ERR_MALFORMED_FILE, NULL,
+                                 "Unsupported record size %u",
+                                 decode_uint32(hdr + 12));
+    }
+
+    nrecords = decode_uint64(hdr + 16);
+    if ((apr_uint64_t)finfo.size != CHECKSUM_CACHE_HEADER_LEN + nrecords * CHECKSUM_RECORD_LEN) {
+        return svn_error_createf(SVN_ERR_MALFORMED_FILE, NULL,
+                                 "Expected %" APR_UINT64_T_FMT " records",
+                                 nrecords);
+    }
+
+    c->records = hdr + CHECKSUM_CACHE_HEADER_LEN;
+    c->nrecords = nrecords;
+    c->format = checksum_cache_format_binary;
+
+    return SVN_NO_ERROR;
+}
+
+static const char *
+journal_path(const char *path, apr_pool_t *pool)
+{
+    return apr_pstrcat(pool, path, CHECKSUM_JOURNAL_SUFFIX, NULL);
+}
+
+static void
+journal_header(unsigned char *hdr)
+{
+    memcpy(hdr, CHECKSUM_JOURNAL_MAGIC, CHECKSUM_CACHE_MAGIC_LEN);
+    encode_uint32(hdr + 8, CHECKSUM_CACHE_VERSION);
+    encode_uint32(hdr + 12, CHECKSUM_RECORD_LEN);
+}
+
+static svn_error_t *
+checksum_cache_load_journal(checksum_cache_t *c,
+                            apr_file_t *fd,
+                            apr_pool_t *pool)
+{
+    apr_size_t len;
+    svn_boolean_t eof;
+    unsigned char expected[CHECKSUM_JOURNAL_HEADER_LEN];
+    unsigned char *buf;
+
+    buf = apr_palloc(pool, CHECKSUM_JOURNAL_READ_RECORDS * CHECKSUM_RECORD_LEN);
+
+    SVN_ERR(svn_io_file_read_full2(fd, buf, CHECKSUM_JOURNAL_HEADER_LEN,
+                                   &len, &eof, pool));
+    // Header might be never written completely.
+    if (len < CHECKSUM_JOURNAL_HEADER_LEN) {
+        return SVN_NO_ERROR;
+    }
+
+    journal_header(expected);
+    if (memcmp(buf, expected, CHECKSUM_JOURNAL_HEADER_LEN) != 0) {
+        return svn_error_create(SVN_ERR_MALFORMED_FILE, NULL,
+                                "Unsupported journal header");
+    }
+
+    while (!eof) {
+        SVN_ERR(svn_io_file_read_full2(fd, buf,
+                                       CHECKSUM_JOURNAL_READ_RECORDS * CHECKSUM_RECORD_LEN,
+                                       &len, &eof, pool));
+
+        // Ignore a partially written record at the end.
+        for (apr_size_t i = 0; i + CHECKSUM_RECORD_LEN <= len; i += CHECKSUM_RECORD_LEN) {
+            checksum_table_set(c, buf + i, buf + i + CHECKSUM_DIGEST_LEN, NULL);
+            c->journal_nrecords++;
+        }
+    }
+
+    return SVN_NO_ERROR;
+}
+
+static svn_error_t *
+checksum_cache_load_journal_path(checksum_cache_t *c,
+                                 const char *path,
+                                 apr_pool_t *pool)
+{
+    apr_file_t *fd;
+    svn_error_t *err;
+    svn_node_kind_t kind;
+
+    path = journal_path(path, pool);
+
+    SVN_ERR(svn_io_check_path(path, &kind, pool));
+    if (kind == svn_node_none) {
+        return SVN_NO_ERROR;
+    }
+
+    SVN_ERR(svn_io_file_open(&fd, path, APR_READ | APR_BINARY,
+                             APR_OS_DEFAULT, pool));
+    err = checksum_cache_load_journal(c, fd, pool);
+    if (err) {
+        return svn_error_quick_wrap(err, "Malformed checksum cache journal");
+    }
+    SVN_ERR(svn_io_file_close(fd, pool));
+
+    return SVN_NO_ERROR;
+}
+
+svn_error_t *
+checksum_cache_load_path(checksum_cache_t *c,
+                         const char *path,
+                         apr_pool_t *pool)
+{
+    apr_file_t *fd;
+    apr_off_t offset = 0;
+    apr_size_t len;
+    char magic[CHECKSUM_CACHE_MAGIC_LEN];
+    svn_boolean_t eof;
+    svn_error_t *err;
+    svn_node_kind_t kind;
+
+    SVN_ERR(svn_io_check_path(path, &kind, pool));
+    if (kind == svn_node_none) {
+        // There may be a journal of a cache that was never compacted.
+        return checksum_cache_load_journal_path(c, path, pool);
+    }
+
+    // The file must outlive the mapping, so open it in the cache pool.
+    SVN_ERR(svn_io_file_open(&fd, path, APR_READ | APR_BINARY,
+                             APR_OS_DEFAULT, c->pool));
+    SVN_ERR(svn_io_file_read_full2(fd, magic, sizeof(magic), &len, &eof, pool));
+
+    if (len == sizeof(magic) && memcmp(magic, CHECKSUM_CACHE_MAGIC, len) == 0) {
+        err = checksum_cache_load_binary(c, fd, pool);
+    } else {
+        apr_finfo_t finfo;
+
+        // Size hash table up front from the number of lines.
+        SVN_ERR(svn_io_file_info_get(&finfo, APR_FINFO_SIZE, fd, pool));
+        checksum_table_reserve(c, finfo.size / CHECKSUM_TEXT_LINE_LEN);
+
+        SVN_ERR(svn_io_file_seek(fd, APR_SET, &offset, pool));
+        err = checksum_cache_load(c, svn_stream_from_aprfile2(fd, TRUE, pool), pool);
+    }
+
+    if (err) {
+        return svn_error_quick_wrap(err, "Malformed checksum cache file");
+    }
+
+    if (c->records == NULL) {
+        SVN_ERR(svn_io_file_close(fd, pool));
+    }
+
+    c->base_nentries = c->nrecords + c->nentries;
+
+    SVN_ERR(checksum_cache_load_journal_path(c, path, pool));
+
+    return SVN_NO_ERROR;
+}
+
+static const char *
+trees_path(const char *path, apr_pool_t *pool)
+{
+    return apr_pstrcat(pool, path, CHECKSUM_TREES_SUFFIX, NULL);
+}
+
+// Parses "mode git-sha1 name" entry of a tree cache file record.
+static svn_boolean_t
+parse_tree_child(tree_child_t *child, const char *line, apr_pool_t *pool)
+{
+    char *end = NULL;
+    long mode = strtol(line, &end, 8);
+
+    if (end == line || *end != ' ' ||
+        strlen(end + 1) < 2 * CHECKSUM_DIGEST_LEN + 2 ||
+        !hex_decode(child->val, end + 1, CHECKSUM_DIGEST_LEN) ||
+        end[1 + 2 * CHECKSUM_DIGEST_LEN] != ' ') {
+        return FALSE;
+    }
+
+    child->name = apr_pstrdup(pool, end + 2 + 2 * CHECKSUM_DIGEST_LEN);
+    child->mode = (node_mode_t)mode;
+    child->checksum.kind = svn_checksum_sha1;
+    child->checksum.digest = child->val;
+
+    return TRUE;
+}
+
+svn_error_t *
+checksum_cache_load_trees(checksum_cache_t *c,
+                          const char *path,
+                          svn_boolean_t entries,
+                          apr_pool_t *pool)
+{
+    apr_array_header_t *children;
+    apr_pool_t *iterpool;
+    svn_boolean_t eof;
+    svn_node_kind_t kind;
+    svn_stream_t *src;
+    tree_entry_t *entry = NULL;
+    int lineno = 0;
+
+    path = trees_path(path, pool);
+
+    SVN_ERR(svn_io_check_path(path, &kind, pool));
+    if (kind == svn_node_none) {
+        return SVN_NO_ERROR;
+    }
+
+    SVN_ERR(svn_stream_open_readonly(&src, path, pool, pool));
+    children = apr_array_make(pool, 0, sizeof(tree_child_t));
+    iterpool = svn_pool_create(pool);
+
+    while (TRUE) {
+        const char *key;
+        svn_stringbuf_t *buf;
+
+        svn_pool_clear(iterpool);
+
+        // The last line without newline is a partially written one.
+        SVN_ERR(svn_stream_readline(src, &buf, "\n", &eof, iterpool));
+        if (eof) {
+            break;
+        }
+
+        lineno++;
+
+        // Entries of a record are complete.
+        if (buf->len == 0) {
+            if (entry != NULL && children->nelts > 0) {
+                entry->nchildren = children->nelts;
+                entry->children = apr_pmemdup(c->pool, children->elts,
+                                              children->nelts * sizeof(tree_child_t));
+            }
+            entry = NULL;
+            apr_array_clear(children);
+            continue;
+        }
+
+        if (buf->data[0] == '\t') {
+            if (entry == NULL) {
+                return svn_error_createf(SVN_ERR_MALFORMED_FILE, NULL,
+                                         "Malformed tree cache file, line %d: %s",
+                                         lineno, buf->data);
+            }
+
+            if (entries &&
+                !parse_tree_child(apr_array_push(children), buf->data + 1, c->pool)) {
+                return svn_error_createf(SVN_ERR_MALFORMED_FILE, NULL,
+                                         "Malformed tree cache file, line %d: %s",
+                                         lineno, buf->data);
+            }
+            continue;
+        }
+
+        key = strchr(buf->data, ' ');
+        entry = apr_pcalloc(c->pool, sizeof(tree_entry_t));
+        if (key == NULL ||
+            buf->len < 2 * CHECKSUM_DIGEST_LEN ||
+            !hex_decode(entry->val, buf->data, CHECKSUM_DIGEST_LEN)) {
+            return svn_error_createf(SVN_ERR_MALFORMED_FILE, NULL,
+                                     "Malformed tree cache file, line %d: %s",
+                                     lineno, buf->data);
+        }
+        key++;
+
+        entry->key = apr_pstrdup(c->pool, key);
+        entry->checksum.kind = svn_checksum_sha1;
+        entry->checksum.digest = entry->val;
+
+        svn_hash_sets(c->trees, entry->key, entry);
+        apr_array_clear(children);
+    }
+
+    svn_pool_destroy(iterpool);
+
+    SVN_ERR(svn_stream_close(src));
+
+    return SVN_NO_ERROR;
+}
+
+// Cuts off a partially written line at the end of file,
+// so that appended records start on a line of their own.
+static svn_error_t *
+trim_partial_line(apr_file_t *file, apr_pool_t *pool)
+{
+    apr_finfo_t finfo;
+    apr_off_t end;
+    char buf[256];
+
+    SVN_ERR(svn_io_file_info_get(&finfo, APR_FINFO_SIZE, file, pool));
+
+    end = finfo.size;
+    while (end > 0) {
+        apr_off_t off = (end > (apr_off_t)sizeof(buf)) ? end - (apr_off_t)sizeof(buf) : 0;
+        apr_size_t len = end - off;
+
+        SVN_ERR(svn_io_file_seek(file, APR_SET, &off, pool));
+        SVN_ERR(svn_io_file_read_full2(file, buf, len, NULL, NULL, pool));
+
+        while (len > 0 && buf[len - 1] != '\n') {
+            len--;
+        }
+
+        end = off + len;
+        if (len > 0) {
+            break;
+        }
+    }
+
+    if (end != finfo.size) {
+        SVN_ERR(svn_io_file_trunc(file, end, pool));
+    }
+
+    return SVN_NO_ERROR;
+}
+
+static const char *
+pending_path(const char *path, apr_pool_t *pool)
+{
+    return apr_pstrcat(pool, path, CHECKSUM_PENDING_SUFFIX, NULL);
+}
+
+// Opens journal and tree cache file of the cache file at path
+// for appending, cutting off records partially written before.
+static svn_error_t *
+open_journal_files(apr_file_t **journal,
+                   apr_file_t **trees_file,
+                   const char *path,
+                   apr_pool_t *result_pool,
+                   apr_pool_t *scratch_pool)
+{
+    apr_finfo_t finfo;
+    apr_off_t size;
+
+    SVN_ERR(svn_io_file_open(journal, journal_path(path, scratch_pool),
+                             APR_CREATE | APR_WRITE | APR_APPEND | APR_BUFFERED | APR_BINARY,
+                             APR_OS_DEFAULT, result_pool));
+
+    SVN_ERR(svn_io_file_open(trees_file, trees_path(path, scratch_pool),
+                             APR_CREATE | APR_READ | APR_WRITE | APR_APPEND | APR_BUFFERED | APR_BINARY,
+                             APR_OS_DEFAULT, result_pool));
+    SVN_ERR(trim_partial_line(*trees_file, scratch_pool));
+
+    SVN_ERR(svn_io_file_info_get(&finfo, APR_FINFO_SIZE, *journal, scratch_pool));
+
+    if (finfo.size < CHECKSUM_JOURNAL_HEADER_LEN) {
+        unsigned char hdr[CHECKSUM_JOURNAL_HEADER_LEN];
+
+        journal_header(hdr);
+        SVN_ERR(svn_io_file_trunc(*journal, 0, scratch_pool));
+        SVN_ERR(svn_io_file_write_full(*journal, hdr, sizeof(hdr), NULL, scratch_pool));
+        SVN_ERR(svn_io_file_flush(*journal, scratch_pool));
+        return SVN_NO_ERROR;
+    }
+
+    // Cut off a partially written record, so new records stay aligned.
+    size = finfo.size - CHECKSUM_JOURNAL_HEADER_LEN;
+    if (size % CHECKSUM_RECORD_LEN != 0) {
+        size = CHECKSUM_JOURNAL_HEADER_LEN + size - size % CHECKSUM_RECORD_LEN;
+        SVN_ERR(svn_io_file_trunc(*journal, size, scratch_pool));
+    }
+
+    return SVN_NO_ERROR;
+}
+
+// Folds journal into the cache file at path once it has grown past
+// a fraction of the cache file.
+static svn_error_t *
+fold_journal(checksum_cache_t *c,
+             const char *path,
+             apr_pool_t *pool)
+{
+    apr_uint64_t threshold = c->base_nentries / CHECKSUM_JOURNAL_RATIO;
+
+    if (threshold < CHECKSUM_JOURNAL_MIN_RECORDS) {
+        threshold = CHECKSUM_JOURNAL_MIN_RECORDS;
+    }
+
+    if (c->journal_nrecords < threshold) {
+        return SVN_NO_ERROR;
+    }
+
+    SVN_ERR(checksum_cache_dump_path(c, path, pool));
+    SVN_ERR(svn_io_remove_file2(journal_path(path, pool), TRUE, pool));
+    c->journal_nrecords = 0;
+
+    return SVN_NO_ERROR;
+}
+
+svn_error_t *
+checksum_cache_open_journal(checksum_cache_t *c,
+                            const char *path,
+                            svn_boolean_t pending,
+                            apr_pool_t *pool)
+{
+    apr_file_t *journal, *trees_file;
+    apr_int32_t flags = APR_CREATE | APR_TRUNCATE | APR_WRITE | APR_BUFFERED | APR_BINARY;
+
+    if (!pending) {
+        return open_journal_files(&c->journal, &c->trees_file, path, c->pool, pool);
+    }
 
-#define SYMLINK_CONTENT_PREFIX "link"
+    // Fold the journal while the cache has only entries stored by
+    // git fast-import, on close it has pending entries as well.
+    SVN_ERR(fold_journal(c, path, pool));
 
-struct checksum_cache_t
-{
-    apr_hash_t *cache;
-    apr_pool_t *pool;
-};
+    // Pending files are appended to them as is.
+    SVN_ERR(open_journal_files(&journal, &trees_file, path, pool, pool));
+    SVN_ERR(svn_io_file_close(journal, pool));
+    SVN_ERR(svn_io_file_close(trees_file, pool));
 
-checksum_cache_t *
-checksum_cache_create(apr_pool_t *pool)
-{
-    checksum_cache_t *c = apr_pcalloc(pool, sizeof(checksum_cache_t));
-    c->pool = pool;
-    c->cache = apr_hash_make(pool);
+    SVN_ERR(svn_io_file_open(&c->journal, pending_path(journal_path(path, pool), pool),
+                             flags, APR_OS_DEFAULT, c->pool));
+    SVN_ERR(svn_io_file_open(&c->trees_file, pending_path(trees_path(path, pool), pool),
+                             flags, APR_OS_DEFAULT, c->pool));
+    c->journal_pending = TRUE;
 
-    return c;
+    return SVN_NO_ERROR;
 }
 
-static svn_checksum_t *
-checksum_cache_get(checksum_cache_t *c,
-                   const svn_checksum_t *svn_checksum,
-                   apr_pool_t *pool)
+// Appends pending file of the file at path to it and removes it.
+static svn_error_t *
+append_pending(const char *path, apr_pool_t *pool)
 {
-    return svn_hash_gets(c->cache, svn_checksum_serialize(svn_checksum, pool, pool));
+    const char *src_path = pending_path(path, pool);
+    apr_file_t *src, *dst;
+    svn_node_kind_t kind;
+
+    SVN_ERR(svn_io_check_path(src_path, &kind, pool));
+    if (kind == svn_node_none) {
+        return SVN_NO_ERROR;
+    }
+
+    SVN_ERR(svn_io_file_open(&src, src_path, APR_READ | APR_BINARY,
+                             APR_OS_DEFAULT, pool));
+    SVN_ERR(svn_io_file_open(&dst, path, APR_CREATE | APR_WRITE | APR_APPEND | APR_BINARY,
+                             APR_OS_DEFAULT, pool));
+    SVN_ERR(svn_stream_copy3(svn_stream_from_aprfile2(src, FALSE, pool),
+                             svn_stream_from_aprfile2(dst, FALSE, pool),
+                             NULL, NULL, pool));
+    SVN_ERR(svn_io_remove_file2(src_path, FALSE, pool));
+
+    return SVN_NO_ERROR;
 }
 
-static void
-checksum_cache_set(checksum_cache_t *c,
-                   const svn_checksum_t *svn_checksum,
-                   const svn_checksum_t *git_checksum)
+svn_error_t *
+checksum_cache_commit_pending(const char *path, apr_pool_t *pool)
 {
-    svn_checksum_t *key = svn_checksum_dup(svn_checksum, c->pool);
-    svn_checksum_t *val = svn_checksum_dup(git_checksum, c->pool);
-    svn_hash_sets(c->cache, svn_checksum_serialize(key, c->pool, c->pool), val);
+    SVN_ERR(append_pending(journal_path(path, pool), pool));
+    SVN_ERR(append_pending(trees_path(path, pool), pool));
+
+    return SVN_NO_ERROR;
 }
 
 svn_error_t *
-checksum_cache_dump(checksum_cache_t *c,
-                    svn_stream_t *dst,
-                    apr_pool_t *pool)
+checksum_cache_discard_pending(const char *path, apr_pool_t *pool)
 {
-    apr_hash_index_t *idx;
-
-    for (idx = apr_hash_first(pool, c->cache); idx; idx = apr_hash_next(idx)) {
-        const svn_checksum_t *svn_checksum;
-        const svn_checksum_t *git_checksum = apr_hash_this_val(idx);
+    SVN_ERR(svn_io_remove_file2(pending_path(journal_path(path, pool), pool), TRUE, pool));
+    SVN_ERR(svn_io_remove_file2(pending_path(trees_path(path, pool), pool), TRUE, pool));
 
-        SVN_ERR(svn_checksum_deserialize(&svn_checksum, apr_hash_this_key(idx),
-                                         pool, pool));
+    return SVN_NO_ERROR;
+}
 
-        SVN_ERR(svn_stream_printf(dst, pool, "%s %s\n",
-                                  svn_checksum_to_cstring_display(svn_checksum, pool),
-                                  svn_checksum_to_cstring_display(git_checksum, pool)));
+void
+checksum_cache_commit_trees(checksum_cache_t *c)
+{
+    for (int i = 0; i < c->pending_trees->nelts; i++) {
+        tree_entry_t *entry = APR_ARRAY_IDX(c->pending_trees, i, tree_entry_t *);
+        svn_hash_sets(c->trees, entry->key, entry);
     }
+    apr_array_clear(c->pending_trees);
 
-    return SVN_NO_ERROR;
+    svn_stringbuf_appendstr(c->unsaved_records, c->pending_records);
+    svn_stringbuf_setempty(c->pending_records);
 }
 
-svn_error_t *
-checksum_cache_dump_path(checksum_cache_t *c,
-                         const char *path,
-                         apr_pool_t *pool)
+// Appends the first nentries pending entries and the first len bytes
+// of unsaved tree records to the journal and tree cache file.
+static svn_error_t *
+flush_records(checksum_cache_t *c,
+              int nentries,
+              apr_size_t len,
+              apr_pool_t *pool)
 {
-    apr_file_t *fd;
-    svn_stream_t *dst;
+    apr_array_header_t *pending = c->pending;
 
-    SVN_ERR(svn_io_file_open(&fd, path,
-                             APR_CREATE | APR_TRUNCATE | APR_BUFFERED | APR_WRITE,
-                             APR_OS_DEFAULT, pool));
+    if (c->journal == NULL) {
+        return SVN_NO_ERROR;
+    }
 
-    dst = svn_stream_from_aprfile2(fd, FALSE, pool);
-    SVN_ERR(checksum_cache_dump(c, dst, pool));
-    SVN_ERR(svn_stream_close(dst));
+    for (int i = 0; i < nentries; i++) {
+        const checksum_entry_t *entry = APR_ARRAY_IDX(pending, i, checksum_entry_t *);
+        SVN_ERR(svn_io_file_write_full(c->journal, entry->key,
+                                       CHECKSUM_DIGEST_LEN, NULL, pool));
+        SVN_ERR(svn_io_file_write_full(c->journal, entry->val,
+                                       CHECKSUM_DIGEST_LEN, NULL, pool));
+    }
+
+    c->journal_nrecords += nentries;
+    memmove(pending->elts, pending->elts + nentries * pending->elt_size,
+            (pending->nelts - nentries) * pending->elt_size);
+    pending->nelts -= nentries;
+
+    SVN_ERR(svn_io_file_flush(c->journal, pool));
+
+    SVN_ERR(svn_io_file_write_full(c->trees_file, c->unsaved_records->data,
+                                   len, NULL, pool));
+    svn_stringbuf_remove(c->unsaved_records, 0, len);
+
+    SVN_ERR(svn_io_file_flush(c->trees_file, pool));
 
     return SVN_NO_ERROR;
 }
 
 svn_error_t *
-checksum_cache_load(checksum_cache_t *c,
-                    svn_stream_t *src,
-                    apr_pool_t *pool)
+checksum_cache_flush(checksum_cache_t *c, apr_pool_t *pool)
 {
-    svn_boolean_t eof;
-    int lineno = 0;
-
-    while (TRUE) {
-        const char *next;
-        svn_checksum_t *svn_checksum, *git_checksum;
-        svn_stringbuf_t *buf;
-
-        SVN_ERR(svn_stream_readline(src, &buf, "\n", &eof, pool));
-        if (eof) {
-            break;
-        }
+    // Trees computed so far have been written along with their blobs.
+    checksum_cache_commit_trees(c);
 
-        lineno++;
+    c->marked_entries = 0;
+    c->marked_records = 0;
 
-        // Parse Subversion checksum.
-        SVN_ERR(svn_checksum_parse_hex(&svn_checksum, svn_checksum_sha1,
-                                       buf->data, pool));
+    return flush_records(c, c->pending->nelts, c->unsaved_records->len, pool);
+}
 
-        // Parse Git checksum.
-        next = strchr(buf->data, ' ');
-        if (next == NULL) {
-            return svn_error_createf(SVN_ERR_MALFORMED_FILE, NULL,
-                                     "line %d: %s", lineno, buf->data);
-        }
-        next++;
+void
+checksum_cache_mark(checksum_cache_t *c)
+{
+    c->marked_entries = c->pending->nelts;
+    c->marked_records = c->unsaved_records->len;
+}
 
-        SVN_ERR(svn_checksum_parse_hex(&git_checksum, svn_checksum_sha1,
-                                       next, pool));
+svn_error_t *
+checksum_cache_flush_marked(checksum_cache_t *c, apr_pool_t *pool)
+{
+    int nentries = c->marked_entries;
+    apr_size_t len = c->marked_records;
 
-        checksum_cache_set(c, svn_checksum, git_checksum);
-    }
+    c->marked_entries = 0;
+    c->marked_records = 0;
 
-    return SVN_NO_ERROR;
+    return flush_records(c, nentries, len, pool);
 }
 
 svn_error_t *
-checksum_cache_load_path(checksum_cache_t *cache,
-                         const char *path,
-                         apr_pool_t *pool)
+checksum_cache_close(checksum_cache_t *c,
+                     const char *path,
+                     apr_pool_t *pool)
 {
-    svn_error_t *err;
-    svn_stream_t *src;
-    svn_node_kind_t kind;
-
-    SVN_ERR(svn_io_check_path(path, &kind, pool));
-    if (kind == svn_node_none) {
+    if (c->journal == NULL) {
         return SVN_NO_ERROR;
     }
 
-    SVN_ERR(svn_stream_open_readonly(&src, path, pool, pool));
-    err = checksum_cache_load(cache, src, pool);
-    if (err) {
-        return svn_error_quick_wrap(err, "Malformed checksum cache file");
+    SVN_ERR(checksum_cache_flush(c, pool));
+    SVN_ERR(svn_io_file_close(c->journal, pool));
+    c->journal = NULL;
+    SVN_ERR(svn_io_file_close(c->trees_file, pool));
+    c->trees_file = NULL;
+
+    // Pending entries are not known to be stored yet.
+    if (c->journal_pending) {
+        return SVN_NO_ERROR;
     }
-    SVN_ERR(svn_stream_close(src));
 
-    return SVN_NO_ERROR;
+    return fold_journal(c, path, pool);
 }
 
 typedef struct
 {
     svn_stream_t *stream;
-    svn_checksum_ctx_t *read_ctx;
-    svn_checksum_ctx_t *write_ctx;
+    sha1_ctx_t *read_ctx;
+    sha1_ctx_t *write_ctx;
 } stream_ctx_t;
 
 static svn_error_t *
@@ -184,7 +1209,7 @@ read_handler(void *stream_ctx, char *buf, apr_size_t *len)
     SVN_ERR(svn_stream_read2(ctx->stream, buf, len));
 
     if (ctx->read_ctx != NULL) {
-        SVN_ERR(svn_checksum_update(ctx->read_ctx, buf, *len));
+        sha1_ctx_update(ctx->read_ctx, buf, *len);
     }
 
     return SVN_NO_ERROR;
@@ -196,7 +1221,7 @@ write_handler(void *stream_ctx, const char *data, apr_size_t *len)
     stream_ctx_t *ctx = stream_ctx;
 
     if (ctx->write_ctx != NULL) {
-        SVN_ERR(svn_checksum_update(ctx->write_ctx, data, *len));
+        sha1_ctx_update(ctx->write_ctx, data, *len);
     }
 
     SVN_ERR(svn_stream_write(ctx->stream, data, len));
@@ -218,8 +1243,8 @@ close_handler(void *stream_ctx)
 // read and written.
 static svn_stream_t *
 checksum_stream_create(svn_stream_t *s,
-                       svn_checksum_ctx_t *read_ctx,
-                       svn_checksum_ctx_t *write_ctx,
+                       sha1_ctx_t *read_ctx,
+                       sha1_ctx_t *write_ctx,
                        apr_pool_t *pool)
 {
     stream_ctx_t *ctx = apr_pcalloc(pool, sizeof(stream_ctx_t));
@@ -236,7 +1261,7 @@ checksum_stream_create(svn_stream_t *s,
 }
 
 svn_error_t *
-set_content_checksum(svn_checksum_t **checksum,
+set_content_checksum(svn_checksum_t *checksum,
                      svn_boolean_t *cached,
                      svn_stream_t *output,
                      checksum_cache_t *cache,
@@ -245,50 +1270,59 @@ set_content_checksum(svn_checksum_t **checksum,
                      apr_pool_t *result_pool,
                      apr_pool_t *scratch_pool)
 {
-    const char *hdr;
-    apr_hash_t *props;
+    char hdr[64];
+    apr_size_t hdr_len;
     svn_checksum_t *svn_checksum, *git_checksum;
-    svn_checksum_ctx_t *ctx;
+    sha1_ctx_t ctx;
     svn_filesize_t size;
     svn_stream_t *content;
 
     SVN_ERR(svn_fs_file_checksum(&svn_checksum, svn_checksum_sha1,
                                  root, path, FALSE, scratch_pool));
 
-    git_checksum = checksum_cache_get(cache, svn_checksum, scratch_pool);
-    if (git_checksum != NULL) {
-        *checksum = git_checksum;
+    if (checksum_cache_get(checksum, cache, svn_checksum)) {
         *cached = TRUE;
         return SVN_NO_ERROR;
     }
 
-    SVN_ERR(svn_fs_node_proplist(&props, root, path, scratch_pool));
-    SVN_ERR(svn_fs_file_length(&size, root, path, scratch_pool));
-    SVN_ERR(svn_fs_file_contents(&content, root, path, scratch_pool));
+    if (cache->prefetched != NULL) {
+        const blob_job_t *job = apr_hash_get(cache->prefetched, svn_checksum->digest,
+                                             CHECKSUM_DIGEST_LEN);
+        if (job != NULL) {
+            if (job->content != NULL) {
+                apr_size_t len = job->content->len;
+
+                hdr_len = apr_snprintf(hdr, sizeof(hdr), "blob\ndata %" APR_SIZE_T_FMT "\n", len);
+                SVN_ERR(svn_stream_write(output, hdr, &hdr_len));
+                SVN_ERR(svn_stream_write(output, job->content->data, &len));
+            }
 
-    // We need to strip a symlink marker from the beginning of a content
-    // and subtract a symlink marker length from the blob size.
-    if (svn_hash_gets(props, SVN_PROP_SPECIAL)) {
-        apr_size_t skip = sizeof(SYMLINK_CONTENT_PREFIX);
-        SVN_ERR(svn_stream_skip(content, skip));
-        size -= skip;
+            checksum_cache_set(cache, svn_checksum, job->checksum);
+            checksum_cache_get(checksum, cache, svn_checksum);
+            *cached = FALSE;
+            return SVN_NO_ERROR;
+        }
     }
 
-    hdr = apr_psprintf(scratch_pool, "blob %ld", size);
-    ctx = svn_checksum_ctx_create(svn_checksum_sha1, scratch_pool);
-    SVN_ERR(svn_checksum_update(ctx, hdr, strlen(hdr) + 1));
+    SVN_ERR(open_blob_contents(&content, &size, root, path, scratch_pool));
 
-    SVN_ERR(svn_stream_printf(output, scratch_pool, "blob\n"));
-    SVN_ERR(svn_stream_printf(output, scratch_pool, "data %ld\n", size));
+    // Format headers on the stack, so that hashing a blob takes
+    // no allocations besides its content stream.
+    hdr_len = apr_snprintf(hdr, sizeof(hdr), "blob %" SVN_FILESIZE_T_FMT, size);
+    sha1_ctx_init(&ctx);
+    sha1_ctx_update(&ctx, hdr, hdr_len + 1);
 
-    output = checksum_stream_create(output, NULL, ctx, scratch_pool);
+    hdr_len = apr_snprintf(hdr, sizeof(hdr), "blob\ndata %" SVN_FILESIZE_T_FMT "\n", size);
+    SVN_ERR(svn_stream_write(output, hdr, &hdr_len));
+
+    output = checksum_stream_create(output, NULL, &ctx, scratch_pool);
 
     SVN_ERR(svn_stream_copy3(content, output, NULL, NULL, scratch_pool));
 
-    SVN_ERR(svn_checksum_final(&git_checksum, ctx, result_pool));
+    git_checksum = sha1_ctx_final(&ctx, result_pool);
 
     checksum_cache_set(cache, svn_checksum, git_checksum);
-    *checksum = git_checksum;
+    *checksum = *git_checksum;
     *cached = FALSE;
 
     return SVN_NO_ERROR;
@@ -330,29 +1364,256 @@ compare_items_gitlike(const sort_item_t *a,
     return 0;
 }
 
-svn_error_t *
-set_tree_checksum(svn_checksum_t **checksum,
-                  svn_boolean_t *cached,
-                  apr_array_header_t **entries,
-                  svn_stream_t *output,
+// Feeds ignored paths below t into ctx in a canonical order.
+static svn_error_t *
+ignores_fingerprint_update(svn_checksum_ctx_t *ctx,
+                           const tree_t *t,
+                           apr_pool_t *pool)
+{
+    // Children are kept sorted by name.
+    for (int i = 0; i < t->nodes->nelts; i++) {
+        const tree_node_t *node = &APR_ARRAY_IDX(t->nodes, i, tree_node_t);
+        char flag = (node->tree->value != NULL) ? '+' : '-';
+
+        SVN_ERR(svn_checksum_update(ctx, node->name, node->len + 1));
+        SVN_ERR(svn_checksum_update(ctx, &flag, 1));
+        SVN_ERR(ignores_fingerprint_update(ctx, node->tree, pool));
+    }
+
+    // Mark the end of children list, so that siblings
+    // are not confused with descendants.
+    SVN_ERR(svn_checksum_update(ctx, "", 1));
+
+    return SVN_NO_ERROR;
+}
+
+// Sets key of a tree cache entry for directory at path. Two directories
+// with the same node revision id have the same content, so they have the
+// same Git tree as long as the same paths below them are ignored.
+// Patterns match repository paths, so with patterns the key depends
+// on path as well.
+static svn_error_t *
+tree_cache_key(const char **key,
+               svn_fs_root_t *root,
+               const char *path,
+               const ignores_t *ignores,
+               apr_pool_t *pool)
+{
+    const svn_fs_id_t *id;
+    svn_checksum_t *fingerprint;
+    svn_checksum_ctx_t *ctx;
+    svn_string_t *id_str;
+    svn_boolean_t has_patterns;
+
+    SVN_ERR(svn_fs_node_id(&id, root, path, pool));
+    id_str = svn_fs_unparse_id(id, pool);
+
+    has_patterns = (ignores->patterns != NULL && pattern_set_labels(ignores->patterns) != 0);
+    if ((ignores->paths == NULL || ignores->paths->nodes->nelts == 0) && !has_patterns) {
+        *key = id_str->data;
+        return SVN_NO_ERROR;
+    }
+
+    ctx = svn_checksum_ctx_create(svn_checksum_sha1, pool);
+    if (ignores->paths != NULL) {
+        SVN_ERR(ignores_fingerprint_update(ctx, ignores->paths, pool));
+    }
+
+    if (has_patterns) {
+        const svn_stringbuf_t *source = pattern_set_source(ignores->patterns);
+        const char *branch_path = ignores->branch_path ? ignores->branch_path : "";
+
+        SVN_ERR(svn_checksum_update(ctx, source->data, source->len + 1));
+        SVN_ERR(svn_checksum_update(ctx, path, strlen(path) + 1));
+        SVN_ERR(svn_checksum_update(ctx, branch_path, strlen(branch_path) + 1));
+        if (ignores->no_ignores != NULL) {
+            SVN_ERR(ignores_fingerprint_update(ctx, ignores->no_ignores, pool));
+        }
+    }
+
+    SVN_ERR(svn_checksum_final(&fingerprint, ctx, pool));
+
+    *key = apr_pstrcat(pool, id_str->data, " ",
+                       svn_checksum_to_cstring_display(fingerprint, pool),
+                       NULL);
+
+    return SVN_NO_ERROR;
+}
+
+// Looks tree at path up in cache, sets entry to NULL if there is none.
+// Sets key of the tree either way.
+static svn_error_t *
+tree_cache_lookup(tree_entry_t **entry,
+                  const char **key,
                   checksum_cache_t *cache,
                   svn_fs_root_t *root,
                   const char *path,
                   const char *root_path,
-                  const char *rewrite_root_path,
-                  tree_t *ignores,
-                  apr_pool_t *result_pool,
-                  apr_pool_t *scratch_pool)
+                  const ignores_t *ignores,
+                  apr_pool_t *pool)
+{
+    const char *relpath = svn_dirent_skip_ancestor(root_path, path);
+    ignores_t subtree_ignores = *ignores;
+
+    if (*relpath != '\0') {
+        subtree_ignores.paths = tree_subtree(ignores->paths, relpath);
+        if (ignores->no_ignores != NULL) {
+            subtree_ignores.no_ignores = tree_subtree(ignores->no_ignores, relpath);
+        }
+    }
+
+    SVN_ERR(tree_cache_key(key, root, path, &subtree_ignores, pool));
+    *entry = svn_hash_gets(cache->trees, *key);
+
+    return SVN_NO_ERROR;
+}
+
+// Tests if node_path at subpath below the root of a walk is ignored.
+// Not ignored paths and patterns override ignored ones.
+static svn_boolean_t
+is_ignored(const ignores_t *ignores, const char *node_path, const char *subpath)
+{
+    svn_boolean_t ignored = (tree_match(ignores->paths, subpath) != NULL);
+    int labels;
+
+    if (ignores->patterns == NULL) {
+        return ignored;
+    }
+
+    labels = pattern_set_match(ignores->patterns, node_path,
+                               ignores->branch_path != NULL
+                                   ? svn_relpath_skip_ancestor(ignores->branch_path, node_path)
+                                   : NULL);
+
+    if (labels & (PATTERN_IGNORE_ABSPATH | PATTERN_IGNORE_PATH)) {
+        ignored = TRUE;
+    }
+
+    if (!ignored || (labels & PATTERN_NO_IGNORE_ABSPATH)) {
+        return FALSE;
+    }
+
+    return ignores->no_ignores == NULL || tree_match(ignores->no_ignores, subpath) == NULL;
+}
+
+static svn_error_t *
+tree_checksum(svn_checksum_t *checksum,
+              svn_boolean_t *cached,
+              apr_array_header_t **entries,
+              svn_stream_t *output,
+              checksum_cache_t *cache,
+              svn_fs_root_t *root,
+              const char *path,
+              const char *root_path,
+              const char *rewrite_root_path,
+              const ignores_t *ignores,
+              svn_boolean_t lookup,
+              svn_boolean_t recurse,
+              apr_pool_t *result_pool,
+              apr_pool_t *scratch_pool);
+
+// Sets entries of a cached tree at path from its cached entries,
+// subtrees are taken from cache as well.
+static svn_error_t *
+cached_tree_entries(apr_array_header_t **entries,
+                    tree_entry_t *tree_entry,
+                    svn_stream_t *output,
+                    checksum_cache_t *cache,
+                    svn_fs_root_t *root,
+                    const char *path,
+                    const char *root_path,
+                    const char *rewrite_root_path,
+                    const ignores_t *ignores,
+                    apr_pool_t *result_pool,
+                    apr_pool_t *scratch_pool)
+{
+    apr_array_header_t *nodes = apr_array_make(result_pool, tree_entry->nchildren,
+                                               sizeof(node_t));
+
+    for (int i = 0; i < tree_entry->nchildren; i++) {
+        tree_child_t *child = &tree_entry->children[i];
+        const char *node_path, *subpath;
+        node_t *node = apr_array_push(nodes);
+
+        node_path = svn_relpath_join(path, child->name, scratch_pool);
+        subpath = svn_dirent_skip_ancestor(root_path, node_path);
+
+        node->mode = child->mode;
+        node->checksum = child->checksum;
+        node->cached = TRUE;
+        node->entries = NULL;
+
+        if (child->mode == MODE_DIR) {
+            svn_boolean_t from_cache;
+
+            node->kind = svn_node_dir;
+            SVN_ERR(tree_checksum(&node->checksum, &from_cache, &node->entries,
+                                  output, cache, root, node_path,
+                                  root_path, rewrite_root_path, ignores,
+                                  TRUE, TRUE, result_pool, scratch_pool));
+        } else {
+            node->kind = svn_node_file;
+        }
+
+        if (rewrite_root_path != NULL) {
+            subpath = svn_relpath_join(rewrite_root_path, subpath, result_pool);
+        }
+        node->path = subpath;
+    }
+
+    *entries = nodes;
+
+    return SVN_NO_ERROR;
+}
+
+// Sets checksum and entries of a tree at path. Looks the tree itself up
+// in cache only if lookup is set, subtrees are always looked up. Entries
+// of cached trees are set only if recurse is set and they are cached.
+static svn_error_t *
+tree_checksum(svn_checksum_t *checksum,
+              svn_boolean_t *cached,
+              apr_array_header_t **entries,
+              svn_stream_t *output,
+              checksum_cache_t *cache,
+              svn_fs_root_t *root,
+              const char *path,
+              const char *root_path,
+              const char *rewrite_root_path,
+              const ignores_t *ignores,
+              svn_boolean_t lookup,
+              svn_boolean_t recurse,
+              apr_pool_t *result_pool,
+              apr_pool_t *scratch_pool)
 {
     apr_array_header_t *sorted_entries, *nodes;
     apr_hash_t *dir_entries;
-    const char *hdr, *ignored;
-    svn_checksum_ctx_t *ctx;
-    svn_stringbuf_t *buf;
+    const char *hdr, *key;
+    sha1_ctx_t ctx;
+    svn_stringbuf_t *buf, *listing = NULL;
+    tree_entry_t *tree_entry;
     *cached = TRUE;
 
-    ctx = svn_checksum_ctx_create(svn_checksum_sha1, scratch_pool);
+    SVN_ERR(tree_cache_lookup(&tree_entry, &key, cache, root, path,
+                              root_path, ignores, scratch_pool));
+    if (lookup && tree_entry != NULL) {
+        *checksum = tree_entry->checksum;
+        *entries = NULL;
+        if (!recurse) {
+            return SVN_NO_ERROR;
+        }
+        if (tree_entry->children != NULL) {
+            return cached_tree_entries(entries, tree_entry, output, cache,
+                                       root, path, root_path, rewrite_root_path,
+                                       ignores, result_pool, scratch_pool);
+        }
+    }
+
+    sha1_ctx_init(&ctx);
     buf = svn_stringbuf_create_empty(scratch_pool);
+    // Entries are recorded only for trees to be saved.
+    if (cache->trees_file != NULL) {
+        listing = svn_stringbuf_create_empty(scratch_pool);
+    }
     nodes = apr_array_make(result_pool, 0, sizeof(node_t));
 
     SVN_ERR(svn_fs_dir_entries(&dir_entries, root, path, scratch_pool));
@@ -366,23 +1627,22 @@ set_tree_checksum(svn_checksum_t **checksum,
         sort_item_t item = APR_ARRAY_IDX(sorted_entries, i, sort_item_t);
         svn_fs_dirent_t *entry = item.value;
         svn_boolean_t from_cache;
-        svn_checksum_t *node_checksum;
+        svn_checksum_t node_checksum;
 
         node_path = svn_relpath_join(path, entry->name, scratch_pool);
         subpath = svn_dirent_skip_ancestor(root_path, node_path);
 
-        ignored = tree_match(ignores, subpath, scratch_pool);
-        if (ignored != NULL) {
+        if (is_ignored(ignores, node_path, subpath)) {
             continue;
         }
 
         if (entry->kind == svn_node_dir) {
-            SVN_ERR(set_tree_checksum(&node_checksum, &from_cache, &subentries,
-                                      output, cache, root, node_path,
-                                      root_path, rewrite_root_path, ignores,
-                                      result_pool, scratch_pool));
+            SVN_ERR(tree_checksum(&node_checksum, &from_cache, &subentries,
+                                  output, cache, root, node_path,
+                                  root_path, rewrite_root_path, ignores,
+                                  TRUE, recurse, result_pool, scratch_pool));
             // Skip empty directories.
-            if (subentries->nelts == 0) {
+            if (subentries != NULL && subentries->nelts == 0) {
                 continue;
             }
         } else {
@@ -405,8 +1665,17 @@ set_tree_checksum(svn_checksum_t **checksum,
 
         record = apr_psprintf(scratch_pool, "%o %s", node->mode, entry->name);
         svn_stringbuf_appendbytes(buf, record, strlen(record) + 1);
-        svn_stringbuf_appendbytes(buf, (const char *)node->checksum->digest,
-                                  svn_checksum_size(node->checksum));
+        svn_stringbuf_appendbytes(buf, (const char *)node->checksum.digest,
+                                  svn_checksum_size(&node->checksum));
+
+        if (listing != NULL) {
+            char hex[2 * CHECKSUM_DIGEST_LEN];
+
+            hex_encode(hex, node->checksum.digest, CHECKSUM_DIGEST_LEN);
+            svn_stringbuf_appendcstr(listing, apr_psprintf(scratch_pool, "\t%o %.*s %s\n",
+                                                          node->mode, (int)sizeof(hex), hex,
+                                                          entry->name));
+        }
 
         *cached &= from_cache;
     }
@@ -415,9 +1684,173 @@ set_tree_checksum(svn_checksum_t **checksum,
 
     hdr = apr_psprintf(scratch_pool, "tree %ld", buf->len);
 
-    SVN_ERR(svn_checksum_update(ctx, hdr, strlen(hdr) + 1));
-    SVN_ERR(svn_checksum_update(ctx, buf->data, buf->len));
-    SVN_ERR(svn_checksum_final(checksum, ctx, result_pool));
+    sha1_ctx_update(&ctx, hdr, strlen(hdr) + 1);
+    sha1_ctx_update(&ctx, buf->data, buf->len);
+    *checksum = *sha1_ctx_final(&ctx, result_pool);
+
+    // Git has no empty trees, so there is nothing to remember.
+    if (nodes->nelts > 0) {
+        tree_entry = apr_palloc(cache->pool, sizeof(tree_entry_t));
+        tree_entry->key = apr_pstrdup(cache->pool, key);
+        memcpy(tree_entry->val, checksum->digest, CHECKSUM_DIGEST_LEN);
+        tree_entry->checksum.kind = svn_checksum_sha1;
+        tree_entry->checksum.digest = tree_entry->val;
+        tree_entry->children = NULL;
+        tree_entry->nchildren = 0;
+        APR_ARRAY_PUSH(cache->pending_trees, tree_entry_t *) = tree_entry;
+
+        if (listing != NULL) {
+            char hex[2 * CHECKSUM_DIGEST_LEN];
+
+            hex_encode(hex, tree_entry->val, CHECKSUM_DIGEST_LEN);
+            svn_stringbuf_appendcstr(cache->pending_records,
+                                     apr_psprintf(scratch_pool, "%.*s %s\n",
+                                                  (int)sizeof(hex), hex, key));
+            svn_stringbuf_appendstr(cache->pending_records, listing);
+            svn_stringbuf_appendbyte(cache->pending_records, '\n');
+        }
+    }
+
+    return SVN_NO_ERROR;
+}
+
+svn_error_t *
+set_tree_checksum(svn_checksum_t *checksum,
+                  svn_boolean_t *cached,
+                  apr_array_header_t **entries,
+                  svn_stream_t *output,
+                  checksum_cache_t *cache,
+                  svn_fs_root_t *root,
+                  const char *path,
+                  const char *root_path,
+                  const char *rewrite_root_path,
+                  const ignores_t *ignores,
+                  apr_pool_t *result_pool,
+                  apr_pool_t *scratch_pool)
+{
+    return tree_checksum(checksum, cached, entries, output, cache, root,
+                         path, root_path, rewrite_root_path, ignores, TRUE,
+                         FALSE, result_pool, scratch_pool);
+}
+
+svn_error_t *
+list_tree_checksum(svn_checksum_t *checksum,
+                   svn_boolean_t *cached,
+                   apr_array_header_t **entries,
+                   svn_stream_t *output,
+                   checksum_cache_t *cache,
+                   svn_fs_root_t *root,
+                   const char *path,
+                   const char *root_path,
+                   const char *rewrite_root_path,
+                   const ignores_t *ignores,
+                   svn_boolean_t recurse,
+                   apr_pool_t *result_pool,
+                   apr_pool_t *scratch_pool)
+{
+    return tree_checksum(checksum, cached, entries, output, cache, root,
+                         path, root_path, rewrite_root_path, ignores, FALSE,
+                         recurse, result_pool, scratch_pool);
+}
+
+static svn_error_t *
+collect_blobs(apr_array_header_t *jobs,
+              apr_hash_t *seen,
+              checksum_cache_t *cache,
+              svn_fs_root_t *root,
+              const char *path,
+              const char *root_path,
+              const ignores_t *ignores,
+              apr_pool_t *result_pool,
+              apr_pool_t *scratch_pool)
+{
+    apr_hash_t *dir_entries;
+    apr_hash_index_t *idx;
+    apr_pool_t *iterpool = svn_pool_create(scratch_pool);
+
+    SVN_ERR(svn_fs_dir_entries(&dir_entries, root, path, scratch_pool));
+
+    for (idx = apr_hash_first(scratch_pool, dir_entries); idx; idx = apr_hash_next(idx)) {
+        const char *node_path, *subpath, *key;
+        svn_fs_dirent_t *entry = apr_hash_this_val(idx);
+        svn_checksum_t *svn_checksum;
+        tree_entry_t *tree_entry;
+        blob_job_t *job;
+
+        svn_pool_clear(iterpool);
+
+        node_path = svn_relpath_join(path, entry->name, iterpool);
+        subpath = svn_dirent_skip_ancestor(root_path, node_path);
+
+        if (is_ignored(ignores, node_path, subpath)) {
+            continue;
+        }
+
+        if (entry->kind == svn_node_dir) {
+            SVN_ERR(tree_cache_lookup(&tree_entry, &key, cache, root, node_path,
+                                      root_path, ignores, iterpool));
+            if (tree_entry == NULL) {
+                SVN_ERR(collect_blobs(jobs, seen, cache, root, node_path,
+                                      root_path, ignores, result_pool, iterpool));
+            }
+            continue;
+        }
+
+        SVN_ERR(svn_fs_file_checksum(&svn_checksum, svn_checksum_sha1,
+                                     root, node_path, FALSE, iterpool));
+
+        if (checksum_cache_contains(cache, svn_checksum)) {
+            continue;
+        }
+
+        if (apr_hash_get(seen, svn_checksum->digest, CHECKSUM_DIGEST_LEN) != NULL) {
+            continue;
+        }
+
+        job = apr_pcalloc(result_pool, sizeof(blob_job_t));
+        job->revnum = svn_fs_revision_root_revision(root);
+        job->path = apr_pstrdup(result_pool, node_path);
+        job->svn_checksum = svn_checksum_dup(svn_checksum, result_pool);
+
+        apr_hash_set(seen, job->svn_checksum->digest, CHECKSUM_DIGEST_LEN, job);
+        APR_ARRAY_PUSH(jobs, blob_job_t *) = job;
+    }
+
+    svn_pool_destroy(iterpool);
 
     return SVN_NO_ERROR;
 }
+
+svn_error_t *
+collect_tree_blobs(apr_array_header_t *jobs,
+                   checksum_cache_t *cache,
+                   svn_fs_root_t *root,
+                   const char *path,
+                   const char *root_path,
+                   const ignores_t *ignores,
+                   apr_pool_t *result_pool,
+                   apr_pool_t *scratch_pool)
+{
+    apr_hash_t *seen = apr_hash_make(scratch_pool);
+
+    return collect_blobs(jobs, seen, cache, root, path, root_path, ignores,
+                         result_pool, scratch_pool);
+}
+
+void
+checksum_cache_prefetch(checksum_cache_t *c,
+                        const apr_array_header_t *jobs,
+                        apr_pool_t *pool)
+{
+    if (jobs == NULL) {
+        c->prefetched = NULL;
+        return;
+    }
+
+    c->prefetched = apr_hash_make(pool);
+
+    for (int i = 0; i < jobs->nelts; i++) {
+        blob_job_t *job = APR_ARRAY_IDX(jobs, i, blob_job_t *);
+        apr_hash_set(c->prefetched, job->svn_checksum->digest, CHECKSUM_DIGEST_LEN, job);
+    }
+}
@@ -23,22 +23,57 @@
 #ifndef GIT_SVN_FAST_IMPORT_CHECKSUM_H_
 #define GIT_SVN_FAST_IMPORT_CHECKSUM_H_
 
+#include "hasher.h"
+#include "pattern.h"
 #include "tree.h"
 #include <svn_checksum.h>
 #include <svn_fs.h>
 
+// Paths ignored below a tree being walked.
+typedef struct
+{
+    // Ignored paths relative to the root of the walk.
+    const tree_t *paths;
+    // Paths relative to the root of the walk overriding ignore patterns,
+    // may be NULL.
+    const tree_t *no_ignores;
+    // Patterns matched against repository paths, may be NULL.
+    pattern_set_t *patterns;
+    // Path of the branch PATTERN_IGNORE_PATH patterns are relative to,
+    // may be NULL.
+    const char *branch_path;
+} ignores_t;
+
 // Abstract type for checksum cache.
 typedef struct checksum_cache_t checksum_cache_t;
 
+// On-disk formats of checksum cache.
+typedef enum
+{
+    // Lines of "svn-sha1 git-sha1" hex checksums.
+    checksum_cache_format_text,
+    // Versioned file of sorted raw checksum records, memory-mapped on load.
+    checksum_cache_format_binary
+} checksum_cache_format_t;
+
 // Create new checksum cache.
 checksum_cache_t *
 checksum_cache_create(apr_pool_t *pool);
 
+// Returns format used by checksum_cache_dump_path().
+// Defaults to the format of a loaded file, or text.
+checksum_cache_format_t
+checksum_cache_get_format(const checksum_cache_t *c);
+
+void
+checksum_cache_set_format(checksum_cache_t *c, checksum_cache_format_t format);
+
 svn_error_t *
 checksum_cache_dump(checksum_cache_t *c,
                     svn_stream_t *dst,
                     apr_pool_t *pool);
 
+// Dumps checksum cache into path using current format.
 svn_error_t *
 checksum_cache_dump_path(checksum_cache_t *c,
                          const char *path,
@@ -49,13 +84,101 @@ checksum_cache_load(checksum_cache_t *c,
                     svn_stream_t *src,
                     apr_pool_t *pool);
 
+// Loads checksum cache from path in either format followed by
+// its journal. Binary files are mapped into memory for the cache lifetime.
 svn_error_t *
 checksum_cache_load_path(checksum_cache_t *c,
                          const char *path,
                          apr_pool_t *pool);
 
+// Opens journal and tree cache file of the cache file at path for
+// appending. Entries and trees added from now on are written into them
+// by checksum_cache_flush().
+//
+// Entries are flushed once their blobs are written into the output,
+// not once git fast-import stores them. If pending is set, they are
+// written into pending files instead, which are appended to the journal
+// and tree cache file by checksum_cache_commit_pending() once
+// git fast-import succeeds.
+svn_error_t *
+checksum_cache_open_journal(checksum_cache_t *c,
+                            const char *path,
+                            svn_boolean_t pending,
+                            apr_pool_t *pool);
+
+// Appends pending files of the cache file at path to its journal
+// and tree cache file and removes them.
+svn_error_t *
+checksum_cache_commit_pending(const char *path, apr_pool_t *pool);
+
+// Removes pending files of the cache file at path.
+svn_error_t *
+checksum_cache_discard_pending(const char *path, apr_pool_t *pool);
+
+// Caches trees computed since the last call. Must be called once
+// everything computed so far has been written into the output stream,
+// the trees may be referenced by the following revisions.
+void
+checksum_cache_commit_trees(checksum_cache_t *c);
+
+// Appends entries added since the last flush to the journal.
+// Must be called once everything computed so far has been written,
+// as trees computed since the last flush are cached from now on.
+svn_error_t *
+checksum_cache_flush(checksum_cache_t *c, apr_pool_t *pool);
+
+// Marks entries and trees cached so far to be appended by
+// checksum_cache_flush_marked(), once they are known to be written.
+void
+checksum_cache_mark(checksum_cache_t *c);
+
+// Appends entries and trees marked by the last checksum_cache_mark()
+// to the journal and tree cache file.
 svn_error_t *
-set_content_checksum(svn_checksum_t **checksum,
+checksum_cache_flush_marked(checksum_cache_t *c, apr_pool_t *pool);
+
+// Flushes and closes the journal. Folds the journal into the cache
+// file at path once it grows past a fraction of the cache file.
+// Pending journal is folded by checksum_cache_open_journal() instead.
+svn_error_t *
+checksum_cache_close(checksum_cache_t *c,
+                     const char *path,
+                     apr_pool_t *pool);
+
+// Loads checksums of trees written into Git from a file
+// stored next to the cache file at path, if there is one.
+// Entries of trees are loaded as well if entries is set,
+// so that cached trees can be listed recursively.
+svn_error_t *
+checksum_cache_load_trees(checksum_cache_t *c,
+                          const char *path,
+                          svn_boolean_t entries,
+                          apr_pool_t *pool);
+
+// Returns TRUE if Git checksum for Subversion checksum is cached.
+svn_boolean_t
+checksum_cache_contains(const checksum_cache_t *c,
+                        const svn_checksum_t *svn_checksum);
+
+// Adds new entry and schedules it for writing into the journal,
+// unless the same entry is cached already.
+// Blob must be written into Git beforehand.
+void
+checksum_cache_set(checksum_cache_t *c,
+                   const svn_checksum_t *svn_checksum,
+                   const svn_checksum_t *git_checksum);
+
+// Makes checksums computed by jobs available to set_content_checksum()
+// until the next call, NULL jobs drop them. Blobs are written to output
+// from prefetched contents, blobs prefetched without contents are not
+// written at all.
+void
+checksum_cache_prefetch(checksum_cache_t *c,
+                        const apr_array_header_t *jobs,
+                        apr_pool_t *pool);
+
+svn_error_t *
+set_content_checksum(svn_checksum_t *checksum,
                      svn_boolean_t *cached,
                      svn_stream_t *output,
                      checksum_cache_t *cache,
@@ -64,8 +187,11 @@ set_content_checksum(svn_checksum_t **checksum,
                      apr_pool_t *result_pool,
                      apr_pool_t *scratch_pool);
 
+// Sets Git checksum of a tree at path and its entries. Trees written
+// before are looked up by node revision id and set of ignored paths
+// below them, such trees are cached and have no entries.
 svn_error_t *
-set_tree_checksum(svn_checksum_t **checksum,
+set_tree_checksum(svn_checksum_t *checksum,
                   svn_boolean_t *cached,
                   apr_array_header_t **entries,
                   svn_stream_t *output,
@@ -74,8 +200,40 @@ set_tree_checksum(svn_checksum_t **checksum,
                   const char *path,
                   const char *root_path,
                   const char *rewrite_root_path,
-                  tree_t *ignores,
+                  const ignores_t *ignores,
                   apr_pool_t *result_pool,
                   apr_pool_t *scratch_pool);
 
+// Same as set_tree_checksum(), but never takes the tree at path itself
+// from cache, so its entries are always set. Entries of subtrees are
+// set as well if recurse is set, cached ones are listed from their
+// cached entries where loaded.
+svn_error_t *
+list_tree_checksum(svn_checksum_t *checksum,
+                   svn_boolean_t *cached,
+                   apr_array_header_t **entries,
+                   svn_stream_t *output,
+                   checksum_cache_t *cache,
+                   svn_fs_root_t *root,
+                   const char *path,
+                   const char *root_path,
+                   const char *rewrite_root_path,
+                   const ignores_t *ignores,
+                   svn_boolean_t recurse,
+                   apr_pool_t *result_pool,
+                   apr_pool_t *scratch_pool);
+
+// Collects files below path into jobs as blob_job_t pointers, skipping
+// ones which checksums are cached. Follows set_tree_checksum() walk,
+// a file is collected once per content.
+svn_error_t *
+collect_tree_blobs(apr_array_header_t *jobs,
+                   checksum_cache_t *cache,
+                   svn_fs_root_t *root,
+                   const char *path,
+                   const char *root_path,
+                   const ignores_t *ignores,
+                   apr_pool_t *result_pool,
+                   apr_pool_t *scratch_pool);
+
 #endif // GIT_SVN_FAST_IMPORT_CHECKSUM_H_
@@ -21,204 +21,732 @@
  */
 
 #include "commit.h"
+#include "utils.h"
+#include <apr_mmap.h>
+#include <apr_strings.h>
+
+// Binary commit cache file layout:
+//
+//   magic       8 bytes, COMMIT_CACHE_MAGIC
+//   version     4 bytes, big-endian
+//   record size 4 bytes, big-endian
+//   chunks, one appended by every dump
+//
+// Chunk layout:
+//
+//   nbranches   4 bytes, big-endian
+//   names size  4 bytes, big-endian
+//   ncommits    4 bytes, big-endian
+//   nmerges     4 bytes, big-endian
+//   refnames    names size bytes, nbranches NUL-terminated refnames
+//   commits     ncommits * record size bytes
+//   merges      nmerges * 4 bytes, big-endian marks
+//
+// Refnames get consecutive ids in order of appearance in the file,
+// a chunk only has refnames not stored by previous chunks.
+// Every commit record is revnum, refname id, mark, parent
+// and number of merges, 4 bytes big-endian each. Merges of commits
+// follow each other in order of commits. A trailing partial chunk
+// left by a killed process is ignored on load and cut off before
+// appending.
+#define COMMIT_CACHE_MAGIC "SVNGITRM"
+#define COMMIT_CACHE_MAGIC_LEN 8
+#define COMMIT_CACHE_VERSION 1
+#define COMMIT_CACHE_HEADER_LEN 16
+#define COMMIT_CHUNK_HEADER_LEN 16
+#define COMMIT_RECORD_LEN 20
+
+// Commits are stored in pages of consecutive ids, 2^COMMIT_PAGE_SHIFT
+// of them unless memory limit is too small to hold COMMIT_MIN_PAGES.
+#define COMMIT_PAGE_SHIFT 12
+#define COMMIT_MIN_PAGE_SHIFT 4
+#define COMMIT_MIN_PAGES 16
+#define PAGE_SIZE(c) ((commit_id_t)1 << (c)->page_shift)
+#define PAGE_NUMBER(c, commit) ((commit) >> (c)->page_shift)
+#define PAGE_SLOT(c, commit) ((commit) & (PAGE_SIZE(c) - 1))
+// Size of columns of a commit in a page.
+#define PAGE_COMMIT_LEN (sizeof(svn_revnum_t) + 5 * sizeof(uint32_t))
+
+typedef struct
+{
+    // Pool of the page, destroyed when the page is spilled.
+    apr_pool_t *pool;
+    int ncommits;
+    svn_revnum_t *revnums;
+    uint32_t *branch_ids;
+    mark_t *marks;
+    mark_t *parents;
+    // Offset and length of merges of a commit in merges.
+    uint32_t *merges_offsets;
+    uint32_t *merges_counts;
+    apr_array_header_t *merges;
+    // Arrays of slots of commits of every branch in order of addition,
+    // indexed by branch id, built when the page is loaded.
+    apr_array_header_t *branch_slots;
+} commit_page_t;
 
 typedef struct
 {
-    svn_revnum_t revnum;
-    branch_t *branch;
-} cache_key_t;
+    // Page in memory, NULL if it is spilled.
+    commit_page_t *page;
+    // Page has been changed since it was spilled.
+    svn_boolean_t dirty;
+    // Last access of the page.
+    apr_uint32_t tick;
+    // Location and size of the slot of the page in the spill file,
+    // size is 0 if the page has never been spilled.
+    apr_off_t offset;
+    apr_size_t slot_size;
+} page_info_t;
+
+typedef struct
+{
+    uint32_t page;
+    svn_revnum_t min_revnum;
+} branch_page_t;
 
 commit_cache_t *
 commit_cache_create(apr_pool_t *pool)
 {
     commit_cache_t *c = apr_pcalloc(pool, sizeof(commit_cache_t));
     c->pool = pool;
-    c->commits = apr_array_make(pool, 0, sizeof(commit_t));
-    c->idx = apr_hash_make(pool);
-    c->marks = apr_array_make(pool, 0, sizeof(commit_t *));
+    c->pages = apr_array_make(pool, 0, sizeof(page_info_t));
+    c->branches = apr_array_make(pool, 0, sizeof(branch_t *));
+    c->branch_ids_idx = apr_hash_make(pool);
+    c->idx = apr_array_make(pool, 0, sizeof(apr_array_header_t *));
+    c->marked = apr_array_make(pool, 0, sizeof(commit_id_t));
+    c->generations = apr_array_make(pool, 0, sizeof(apr_uint32_t));
+    c->visited = apr_array_make(pool, 0, sizeof(apr_uint32_t));
+    c->queue = apr_array_make(pool, 0, sizeof(mark_t));
+    c->new_merges = apr_array_make(pool, 0, sizeof(mark_t));
     c->last_revnum = SVN_INVALID_REVNUM;
+    c->format = commit_cache_format_text;
+    c->page_shift = COMMIT_PAGE_SHIFT;
 
     return c;
 }
 
-commit_t *
-commit_cache_get(commit_cache_t *c, svn_revnum_t revnum, branch_t *branch)
+void
+commit_cache_set_memory_limit(commit_cache_t *c, apr_size_t limit)
+{
+    // Use smaller pages with small limits, so that pages of several
+    // branches fit.
+    c->page_shift = COMMIT_PAGE_SHIFT;
+    while (c->page_shift > COMMIT_MIN_PAGE_SHIFT &&
+           limit / (sizeof(commit_page_t) + PAGE_SIZE(c) * PAGE_COMMIT_LEN) < COMMIT_MIN_PAGES) {
+        c->page_shift--;
+    }
+
+    c->max_pages = limit / (sizeof(commit_page_t) + PAGE_SIZE(c) * PAGE_COMMIT_LEN);
+
+    // The last page and a page being looked up are always in memory.
+    if (c->max_pages < 2) {
+        c->max_pages = 2;
+    }
+}
+
+apr_uint64_t
+commit_cache_spilled(commit_cache_t *c)
+{
+    return c->nspilled;
+}
+
+static commit_page_t *
+page_create(commit_cache_t *c)
+{
+    apr_pool_t *pool = svn_pool_create(c->pool);
+    commit_page_t *page = apr_palloc(pool, sizeof(commit_page_t));
+
+    page->pool = pool;
+    page->ncommits = 0;
+    page->revnums = apr_palloc(pool, PAGE_SIZE(c) * sizeof(svn_revnum_t));
+    page->branch_ids = apr_palloc(pool, PAGE_SIZE(c) * sizeof(uint32_t));
+    page->marks = apr_palloc(pool, PAGE_SIZE(c) * sizeof(mark_t));
+    page->parents = apr_palloc(pool, PAGE_SIZE(c) * sizeof(mark_t));
+    page->merges_offsets = apr_palloc(pool, PAGE_SIZE(c) * sizeof(uint32_t));
+    page->merges_counts = apr_palloc(pool, PAGE_SIZE(c) * sizeof(uint32_t));
+    page->merges = apr_array_make(pool, 0, sizeof(mark_t));
+    page->branch_slots = apr_array_make(pool, 0, sizeof(apr_array_header_t *));
+
+    return page;
+}
+
+static void
+page_add_branch_slot(commit_page_t *page, uint32_t branch_id, int slot)
+{
+    apr_array_header_t *slots;
+
+    while (page->branch_slots->nelts <= (int)branch_id) {
+        APR_ARRAY_PUSH(page->branch_slots, apr_array_header_t *) = NULL;
+    }
+
+    slots = APR_ARRAY_IDX(page->branch_slots, branch_id, apr_array_header_t *);
+    if (slots == NULL) {
+        slots = apr_array_make(page->pool, 1, sizeof(uint16_t));
+        APR_ARRAY_IDX(page->branch_slots, branch_id, apr_array_header_t *) = slots;
+    }
+
+    APR_ARRAY_PUSH(slots, uint16_t) = slot;
+}
+
+// Spill file keeps raw pages: number of commits, used part of every
+// column, number of merges and merges.
+static svn_error_t *
+page_write(commit_cache_t *c, page_info_t *info, apr_pool_t *pool)
+{
+    commit_page_t *page = info->page;
+    apr_size_t n = page->ncommits;
+    apr_uint32_t nmerges = page->merges->nelts;
+    apr_size_t size = sizeof(page->ncommits) + n * PAGE_COMMIT_LEN +
+                      sizeof(nmerges) + nmerges * sizeof(mark_t);
+    apr_off_t offset;
+
+    if (c->spill == NULL) {
+        SVN_ERR(svn_io_open_unique_file3(&c->spill, NULL, NULL,
+                                         svn_io_file_del_on_pool_cleanup,
+                                         c->pool, pool));
+    }
+
+    // Pages changed after spilling overwrite their slot, unless merges
+    // have outgrown it. Outgrown slots are left unused.
+    if (size > info->slot_size) {
+        info->offset = c->spill_size;
+        info->slot_size = size;
+        c->spill_size += size;
+    }
+    offset = info->offset;
+    SVN_ERR(svn_io_file_seek(c->spill, APR_SET, &offset, pool));
+
+    SVN_ERR(svn_io_file_write_full(c->spill, &page->ncommits, sizeof(page->ncommits), NULL, pool));
+    SVN_ERR(svn_io_file_write_full(c->spill, page->revnums, n * sizeof(svn_revnum_t), NULL, pool));
+    SVN_ERR(svn_io_file_write_full(c->spill, page->branch_ids, n * sizeof(uint32_t), NULL, pool));
+    SVN_ERR(svn_io_file_write_full(c->spill, page->marks, n * sizeof(mark_t), NULL, pool));
+    SVN_ERR(svn_io_file_write_full(c->spill, page->parents, n * sizeof(mark_t), NULL, pool));
+    SVN_ERR(svn_io_file_write_full(c->spill, page->merges_offsets, n * sizeof(uint32_t), NULL, pool));
+    SVN_ERR(svn_io_file_write_full(c->spill, page->merges_counts, n * sizeof(uint32_t), NULL, pool));
+    SVN_ERR(svn_io_file_write_full(c->spill, &nmerges, sizeof(nmerges), NULL, pool));
+    SVN_ERR(svn_io_file_write_full(c->spill, page->merges->elts, nmerges * sizeof(mark_t), NULL, pool));
+
+    c->nspilled++;
+
+    return SVN_NO_ERROR;
+}
+
+static svn_error_t *
+page_read(commit_cache_t *c, page_info_t *info, apr_pool_t *pool)
+{
+    commit_page_t *page = page_create(c);
+    apr_off_t offset = info->offset;
+    apr_size_t n;
+    apr_uint32_t nmerges;
+
+    SVN_ERR(svn_io_file_seek(c->spill, APR_SET, &offset, pool));
+
+    SVN_ERR(svn_io_file_read_full2(c->spill, &page->ncommits, sizeof(page->ncommits), NULL, NULL, pool));
+    n = page->ncommits;
+    SVN_ERR(svn_io_file_read_full2(c->spill, page->revnums, n * sizeof(svn_revnum_t), NULL, NULL, pool));
+    SVN_ERR(svn_io_file_read_full2(c->spill, page->branch_ids, n * sizeof(uint32_t), NULL, NULL, pool));
+    SVN_ERR(svn_io_file_read_full2(c->spill, page->marks, n * sizeof(mark_t), NULL, NULL, pool));
+    SVN_ERR(svn_io_file_read_full2(c->spill, page->parents, n * sizeof(mark_t), NULL, NULL, pool));
+    SVN_ERR(svn_io_file_read_full2(c->spill, page->merges_offsets, n * sizeof(uint32_t), NULL, NULL, pool));
+    SVN_ERR(svn_io_file_read_full2(c->spill, page->merges_counts, n * sizeof(uint32_t), NULL, NULL, pool));
+    SVN_ERR(svn_io_file_read_full2(c->spill, &nmerges, sizeof(nmerges), NULL, NULL, pool));
+
+    apr_array_header_t *merges = apr_array_make(page->pool, nmerges, sizeof(mark_t));
+    SVN_ERR(svn_io_file_read_full2(c->spill, merges->elts, nmerges * sizeof(mark_t), NULL, NULL, pool));
+    merges->nelts = nmerges;
+    page->merges = merges;
+
+    for (int slot = 0; slot < page->ncommits; slot++) {
+        page_add_branch_slot(page, page->branch_ids[slot], slot);
+    }
+
+    info->page = page;
+
+    return SVN_NO_ERROR;
+}
+
+// Spills the least recently used page, except the last one.
+static svn_error_t *
+page_evict(commit_cache_t *c, apr_pool_t *pool)
+{
+    page_info_t *victim = NULL;
+
+    for (int i = 0; i < c->pages->nelts - 1; i++) {
+        page_info_t *info = &APR_ARRAY_IDX(c->pages, i, page_info_t);
+        if (info->page != NULL && (victim == NULL || info->tick < victim->tick)) {
+            victim = info;
+        }
+    }
+
+    if (victim == NULL) {
+        return SVN_NO_ERROR;
+    }
+
+    if (victim->dirty) {
+        SVN_ERR(page_write(c, victim, pool));
+        victim->dirty = FALSE;
+    }
+
+    svn_pool_destroy(victim->page->pool);
+    victim->page = NULL;
+    c->npages_loaded--;
+
+    return SVN_NO_ERROR;
+}
+
+static svn_error_t *
+page_load(commit_cache_t *c, page_info_t *info)
+{
+    apr_pool_t *pool = svn_pool_create(c->pool);
+
+    while (c->max_pages > 0 && c->npages_loaded >= c->max_pages) {
+        SVN_ERR(page_evict(c, pool));
+    }
+
+    SVN_ERR(page_read(c, info, pool));
+    c->npages_loaded++;
+
+    svn_pool_destroy(pool);
+
+    return SVN_NO_ERROR;
+}
+
+// Sets *page to page of commit, reading it back from the spill file
+// if needed.
+static svn_error_t *
+get_page(commit_page_t **page,
+         commit_cache_t *c,
+         commit_id_t commit,
+         svn_boolean_t modify)
+{
+    page_info_t *info = &APR_ARRAY_IDX(c->pages, PAGE_NUMBER(c, commit), page_info_t);
+
+    if (info->page == NULL) {
+        SVN_ERR(page_load(c, info));
+    }
+
+    info->tick = ++c->tick;
+    info->dirty = info->dirty || modify;
+    *page = info->page;
+
+    return SVN_NO_ERROR;
+}
+
+// Returns id of branch, adding it if create is set.
+// Returns -1 for unknown branch otherwise.
+static int
+get_branch_id(commit_cache_t *c, branch_t *branch, svn_boolean_t create)
+{
+    uint32_t *id = apr_hash_get(c->branch_ids_idx, &branch, sizeof(branch_t *));
+
+    if (id == NULL) {
+        if (!create) {
+            return -1;
+        }
+
+        id = apr_palloc(c->pool, sizeof(uint32_t));
+        *id = c->branches->nelts;
+        APR_ARRAY_PUSH(c->branches, branch_t *) = branch;
+        APR_ARRAY_PUSH(c->idx, apr_array_header_t *) = apr_array_make(c->pool, 1, sizeof(branch_page_t));
+        apr_hash_set(c->branch_ids_idx, apr_pmemdup(c->pool, &branch, sizeof(branch_t *)),
+                     sizeof(branch_t *), id);
+    }
+
+    return *id;
+}
+
+svn_error_t *
+commit_cache_get(commit_id_t *commit,
+                 commit_cache_t *c,
+                 svn_revnum_t revnum,
+                 branch_t *branch)
 {
-    while (revnum > 0) {
-        cache_key_t key = {revnum, branch};
-        commit_t *commit = apr_hash_get(c->idx, &key, sizeof(cache_key_t));
-        if (commit != NULL) {
-            return commit;
+    apr_array_header_t *pages, *slots;
+    const branch_page_t *bp;
+    commit_page_t *page;
+    int branch_id, lo, hi;
+    uint16_t slot;
+
+    *commit = COMMIT_ID_NONE;
+
+    branch_id = get_branch_id(c, branch, FALSE);
+    if (branch_id < 0) {
+        return SVN_NO_ERROR;
+    }
+
+    // Find the last page having commits of branch at or before revision.
+    pages = APR_ARRAY_IDX(c->idx, branch_id, apr_array_header_t *);
+    lo = 0;
+    hi = pages->nelts;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (APR_ARRAY_IDX(pages, mid, branch_page_t).min_revnum <= revnum) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    if (lo == 0) {
+        return SVN_NO_ERROR;
+    }
+
+    bp = &APR_ARRAY_IDX(pages, lo - 1, branch_page_t);
+    SVN_ERR(get_page(&page, c, (commit_id_t)bp->page << c->page_shift, FALSE));
+
+    // Find the last commit of branch at or before revision in the page.
+    slots = APR_ARRAY_IDX(page->branch_slots, branch_id, apr_array_header_t *);
+    lo = 0;
+    hi = slots->nelts;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (page->revnums[APR_ARRAY_IDX(slots, mid, uint16_t)] <= revnum) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
         }
+    }
 
-        --revnum;
+    // Commits of revision 0 are never looked up.
+    slot = APR_ARRAY_IDX(slots, lo - 1, uint16_t);
+    if (page->revnums[slot] > 0) {
+        *commit = ((commit_id_t)bp->page << c->page_shift) + slot;
     }
 
-    return NULL;
+    return SVN_NO_ERROR;
 }
 
-commit_t *
+commit_id_t
 commit_cache_get_by_mark(commit_cache_t *c, mark_t mark)
 {
-    return APR_ARRAY_IDX(c->marks, mark - 1, commit_t *);
+    return APR_ARRAY_IDX(c->marked, mark - 1, commit_id_t);
+}
+
+svn_error_t *
+commit_cache_get_mark(mark_t *mark, commit_cache_t *c, commit_id_t commit)
+{
+    commit_page_t *page;
+
+    SVN_ERR(get_page(&page, c, commit, FALSE));
+    *mark = page->marks[PAGE_SLOT(c, commit)];
+
+    return SVN_NO_ERROR;
+}
+
+svn_error_t *
+commit_cache_get_parent(mark_t *parent, commit_cache_t *c, commit_id_t commit)
+{
+    commit_page_t *page;
+
+    SVN_ERR(get_page(&page, c, commit, FALSE));
+    *parent = page->parents[PAGE_SLOT(c, commit)];
+
+    return SVN_NO_ERROR;
 }
 
-commit_t *
-commit_cache_add(commit_cache_t *c, svn_revnum_t revnum, branch_t *branch)
+svn_error_t *
+commit_cache_set_parent(commit_cache_t *c, commit_id_t commit, mark_t parent)
 {
-    commit_t *commit = apr_array_push(c->commits);
-    commit->revnum = revnum;
-    commit->branch = branch;
-    commit->merges = apr_array_make(c->pool, 0, sizeof(mark_t));
+    commit_page_t *page;
 
-    apr_hash_set(c->idx, commit, sizeof(cache_key_t), commit);
+    SVN_ERR(get_page(&page, c, commit, TRUE));
+    page->parents[PAGE_SLOT(c, commit)] = parent;
+
+    return SVN_NO_ERROR;
+}
+
+svn_error_t *
+commit_cache_get_merges(const mark_t **merges,
+                        int *nmerges,
+                        commit_cache_t *c,
+                        commit_id_t commit)
+{
+    commit_page_t *page;
+    int slot = PAGE_SLOT(c, commit);
+
+    SVN_ERR(get_page(&page, c, commit, FALSE));
+    *nmerges = page->merges_counts[slot];
+    *merges = &APR_ARRAY_IDX(page->merges, page->merges_offsets[slot], mark_t);
+
+    return SVN_NO_ERROR;
+}
+
+// Appends merge to merges of commit, which must be the last one.
+static svn_error_t *
+push_merge(commit_cache_t *c, commit_id_t commit, mark_t merge)
+{
+    commit_page_t *page;
+
+    SVN_ERR(get_page(&page, c, commit, TRUE));
+    APR_ARRAY_PUSH(page->merges, mark_t) = merge;
+    page->merges_counts[PAGE_SLOT(c, commit)]++;
+
+    return SVN_NO_ERROR;
+}
+
+svn_error_t *
+commit_cache_add(commit_id_t *commit,
+                 commit_cache_t *c,
+                 svn_revnum_t revnum,
+                 branch_t *branch)
+{
+    commit_id_t id = c->ncommits;
+    uint32_t branch_id = get_branch_id(c, branch, TRUE);
+    apr_array_header_t *pages = APR_ARRAY_IDX(c->idx, branch_id, apr_array_header_t *);
+    commit_page_t *page;
+    int slot = PAGE_SLOT(c, id);
+
+    if (slot == 0) {
+        page_info_t *info;
+
+        // The previous page is not spilled until the next page is needed,
+        // so it stays in memory while its commits are written.
+        if (c->max_pages > 0 && c->npages_loaded >= c->max_pages) {
+            apr_pool_t *pool = svn_pool_create(c->pool);
+            SVN_ERR(page_evict(c, pool));
+            svn_pool_destroy(pool);
+        }
+
+        info = apr_array_push(c->pages);
+        info->page = page_create(c);
+        info->dirty = TRUE;
+        c->npages_loaded++;
+    }
+
+    SVN_ERR(get_page(&page, c, id, TRUE));
+    page->revnums[slot] = revnum;
+    page->branch_ids[slot] = branch_id;
+    page->marks[slot] = 0;
+    page->parents[slot] = 0;
+    page->merges_offsets[slot] = page->merges->nelts;
+    page->merges_counts[slot] = 0;
+    page->ncommits++;
+    page_add_branch_slot(page, branch_id, slot);
+
+    if (pages->nelts == 0 || APR_ARRAY_IDX(pages, pages->nelts - 1, branch_page_t).page != PAGE_NUMBER(c, id)) {
+        branch_page_t *bp = apr_array_push(pages);
+        bp->page = PAGE_NUMBER(c, id);
+        bp->min_revnum = revnum;
+    }
+
+    c->ncommits++;
 
     if (revnum > c->last_revnum) {
         c->last_revnum = revnum;
     }
 
-    return commit;
+    *commit = id;
+
+    return SVN_NO_ERROR;
 }
 
-void
-commit_cache_set_mark(commit_cache_t *c, commit_t *commit)
+static apr_uint32_t
+mark_generation(commit_cache_t *c, mark_t mark)
 {
-    APR_ARRAY_PUSH(c->marks, commit_t *) = commit;
-    commit->mark = c->marks->nelts;
+    if (mark == 0) {
+        return 0;
+    }
+
+    return APR_ARRAY_IDX(c->generations, mark - 1, apr_uint32_t);
+}
+
+svn_error_t *
+commit_cache_set_mark(commit_cache_t *c, commit_id_t commit)
+{
+    commit_page_t *page;
+    apr_uint32_t generation;
+    const mark_t *merges;
+    int slot = PAGE_SLOT(c, commit);
+
+    SVN_ERR(get_page(&page, c, commit, TRUE));
+
+    generation = mark_generation(c, page->parents[slot]);
+    merges = &APR_ARRAY_IDX(page->merges, page->merges_offsets[slot], mark_t);
+    for (uint32_t i = 0; i < page->merges_counts[slot]; i++) {
+        apr_uint32_t merge_generation = mark_generation(c, merges[i]);
+        if (merge_generation > generation) {
+            generation = merge_generation;
+        }
+    }
+
+    APR_ARRAY_PUSH(c->marked, commit_id_t) = commit;
+    APR_ARRAY_PUSH(c->generations, apr_uint32_t) = generation + 1;
+    APR_ARRAY_PUSH(c->visited, apr_uint32_t) = 0;
+    page->marks[slot] = c->marked->nelts;
+
+    return SVN_NO_ERROR;
 }
 
-static void *
-array_prepend(apr_array_header_t *arr)
+svn_error_t *
+commit_cache_set_parent_mark(commit_cache_t *c, commit_id_t commit)
 {
-    // Call apr_array_push() to ensure that enough space
-    // has been allocated.
-    apr_array_push(arr);
-    // Now shift all elements down one spot.
-    memmove(arr->elts + arr->elt_size,
-            arr->elts,
-            ((arr->nelts - 1) * arr->elt_size));
-    // Finally, return the pointer to the first array element.
-    return arr->elts;
+    commit_page_t *page;
+
+    SVN_ERR(get_page(&page, c, commit, TRUE));
+    page->marks[PAGE_SLOT(c, commit)] = page->parents[PAGE_SLOT(c, commit)];
+
+    return SVN_NO_ERROR;
 }
 
-#define ARRAY_PREPEND(ary, type) (*((type *)array_prepend(ary)))
+// Adds mark into the queue of ancestry search for other, unless it
+// has been visited already or it cannot reach other. Ancestors always
+// have both smaller marks and smaller generation numbers.
+static void
+enqueue_mark(commit_cache_t *c, mark_t mark, mark_t other, apr_uint32_t generation)
+{
+    apr_uint32_t *stamp;
 
-// This function implements simple breadth-first search for determining
-// if other commit has already been merged into first commit.
-// It uses apr_array_header_t as a FIFO queue for marks.
-static svn_boolean_t
-commit_is_merged(commit_cache_t *c, commit_t *commit, mark_t other,
-                 apr_pool_t *scratch_pool)
+    if (mark < other || (mark != other && mark_generation(c, mark) <= generation)) {
+        return;
+    }
+
+    stamp = &APR_ARRAY_IDX(c->visited, mark - 1, apr_uint32_t);
+    if (*stamp == c->stamp) {
+        return;
+    }
+    *stamp = c->stamp;
+
+    APR_ARRAY_PUSH(c->queue, mark_t) = mark;
+}
+
+// Enqueues parent and merges of commit.
+static svn_error_t *
+enqueue_parents(commit_cache_t *c, commit_id_t commit, mark_t other, apr_uint32_t generation)
 {
-    apr_array_header_t *queue;
-    apr_hash_t *visited;
+    commit_page_t *page;
+    const mark_t *merges;
+    int slot = PAGE_SLOT(c, commit);
 
-    queue = apr_array_make(scratch_pool, 0, sizeof(mark_t));
-    visited = apr_hash_make(scratch_pool);
+    SVN_ERR(get_page(&page, c, commit, FALSE));
 
-    // Copy merge commits into queue.
-    for (int i = 0; i < commit->merges->nelts; i++) {
-        mark_t merge = APR_ARRAY_IDX(commit->merges, i, mark_t);
-        if (merge < other) {
-            continue;
-        }
-        APR_ARRAY_PUSH(queue, mark_t) = merge;
-        apr_hash_set(visited, &merge, sizeof(mark_t), &merge);
+    merges = &APR_ARRAY_IDX(page->merges, page->merges_offsets[slot], mark_t);
+    for (uint32_t i = 0; i < page->merges_counts[slot]; i++) {
+        enqueue_mark(c, merges[i], other, generation);
     }
-    // Add parent commit into queue.
-    if (commit->parent >= other) {
-        mark_t merge = commit->parent;
-        APR_ARRAY_PUSH(queue, mark_t) = merge;
-        apr_hash_set(visited, &merge, sizeof(mark_t), &merge);
+    enqueue_mark(c, page->parents[slot], other, generation);
+
+    return SVN_NO_ERROR;
+}
+
+// This function implements breadth-first search for determining
+// if other commit has already been merged into first commit.
+// Only commits between other and commit by both marks and
+// generation numbers are visited.
+static svn_error_t *
+commit_is_merged(svn_boolean_t *merged, commit_cache_t *c, commit_id_t commit, mark_t other)
+{
+    apr_uint32_t generation = mark_generation(c, other);
+
+    // Start a new search, clearing stamps once they wrap around.
+    if (++c->stamp == 0) {
+        memset(c->visited->elts, 0, c->visited->nelts * c->visited->elt_size);
+        c->stamp = 1;
     }
 
-    while (queue->nelts) {
-        commit_t *merged;
-        mark_t *merge = apr_array_pop(queue);
-        if (*merge == other) {
-            return TRUE;
-        }
+    *merged = FALSE;
 
-        merged = commit_cache_get_by_mark(c, *merge);
+    apr_array_clear(c->queue);
+    SVN_ERR(enqueue_parents(c, commit, other, generation));
 
-        // Add parent commit into queue.
-        if (merged->parent >= other && apr_hash_get(visited, &merged->parent, sizeof(mark_t)) == NULL) {
-            mark_t merge = merged->parent;
-            ARRAY_PREPEND(queue, mark_t) = merge;
-            apr_hash_set(visited, &merge, sizeof(mark_t), &merge);
-        }
-        // Copy merge commits into queue.
-        for (int i = 0; i < merged->merges->nelts; i++) {
-            mark_t merge = APR_ARRAY_IDX(merged->merges, i, mark_t);
-            if (merge < other || apr_hash_get(visited, &merge, sizeof(mark_t)) != NULL) {
-                continue;
-            }
-            ARRAY_PREPEND(queue, mark_t) = merge;
-            apr_hash_set(visited, &merge, sizeof(mark_t), &merge);
+    for (int head = 0; head < c->queue->nelts; head++) {
+        mark_t merge = APR_ARRAY_IDX(c->queue, head, mark_t);
+        if (merge == other) {
+            *merged = TRUE;
+            break;
         }
+
+        SVN_ERR(enqueue_parents(c, commit_cache_get_by_mark(c, merge), other, generation));
     }
 
-    return FALSE;
+    return SVN_NO_ERROR;
 }
 
-void
+svn_error_t *
 commit_cache_add_merge(commit_cache_t *c,
-                       commit_t *commit,
-                       commit_t *other,
-                       apr_pool_t *scratch_pool)
+                       commit_id_t commit,
+                       commit_id_t other)
 {
-    apr_array_header_t *new_merges;
+    apr_array_header_t *new_merges = c->new_merges;
+    mark_t other_mark;
+    const mark_t *merges;
+    commit_page_t *page;
+    uint32_t offset;
+    int nmerges, nkept = 1, slot = PAGE_SLOT(c, commit);
+    svn_boolean_t merged;
+
+    SVN_ERR(commit_cache_get_mark(&other_mark, c, other));
 
-    if (commit_is_merged(c, commit, other->mark, scratch_pool)) {
+    SVN_ERR(commit_is_merged(&merged, c, commit, other_mark));
+    if (merged) {
         // Commit is already merged, nothing to do.
-        return;
+        return SVN_NO_ERROR;
     }
 
-    new_merges = apr_array_make(scratch_pool, 1, sizeof(mark_t));
-    APR_ARRAY_PUSH(new_merges, mark_t) = other->mark;
+    apr_array_clear(new_merges);
+    APR_ARRAY_PUSH(new_merges, mark_t) = other_mark;
+
+    // Copy old merges, as ancestry search may spill their page.
+    SVN_ERR(commit_cache_get_merges(&merges, &nmerges, c, commit));
+    for (int i = 0; i < nmerges; i++) {
+        APR_ARRAY_PUSH(new_merges, mark_t) = merges[i];
+    }
 
     // Filter old merges by removing merged one into just added merge commit.
-    for (int i = 0; i < commit->merges->nelts; i++) {
-        mark_t merged = APR_ARRAY_IDX(commit->merges, i, mark_t);
+    for (int i = 1; i <= nmerges; i++) {
+        mark_t merge = APR_ARRAY_IDX(new_merges, i, mark_t);
 
-        if (!commit_is_merged(c, other, merged, scratch_pool)) {
-            APR_ARRAY_PUSH(new_merges, mark_t) = merged;
+        SVN_ERR(commit_is_merged(&merged, c, other, merge));
+        if (!merged) {
+            APR_ARRAY_IDX(new_merges, nkept++, mark_t) = merge;
         }
     }
+    new_merges->nelts = nkept;
 
-    // Set new merges for commit.
-    apr_array_clear(commit->merges);
-    apr_array_cat(commit->merges, new_merges);
+    // Set new merges for commit. Merges are added to the latest commit,
+    // so its old merges are usually at the end and get overwritten.
+    SVN_ERR(get_page(&page, c, commit, TRUE));
+    offset = page->merges_offsets[slot];
+    if (offset + nmerges == (uint32_t)page->merges->nelts) {
+        page->merges->nelts = offset;
+    } else {
+        offset = page->merges->nelts;
+    }
+
+    apr_array_cat(page->merges, new_merges);
+    page->merges_offsets[slot] = offset;
+    page->merges_counts[slot] = new_merges->nelts;
+
+    return SVN_NO_ERROR;
 }
 
 svn_error_t *
 commit_cache_dump(commit_cache_t *c, svn_stream_t *dst, apr_pool_t *pool)
 {
-    for (int i = 0; i < c->commits->nelts; i++) {
-        commit_t *commit = &APR_ARRAY_IDX(c->commits, i, commit_t);
-        if (!commit->mark) {
+    for (commit_id_t commit = 0; commit < c->ncommits; commit++) {
+        commit_page_t *page;
+        const mark_t *merges;
+        branch_t *branch;
+        int slot = PAGE_SLOT(c, commit);
+
+        SVN_ERR(get_page(&page, c, commit, FALSE));
+
+        if (!page->marks[slot]) {
             // Skip commit if mark was not assigned.
             continue;
         }
-        SVN_ERR(svn_stream_printf(dst, pool, "%ld %s :%d",
-                                  commit->revnum,
-                                  commit->branch->refname,
-                                  commit->mark));
 
-        SVN_ERR(svn_stream_printf(dst, pool, " :%d",
-                                  commit->parent));
+        branch = APR_ARRAY_IDX(c->branches, page->branch_ids[slot], branch_t *);
+        SVN_ERR(svn_stream_printf(dst, pool, "%ld %s :%d",
+                                  page->revnums[slot],
+                                  branch->refname,
+                                  page->marks[slot]));
 
-        if (commit->merges->nelts) {
-            int j;
-            mark_t merge;
+        SVN_ERR(svn_stream_printf(dst, pool, " :%d", page->parents[slot]));
 
-            SVN_ERR(svn_stream_printf(dst, pool, " "));
-            for (j = 0; j < commit->merges->nelts - 1; j++) {
-                merge = APR_ARRAY_IDX(commit->merges, j, mark_t);
-                SVN_ERR(svn_stream_printf(dst, pool, ":%d ", merge));
-            }
-            merge = APR_ARRAY_IDX(commit->merges, j, mark_t);
-            SVN_ERR(svn_stream_printf(dst, pool, ":%d", merge));
+        merges = &APR_ARRAY_IDX(page->merges, page->merges_offsets[slot], mark_t);
+        for (uint32_t i = 0; i < page->merges_counts[slot]; i++) {
+            SVN_ERR(svn_stream_printf(dst, pool, " :%d", merges[i]));
         }
 
         SVN_ERR(svn_stream_printf(dst, pool, "\n"));
@@ -227,12 +755,156 @@ commit_cache_dump(commit_cache_t *c, svn_stream_t *dst, apr_pool_t *pool)
     return SVN_NO_ERROR;
 }
 
+commit_cache_format_t
+commit_cache_get_format(const commit_cache_t *c)
+{
+    return c->format;
+}
+
+void
+commit_cache_set_format(commit_cache_t *c, commit_cache_format_t format)
+{
+    c->format = format;
+}
+
+static void
+stringbuf_append_uint32(svn_stringbuf_t *buf, apr_uint32_t val)
+{
+    unsigned char bytes[4];
+
+    encode_uint32(bytes, val);
+    svn_stringbuf_appendbytes(buf, (const char *)bytes, sizeof(bytes));
+}
+
+// Writes a chunk of marked commits starting with first into fd.
+// Refnames missing from branch_ids are added to it and written as well.
+static svn_error_t *
+write_binary_chunk(apr_off_t *len,
+                   commit_cache_t *c,
+                   apr_file_t *fd,
+                   commit_id_t first,
+                   apr_hash_t *branch_ids,
+                   apr_pool_t *pool)
+{
+    svn_stringbuf_t *names, *records, *merges;
+    apr_uint32_t nbranches = 0, ncommits = 0;
+    unsigned char hdr[COMMIT_CHUNK_HEADER_LEN];
+
+    names = svn_stringbuf_create_empty(pool);
+    records = svn_stringbuf_create_empty(pool);
+    merges = svn_stringbuf_create_empty(pool);
+
+    for (commit_id_t commit = first; commit < c->ncommits; commit++) {
+        commit_page_t *page;
+        const mark_t *commit_merges;
+        branch_t *branch;
+        apr_uint32_t *id;
+        int slot = PAGE_SLOT(c, commit);
+
+        SVN_ERR(get_page(&page, c, commit, FALSE));
+
+        if (!page->marks[slot]) {
+            // Skip commit if mark was not assigned.
+            continue;
+        }
+
+        branch = APR_ARRAY_IDX(c->branches, page->branch_ids[slot], branch_t *);
+        id = apr_hash_get(branch_ids, branch->refname, APR_HASH_KEY_STRING);
+        if (id == NULL) {
+            id = apr_palloc(apr_hash_pool_get(branch_ids), sizeof(apr_uint32_t));
+            *id = apr_hash_count(branch_ids);
+            apr_hash_set(branch_ids, apr_pstrdup(apr_hash_pool_get(branch_ids), branch->refname),
+                         APR_HASH_KEY_STRING, id);
+
+            svn_stringbuf_appendbytes(names, branch->refname, strlen(branch->refname) + 1);
+            nbranches++;
+        }
+
+        commit_merges = &APR_ARRAY_IDX(page->merges, page->merges_offsets[slot], mark_t);
+
+        stringbuf_append_uint32(records, (apr_uint32_t)page->revnums[slot]);
+        stringbuf_append_uint32(records, *id);
+        stringbuf_append_uint32(records, page->marks[slot]);
+        stringbuf_append_uint32(records, page->parents[slot]);
+        stringbuf_append_uint32(records, page->merges_counts[slot]);
+        ncommits++;
+
+        for (uint32_t i = 0; i < page->merges_counts[slot]; i++) {
+            stringbuf_append_uint32(merges, commit_merges[i]);
+        }
+    }
+
+    encode_uint32(hdr, nbranches);
+    encode_uint32(hdr + 4, names->len);
+    encode_uint32(hdr + 8, ncommits);
+    encode_uint32(hdr + 12, merges->len / 4);
+
+    SVN_ERR(svn_io_file_write_full(fd, hdr, sizeof(hdr), NULL, pool));
+    SVN_ERR(svn_io_file_write_full(fd, names->data, names->len, NULL, pool));
+    SVN_ERR(svn_io_file_write_full(fd, records->data, records->len, NULL, pool));
+    SVN_ERR(svn_io_file_write_full(fd, merges->data, merges->len, NULL, pool));
+
+    *len = sizeof(hdr) + names->len + records->len + merges->len;
+
+    return SVN_NO_ERROR;
+}
+
+static svn_error_t *
+commit_cache_dump_binary_path(commit_cache_t *c, const char *path, apr_pool_t *pool)
+{
+    apr_file_t *fd;
+    apr_off_t len;
+
+    if (c->file_path != NULL && strcmp(c->file_path, path) == 0) {
+        apr_off_t offset = c->file_size;
+
+        // Append commits added since load, cutting off a partial chunk.
+        SVN_ERR(svn_io_file_open(&fd, path, APR_WRITE | APR_BUFFERED | APR_BINARY,
+                                 APR_OS_DEFAULT, pool));
+        SVN_ERR(svn_io_file_trunc(fd, offset, pool));
+        SVN_ERR(svn_io_file_seek(fd, APR_SET, &offset, pool));
+        SVN_ERR(write_binary_chunk(&len, c, fd, c->file_ncommits, c->file_branch_ids, pool));
+        SVN_ERR(svn_io_file_close(fd, pool));
+
+        c->file_size += len;
+    } else {
+        unsigned char hdr[COMMIT_CACHE_HEADER_LEN];
+        const char *tmp_path = apr_pstrcat(pool, path, ".tmp", NULL);
+        apr_hash_t *branch_ids = apr_hash_make(c->pool);
+
+        SVN_ERR(svn_io_file_open(&fd, tmp_path,
+                                 APR_CREATE | APR_TRUNCATE | APR_BUFFERED | APR_WRITE | APR_BINARY,
+                                 APR_OS_DEFAULT, pool));
+
+        memcpy(hdr, COMMIT_CACHE_MAGIC, COMMIT_CACHE_MAGIC_LEN);
+        encode_uint32(hdr + 8, COMMIT_CACHE_VERSION);
+        encode_uint32(hdr + 12, COMMIT_RECORD_LEN);
+        SVN_ERR(svn_io_file_write_full(fd, hdr, sizeof(hdr), NULL, pool));
+
+        SVN_ERR(write_binary_chunk(&len, c, fd, 0, branch_ids, pool));
+        SVN_ERR(svn_io_file_close(fd, pool));
+        SVN_ERR(svn_io_file_rename(tmp_path, path, pool));
+
+        c->file_path = apr_pstrdup(c->pool, path);
+        c->file_size = sizeof(hdr) + len;
+        c->file_branch_ids = branch_ids;
+    }
+
+    c->file_ncommits = c->ncommits;
+
+    return SVN_NO_ERROR;
+}
+
 svn_error_t *
 commit_cache_dump_path(commit_cache_t *c, const char *path, apr_pool_t *pool)
 {
     apr_file_t *fd;
     svn_stream_t *dst;
 
+    if (c->format == commit_cache_format_binary) {
+        return commit_cache_dump_binary_path(c, path, pool);
+    }
+
     SVN_ERR(svn_io_file_open(&fd, path,
                              APR_CREATE | APR_TRUNCATE | APR_BUFFERED | APR_WRITE,
                              APR_OS_DEFAULT, pool));
@@ -280,11 +952,11 @@ commit_cache_load(commit_cache_t *c,
     while (TRUE) {
         const char *prev, *next;
         const char *refname;
-        commit_t *commit;
+        commit_id_t commit;
         branch_t *branch;
         svn_stringbuf_t *buf;
         svn_revnum_t revnum;
-        mark_t mark;
+        mark_t mark, parent = 0;
 
         SVN_ERR(svn_stream_readline(src, &buf, "\n", &eof, pool));
         if (eof) {
@@ -311,7 +983,7 @@ commit_cache_load(commit_cache_t *c,
         mark = str_to_uint32(prev, &next);
 
         branch = branch_storage_lookup_refname(bs, refname);
-        commit = commit_cache_add(c, revnum, branch);
+        SVN_ERR(commit_cache_add(&commit, c, revnum, branch));
 
         if (*next == ' ') {
             ++next;
@@ -319,33 +991,184 @@ commit_cache_load(commit_cache_t *c,
                 return svn_malformed_file_error(lineno, buf->data);
             }
             prev = ++next;
-            commit->parent = str_to_uint32(prev, &next);
+            parent = str_to_uint32(prev, &next);
+            SVN_ERR(commit_cache_set_parent(c, commit, parent));
+        }
+
+        // Merges of the just added commit are at the end of its page.
+        while (*next == ' ' || *next == ',') {
+            ++next;
+            if (*next != ':') {
+                return svn_malformed_file_error(lineno, buf->data);
+            }
+            prev = ++next;
+            SVN_ERR(push_merge(c, commit, str_to_uint32(prev, &next)));
         }
 
-        if (mark == commit->parent) {
-            commit->mark = commit->parent;
+        // Generation number of commit depends on its merges.
+        if (mark == parent) {
+            SVN_ERR(commit_cache_set_parent_mark(c, commit));
         } else {
-            commit_cache_set_mark(c, commit);
+            SVN_ERR(commit_cache_set_mark(c, commit));
         }
+    }
 
-        if (*next == ' ') {
-            ++next;
-            while (TRUE) {
-                if (*next != ':') {
-                    return svn_malformed_file_error(lineno, buf->data);
-                }
-                prev = ++next;
-                APR_ARRAY_PUSH(commit->merges, mark_t) = str_to_uint32(prev, &next);
-
-                next = strchr(next, ',');
-                if (next == NULL) {
-                    break;
-                }
-                ++next;
-            }
+    return SVN_NO_ERROR;
+}
+
+// Loads commits of a chunk at data, which has at most len bytes.
+// Sets *chunk_len to 0 if the chunk has not been written completely.
+static svn_error_t *
+load_binary_chunk(apr_size_t *chunk_len,
+                  commit_cache_t *c,
+                  const unsigned char *data,
+                  apr_size_t len,
+                  apr_array_header_t *branches,
+                  branch_storage_t *bs)
+{
+    apr_uint32_t nbranches, names_len, ncommits, nmerges;
+    const unsigned char *names, *records, *merges;
+    apr_uint64_t total;
+
+    *chunk_len = 0;
+
+    if (len < COMMIT_CHUNK_HEADER_LEN) {
+        return SVN_NO_ERROR;
+    }
+
+    nbranches = decode_uint32(data);
+    names_len = decode_uint32(data + 4);
+    ncommits = decode_uint32(data + 8);
+    nmerges = decode_uint32(data + 12);
+
+    total = COMMIT_CHUNK_HEADER_LEN + (apr_uint64_t)names_len +
+            (apr_uint64_t)ncommits * COMMIT_RECORD_LEN + (apr_uint64_t)nmerges * 4;
+    if (total > len) {
+        return SVN_NO_ERROR;
+    }
+
+    names = data + COMMIT_CHUNK_HEADER_LEN;
+    records = names + names_len;
+    merges = records + ncommits * COMMIT_RECORD_LEN;
+
+    for (apr_uint32_t i = 0, offset = 0; i < nbranches; i++) {
+        const char *refname = (const char *)names + offset;
+        const unsigned char *end = NULL;
+        apr_uint32_t *id;
+
+        if (offset < names_len) {
+            end = memchr(refname, '\0', names_len - offset);
+        }
+
+        if (end == NULL) {
+            return svn_error_create(SVN_ERR_MALFORMED_FILE, NULL,
+                                    "Truncated refnames");
+        }
+
+        refname = apr_pstrdup(c->pool, refname);
+        id = apr_palloc(c->pool, sizeof(apr_uint32_t));
+        *id = branches->nelts;
+        apr_hash_set(c->file_branch_ids, refname, APR_HASH_KEY_STRING, id);
+        APR_ARRAY_PUSH(branches, branch_t *) = branch_storage_lookup_refname(bs, refname);
+
+        offset = end - names + 1;
+    }
+
+    for (apr_uint32_t i = 0; i < ncommits; i++) {
+        const unsigned char *rec = records + i * COMMIT_RECORD_LEN;
+        apr_uint32_t branch_id = decode_uint32(rec + 4);
+        mark_t mark = decode_uint32(rec + 8);
+        apr_uint32_t commit_nmerges = decode_uint32(rec + 16);
+        commit_id_t commit;
+
+        if (branch_id >= (apr_uint32_t)branches->nelts || commit_nmerges > nmerges) {
+            return svn_error_createf(SVN_ERR_MALFORMED_FILE, NULL,
+                                     "Malformed commit record %u", i);
+        }
+
+        SVN_ERR(commit_cache_add(&commit, c, decode_uint32(rec),
+                                 APR_ARRAY_IDX(branches, branch_id, branch_t *)));
+        SVN_ERR(commit_cache_set_parent(c, commit, decode_uint32(rec + 12)));
+
+        // Merges of the just added commit are at the end of its page.
+        for (apr_uint32_t j = 0; j < commit_nmerges; j++) {
+            SVN_ERR(push_merge(c, commit, decode_uint32(merges)));
+            merges += 4;
+        }
+        nmerges -= commit_nmerges;
+
+        if (mark == decode_uint32(rec + 12)) {
+            SVN_ERR(commit_cache_set_parent_mark(c, commit));
+        } else {
+            SVN_ERR(commit_cache_set_mark(c, commit));
         }
     }
 
+    *chunk_len = total;
+
+    return SVN_NO_ERROR;
+}
+
+static svn_error_t *
+commit_cache_load_binary(commit_cache_t *c,
+                         apr_file_t *fd,
+                         const char *path,
+                         branch_storage_t *bs,
+                         apr_pool_t *pool)
+{
+    apr_finfo_t finfo;
+    apr_mmap_t *mm;
+    apr_status_t status;
+    apr_array_header_t *branches;
+    const unsigned char *data;
+    apr_size_t offset = COMMIT_CACHE_HEADER_LEN;
+
+    SVN_ERR(svn_io_file_info_get(&finfo, APR_FINFO_SIZE, fd, pool));
+    if (finfo.size < COMMIT_CACHE_HEADER_LEN) {
+        return svn_error_create(SVN_ERR_MALFORMED_FILE, NULL,
+                                "Truncated header");
+    }
+
+    status = apr_mmap_create(&mm, fd, 0, (apr_size_t)finfo.size,
+                             APR_MMAP_READ, pool);
+    if (status) {
+        return svn_error_wrap_apr(status, "Can't map marks file");
+    }
+
+    data = mm->mm;
+    if (decode_uint32(data + 8) != COMMIT_CACHE_VERSION) {
+        return svn_error_createf(SVN_ERR_MALFORMED_FILE, NULL,
+                                 "Unsupported version %u",
+                                 decode_uint32(data + 8));
+    }
+
+    if (decode_uint32(data + 12) != COMMIT_RECORD_LEN) {
+        return svn_error_createf(SVN_ERR_MALFORMED_FILE, NULL,
+                                 "Unsupported record size %u",
+                                 decode_uint32(data + 12));
+    }
+
+    c->file_branch_ids = apr_hash_make(c->pool);
+    branches = apr_array_make(pool, 0, sizeof(branch_t *));
+
+    while (TRUE) {
+        apr_size_t chunk_len;
+
+        SVN_ERR(load_binary_chunk(&chunk_len, c, data + offset,
+                                  (apr_size_t)finfo.size - offset, branches, bs));
+        if (chunk_len == 0) {
+            break;
+        }
+        offset += chunk_len;
+    }
+
+    apr_mmap_delete(mm);
+
+    c->file_path = apr_pstrdup(c->pool, path);
+    c->file_size = offset;
+    c->file_ncommits = c->ncommits;
+    c->format = commit_cache_format_binary;
+
     return SVN_NO_ERROR;
 }
 
@@ -355,8 +1178,12 @@ commit_cache_load_path(commit_cache_t *c,
                        branch_storage_t *bs,
                        apr_pool_t *pool)
 {
+    apr_file_t *fd;
+    apr_off_t offset = 0;
+    apr_size_t len;
+    char magic[COMMIT_CACHE_MAGIC_LEN];
+    svn_boolean_t eof;
     svn_error_t *err;
-    svn_stream_t *src;
     svn_node_kind_t kind;
 
     SVN_ERR(svn_io_check_path(path, &kind, pool));
@@ -364,12 +1191,21 @@ commit_cache_load_path(commit_cache_t *c,
         return SVN_NO_ERROR;
     }
 
-    SVN_ERR(svn_stream_open_readonly(&src, path, pool, pool));
-    err = commit_cache_load(c, src, bs, pool);
+    SVN_ERR(svn_io_file_open(&fd, path, APR_READ | APR_BINARY,
+                             APR_OS_DEFAULT, pool));
+    SVN_ERR(svn_io_file_read_full2(fd, magic, sizeof(magic), &len, &eof, pool));
+
+    if (len == sizeof(magic) && memcmp(magic, COMMIT_CACHE_MAGIC, len) == 0) {
+        err = commit_cache_load_binary(c, fd, path, bs, pool);
+    } else {
+        SVN_ERR(svn_io_file_seek(fd, APR_SET, &offset, pool));
+        err = commit_cache_load(c, svn_stream_from_aprfile2(fd, TRUE, pool), bs, pool);
+    }
+
     if (err) {
         return svn_error_quick_wrap(err, "Malformed marks file");
     }
-    SVN_ERR(svn_stream_close(src));
+    SVN_ERR(svn_io_file_close(fd, pool));
 
     return SVN_NO_ERROR;
 }
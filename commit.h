@@ -29,52 +29,156 @@
 
 typedef uint32_t mark_t;
 
-typedef struct
-{
-    svn_revnum_t revnum;
-    branch_t *branch;
-    mark_t mark;
-    mark_t parent;
-    apr_array_header_t *merges;
-} commit_t;
+// Index of a commit in commit cache in order of addition.
+typedef uint32_t commit_id_t;
 
+#define COMMIT_ID_NONE ((commit_id_t)-1)
+
+// On-disk formats of commit cache.
+typedef enum
+{
+    // Lines of "revnum refname :mark :parent :merge...".
+    commit_cache_format_text,
+    // Versioned file of interned refnames and fixed-size commit records,
+    // commits added since load are appended to it.
+    commit_cache_format_binary
+} commit_cache_format_t;
+
+// Commits are stored in pages of consecutive commit ids, column by
+// column within a page. Pages can be spilled into a temporary file
+// to keep memory usage bounded.
 typedef struct
 {
     apr_pool_t *pool;
-    apr_array_header_t *commits;
-    apr_hash_t *idx;
-    apr_array_header_t *marks;
+    // Pages of commits, see commit.c.
+    apr_array_header_t *pages;
+    commit_id_t ncommits;
+    // Branches of commits indexed by branch id.
+    apr_array_header_t *branches;
+    apr_hash_t *branch_ids_idx;
+    // Pages with commits of every branch along with the smallest
+    // revision of the branch in them, indexed by branch id.
+    apr_array_header_t *idx;
+    // Ids of marked commits indexed by mark.
+    apr_array_header_t *marked;
+    // Generation numbers of marked commits: one more than the largest
+    // generation of their parent and merges.
+    apr_array_header_t *generations;
+    // Stamps of marked commits visited by the current ancestry search.
+    apr_array_header_t *visited;
+    apr_uint32_t stamp;
+    // Queue of marks reused by ancestry searches.
+    apr_array_header_t *queue;
+    // Merges being set by commit_cache_add_merge(), reused by every call.
+    apr_array_header_t *new_merges;
+    // Maximal number of pages kept in memory, 0 for no limit.
+    int max_pages;
+    int npages_loaded;
+    apr_uint32_t tick;
+    // Temporary file pages are spilled into.
+    apr_file_t *spill;
+    apr_off_t spill_size;
+    // Number of pages written into the spill file.
+    apr_uint64_t nspilled;
+    // Commits in a page are 2^page_shift.
+    int page_shift;
     svn_revnum_t last_revnum;
+    commit_cache_format_t format;
+    // Binary file commits were loaded from, its valid size
+    // and number of commits loaded from it.
+    const char *file_path;
+    apr_off_t file_size;
+    commit_id_t file_ncommits;
+    // Ids of refnames stored in the binary file.
+    apr_hash_t *file_branch_ids;
 } commit_cache_t;
 
 commit_cache_t *
 commit_cache_create(apr_pool_t *pool);
 
-commit_t *
-commit_cache_get(commit_cache_t *c, svn_revnum_t revnum, branch_t *branch);
+// Limits memory used by commits to about limit bytes. Least recently
+// used pages of commits are spilled into a temporary file, only marks
+// index takes memory for every commit. Commits of every branch must be
+// added in order of revisions. Must be called before commits are added.
+void
+commit_cache_set_memory_limit(commit_cache_t *c, apr_size_t limit);
+
+// Returns number of times pages of commits were spilled.
+apr_uint64_t
+commit_cache_spilled(commit_cache_t *c);
+
+// Functions accessing commits return an error if their spilled page
+// cannot be read back or another page cannot be spilled.
 
-commit_t *
+// Sets *commit to the latest commit of branch made at or before revision,
+// COMMIT_ID_NONE if there is none.
+svn_error_t *
+commit_cache_get(commit_id_t *commit,
+                 commit_cache_t *c,
+                 svn_revnum_t revnum,
+                 branch_t *branch);
+
+commit_id_t
 commit_cache_get_by_mark(commit_cache_t *c, mark_t mark);
 
-void
-commit_cache_set_mark(commit_cache_t *c, commit_t *commit);
+// Sets *mark to mark of commit, 0 if it has not been marked yet.
+svn_error_t *
+commit_cache_get_mark(mark_t *mark, commit_cache_t *c, commit_id_t commit);
+
+// Sets *parent to mark of parent of commit, 0 if there is no parent.
+svn_error_t *
+commit_cache_get_parent(mark_t *parent, commit_cache_t *c, commit_id_t commit);
+
+svn_error_t *
+commit_cache_set_parent(commit_cache_t *c, commit_id_t commit, mark_t parent);
+
+// Sets *merges to merges of commit, valid until any other commit
+// is accessed.
+svn_error_t *
+commit_cache_get_merges(const mark_t **merges,
+                        int *nmerges,
+                        commit_cache_t *c,
+                        commit_id_t commit);
+
+// Assigns the next mark to commit. Parent and merges of commit
+// must be set beforehand.
+svn_error_t *
+commit_cache_set_mark(commit_cache_t *c, commit_id_t commit);
+
+// Makes commit a dummy one sharing mark of its parent.
+svn_error_t *
+commit_cache_set_parent_mark(commit_cache_t *c, commit_id_t commit);
+
+svn_error_t *
+commit_cache_add(commit_id_t *commit,
+                 commit_cache_t *c,
+                 svn_revnum_t revnum,
+                 branch_t *branch);
+
+svn_error_t *
+commit_cache_add_merge(commit_cache_t *c, commit_id_t commit, commit_id_t other);
 
-commit_t *
-commit_cache_add(commit_cache_t *c, svn_revnum_t revnum, branch_t *branch);
+// Returns format used by commit_cache_dump_path().
+// Defaults to the format of a loaded file, or text.
+commit_cache_format_t
+commit_cache_get_format(const commit_cache_t *c);
 
 void
-commit_cache_add_merge(commit_cache_t *c, commit_t *commit, commit_t *other,
-                       apr_pool_t *scratch_pool);
+commit_cache_set_format(commit_cache_t *c, commit_cache_format_t format);
 
 svn_error_t *
 commit_cache_dump(commit_cache_t *c, svn_stream_t *dst, apr_pool_t *pool);
 
+// Dumps commit cache into path using current format. Commits added
+// since loading a binary file at the same path are appended to it.
 svn_error_t *
 commit_cache_dump_path(commit_cache_t *c, const char *path, apr_pool_t *pool);
 
 svn_error_t *
 commit_cache_load(commit_cache_t *c, svn_stream_t *src, branch_storage_t *bs, apr_pool_t *pool);
 
+// Loads commit cache from path in either format.
+// Binary files are mapped into memory while loading.
 svn_error_t *
 commit_cache_load_path(commit_cache_t *c, const char *path, branch_storage_t *bs, apr_pool_t *pool);
 
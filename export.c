@@ -22,10 +22,12 @@
 
 #include "export.h"
 #include "node.h"
+#include "reader.h"
 #include "sorts.h"
 #include "tree.h"
 #include "utils.h"
 #include <apr_portable.h>
+#include <apr_strings.h>
 #include <svn_dirent_uri.h>
 #include <svn_hash.h>
 #include <svn_pools.h>
@@ -35,6 +37,13 @@
 
 #define NULL_SHA1 "0000000000000000000000000000000000000000"
 
+// Maximal total size of blob contents hashed ahead of time
+// for a single revision, blobs beyond it are hashed as usual.
+#define PREFETCH_MAX_SIZE (256 * 1024 * 1024)
+
+// Number of blobs hashed and written at once by export_blobs().
+#define BLOBS_BATCH_SIZE 4096
+
 typedef struct
 {
     svn_fs_root_t *root;
@@ -56,17 +65,16 @@ typedef struct
 static svn_error_t *
 get_revision(revision_t **rev,
              svn_revnum_t revnum,
+             apr_hash_t *revprops,
              svn_fs_t *fs,
              export_ctx_t *ctx,
              apr_pool_t *pool)
 {
-    apr_hash_t *revprops;
     revision_t *r;
     svn_fs_root_t *root;
     svn_string_t *value;
 
     SVN_ERR(svn_fs_revision_root(&root, fs, revnum, pool));
-    SVN_ERR(svn_fs_revision_proplist(&revprops, fs, revnum, pool));
 
     r = apr_pcalloc(pool, sizeof(revision_t));
     r->root = root;
@@ -135,6 +143,94 @@ get_mergeinfo_for_path(svn_mergeinfo_t *mergeinfo,
     return SVN_NO_ERROR;
 }
 
+// Returns paths ignored below a directory copied from src_path, which
+// is at src_node_path relative to its branch. Ignores depend only on
+// the source path as long as branches do not change, so they are cached
+// until a branch is added.
+static tree_t *
+get_copy_ignores(export_ctx_t *ctx, const char *src_path, const char *src_node_path)
+{
+    apr_pool_t *pool = ctx->copy_ignores_pool;
+    tree_t *ignores;
+
+    if (ctx->copy_ignores_version != ctx->branches->version) {
+        svn_pool_clear(pool);
+        ctx->copy_ignores = apr_hash_make(pool);
+        ctx->copy_ignores_version = ctx->branches->version;
+    }
+
+    ignores = svn_hash_gets(ctx->copy_ignores, src_path);
+    if (ignores != NULL) {
+        return ignores;
+    }
+
+    // Ignore paths of sub-branches
+    const tree_t *sub_branches = tree_subtree(ctx->branches->tree, src_path);
+    // Ignore by absolute path
+    const tree_t *abs_ignores = tree_subtree(ctx->absignores, src_path);
+    // Ignore by relative path
+    const tree_t *rel_ignores = tree_subtree(ctx->ignores, src_node_path);
+    // Do not ignore by absolute path
+    const tree_t *no_ignores = tree_subtree(ctx->no_ignores, src_path);
+
+    tree_merge(&ignores, sub_branches, abs_ignores, pool);
+    tree_merge(&ignores, ignores, rel_ignores, pool);
+    tree_diff(&ignores, ignores, no_ignores, pool);
+    // Do not match by tree root node, i.e. do not ignore source path itself.
+    // We can merge orphan branch into parent branch.
+    if (ignores->value != NULL) {
+        tree_copy(&ignores, ignores, pool);
+        ignores->value = NULL;
+    }
+
+    svn_hash_sets(ctx->copy_ignores, apr_pstrdup(pool, src_path), ignores);
+
+    return ignores;
+}
+
+// Tests if path is ignored regardless of its branch.
+static svn_boolean_t
+is_abspath_ignored(export_ctx_t *ctx, const char *path)
+{
+    int labels;
+
+    if (tree_match(ctx->absignores, path) != NULL) {
+        return TRUE;
+    }
+
+    if (!(pattern_set_labels(ctx->patterns) & PATTERN_IGNORE_ABSPATH)) {
+        return FALSE;
+    }
+
+    labels = pattern_set_match(ctx->patterns, path, NULL);
+
+    return ((labels & PATTERN_IGNORE_ABSPATH) &&
+            !(labels & PATTERN_NO_IGNORE_ABSPATH) &&
+            tree_match(ctx->no_ignores, path) == NULL);
+}
+
+// Tests if path, which is at node_path relative to its branch,
+// is ignored. Not ignored paths and patterns override ignores.
+static svn_boolean_t
+is_path_ignored(export_ctx_t *ctx, const char *path, const char *node_path)
+{
+    svn_boolean_t ignored = (tree_match(ctx->ignores, node_path) != NULL);
+    int labels = 0;
+
+    // Classify path by all patterns in a single pass.
+    if (pattern_set_labels(ctx->patterns) != 0) {
+        labels = pattern_set_match(ctx->patterns, path, node_path);
+    }
+
+    if (labels & (PATTERN_IGNORE_ABSPATH | PATTERN_IGNORE_PATH)) {
+        ignored = TRUE;
+    }
+
+    return (ignored &&
+            !(labels & PATTERN_NO_IGNORE_ABSPATH) &&
+            tree_match(ctx->no_ignores, path) == NULL);
+}
+
 static svn_error_t *
 process_change_record(const char *path,
                       svn_fs_path_change2_t *change,
@@ -145,8 +241,8 @@ process_change_record(const char *path,
                       apr_pool_t *scratch_pool)
 {
     const char *src_path = NULL, *node_path;
-    const char *ignored, *not_ignored;
-    commit_t *commit, *parent;
+    commit_id_t commit, parent, *commit_ptr;
+    mark_t mark;
     branch_t *branch = NULL, *src_branch = NULL, *merge_branch;
     node_t *node;
     svn_boolean_t dst_is_root = FALSE, src_is_root = FALSE;
@@ -156,8 +252,7 @@ process_change_record(const char *path,
     svn_node_kind_t kind = change->node_kind;
     svn_revnum_t src_rev = change->copyfrom_rev;
 
-    ignored = tree_match(ctx->absignores, path, scratch_pool);
-    if (ignored != NULL) {
+    if (is_abspath_ignored(ctx, path)) {
         return SVN_NO_ERROR;
     }
 
@@ -194,27 +289,29 @@ process_change_record(const char *path,
         return SVN_NO_ERROR;
     }
 
-    ignored = tree_match(ctx->ignores, node_path, scratch_pool);
-    not_ignored = tree_match(ctx->no_ignores, path, scratch_pool);
-    if (ignored != NULL && not_ignored == NULL) {
+    if (is_path_ignored(ctx, path, node_path)) {
         return SVN_NO_ERROR;
     }
 
-    commit = apr_hash_get(rev->commits, branch, sizeof(branch_t *));
-    if (commit == NULL) {
-        parent = commit_cache_get(ctx->commits, rev->revnum - 1, branch);
-        commit = commit_cache_add(ctx->commits, rev->revnum, branch);
-        if (parent != NULL && branch->dirty == FALSE) {
-            commit->parent = parent->mark;
+    commit_ptr = apr_hash_get(rev->commits, branch, sizeof(branch_t *));
+    if (commit_ptr == NULL) {
+        SVN_ERR(commit_cache_get(&parent, ctx->commits, rev->revnum - 1, branch));
+        SVN_ERR(commit_cache_add(&commit, ctx->commits, rev->revnum, branch));
+        if (parent != COMMIT_ID_NONE && branch->dirty == FALSE) {
+            SVN_ERR(commit_cache_get_mark(&mark, ctx->commits, parent));
+            SVN_ERR(commit_cache_set_parent(ctx->commits, commit, mark));
         }
 
-        apr_hash_set(rev->commits, branch, sizeof(branch_t *), commit);
+        commit_ptr = apr_pmemdup(result_pool, &commit, sizeof(commit_id_t));
+        apr_hash_set(rev->commits, branch, sizeof(branch_t *), commit_ptr);
     }
+    commit = *commit_ptr;
 
     if (modify && src_branch != NULL && dst_is_root && src_is_root && branch->dirty) {
-        parent = commit_cache_get(ctx->commits, change->copyfrom_rev, src_branch);
-        if (parent != NULL) {
-            commit->parent = parent->mark;
+        SVN_ERR(commit_cache_get(&parent, ctx->commits, change->copyfrom_rev, src_branch));
+        if (parent != COMMIT_ID_NONE) {
+            SVN_ERR(commit_cache_get_mark(&mark, ctx->commits, parent));
+            SVN_ERR(commit_cache_set_parent(ctx->commits, commit, mark));
             return SVN_NO_ERROR;
         }
     }
@@ -270,17 +367,17 @@ process_change_record(const char *path,
                 last_merged = rev->revnum - 1;
             }
 
-            parent = commit_cache_get(ctx->commits, last_merged, merge_branch);
-            if (parent != NULL) {
-                commit_cache_add_merge(ctx->commits, commit, parent, scratch_pool);
+            SVN_ERR(commit_cache_get(&parent, ctx->commits, last_merged, merge_branch));
+            if (parent != COMMIT_ID_NONE) {
+                SVN_ERR(commit_cache_add_merge(ctx->commits, commit, parent));
             }
         }
     }
 
     if (src_branch != NULL) {
-        parent = commit_cache_get(ctx->commits, change->copyfrom_rev, src_branch);
-        if (parent != NULL) {
-            commit_cache_add_merge(ctx->commits, commit, parent, scratch_pool);
+        SVN_ERR(commit_cache_get(&parent, ctx->commits, change->copyfrom_rev, src_branch));
+        if (parent != COMMIT_ID_NONE) {
+            SVN_ERR(commit_cache_add_merge(ctx->commits, commit, parent));
         }
     }
 
@@ -295,28 +392,17 @@ process_change_record(const char *path,
         const char *src_node_path = svn_relpath_skip_ancestor(src_branch->path, src_path);
         svn_fs_t *fs = svn_fs_root_fs(rev->root);
         svn_fs_root_t *src_root;
-        tree_t *ignores = NULL;
-
-        // Ignore paths of sub-branches
-        const tree_t *sub_branches = tree_subtree(ctx->branches->tree, src_path, scratch_pool);
-        // Ignore by absolute path
-        const tree_t *abs_ignores = tree_subtree(ctx->absignores, src_path, scratch_pool);
-        // Ignore by relative path
-        const tree_t *rel_ignores = tree_subtree(ctx->ignores, src_node_path, scratch_pool);
-        // Do not ignore by absolute path
-        const tree_t *no_ignores = tree_subtree(ctx->no_ignores, src_path, scratch_pool);
-
-        tree_merge(&ignores, sub_branches, abs_ignores, scratch_pool);
-        tree_merge(&ignores, ignores, rel_ignores, scratch_pool);
-        tree_diff(&ignores, ignores, no_ignores, scratch_pool);
-        // Do not match by tree root node, i.e. do not ignore source path itself.
-        // We can merge orphan branch into parent branch.
-        ignores->value = NULL;
+        ignores_t ignores;
+
+        ignores.paths = get_copy_ignores(ctx, src_path, src_node_path);
+        ignores.no_ignores = tree_subtree(ctx->no_ignores, src_path);
+        ignores.patterns = ctx->patterns;
+        ignores.branch_path = src_branch->path;
 
         SVN_ERR(svn_fs_revision_root(&src_root, fs, change->copyfrom_rev, scratch_pool));
         SVN_ERR(set_tree_checksum(&node->checksum, &node->cached, &node->entries,
                                   dst, ctx->blobs, src_root, src_path,
-                                  src_path, node->path, ignores,
+                                  src_path, node->path, &ignores,
                                   result_pool, scratch_pool));
     }
 
@@ -324,83 +410,123 @@ process_change_record(const char *path,
 }
 
 static svn_error_t *
-reset_branch(svn_stream_t *dst,
-             branch_t *branch,
-             commit_t *commit,
-             apr_pool_t *pool)
+reset_branch(output_t *out, branch_t *branch, mark_t mark)
 {
-    SVN_ERR(svn_stream_printf(dst, pool, "reset %s\n", branch->refname));
-    SVN_ERR(svn_stream_printf(dst, pool, "from :%d\n", commit->mark));
+    SVN_ERR(output_cstr(out, "reset "));
+    SVN_ERR(output_cstr(out, branch->refname));
+    SVN_ERR(output_cstr(out, "\nfrom :"));
+    SVN_ERR(output_dec(out, mark));
+    SVN_ERR(output_char(out, '\n'));
 
     return SVN_NO_ERROR;
 }
 
 static svn_error_t *
-node_modify(svn_stream_t *dst, const node_t *node, apr_pool_t *pool)
+node_modify(output_t *out, const node_t *node)
 {
-    const char *checksum;
-    checksum = svn_checksum_to_cstring_display(node->checksum, pool);
-
     if (node->kind == svn_node_dir && node->cached == FALSE) {
         for (int i = 0; i < node->entries->nelts; i++) {
             const node_t *subnode = &APR_ARRAY_IDX(node->entries, i, node_t);
-            SVN_ERR(node_modify(dst, subnode, pool));
+            SVN_ERR(node_modify(out, subnode));
         }
     } else {
-        SVN_ERR(svn_stream_printf(dst, pool, "M %o %s \"%s\"\n",
-                                  node->mode, checksum, node->path));
+        SVN_ERR(output_cstr(out, "M "));
+        SVN_ERR(output_oct(out, node->mode));
+        SVN_ERR(output_char(out, ' '));
+        SVN_ERR(output_checksum(out, &node->checksum));
+        SVN_ERR(output_cstr(out, " \""));
+        SVN_ERR(output_cstr(out, node->path));
+        SVN_ERR(output_cstr(out, "\"\n"));
     }
 
     return SVN_NO_ERROR;
 }
 
 static svn_error_t *
-node_delete(svn_stream_t *dst, const node_t *node, apr_pool_t *pool)
+node_delete(output_t *out, const node_t *node)
 {
-    SVN_ERR(svn_stream_printf(dst, pool, "D \"%s\"\n", node->path));
+    SVN_ERR(output_cstr(out, "D \""));
+    SVN_ERR(output_cstr(out, node->path));
+    SVN_ERR(output_cstr(out, "\"\n"));
 
     return SVN_NO_ERROR;
 }
 
+// Writes timezone offset like "%+.2d%.2d" of its hours and minutes,
+// offsets are well within 100 hours.
 static svn_error_t *
-write_commit(svn_stream_t *dst,
+write_tz(output_t *out, apr_int32_t gmtoff)
+{
+    int hours = gmtoff / 3600;
+    int minutes = (abs(gmtoff) / 60) % 60;
+    char tz[5];
+
+    tz[0] = (hours < 0) ? '-' : '+';
+    hours = abs(hours);
+    tz[1] = '0' + hours / 10;
+    tz[2] = '0' + hours % 10;
+    tz[3] = '0' + minutes / 10;
+    tz[4] = '0' + minutes % 10;
+
+    return output_write(out, tz, sizeof(tz));
+}
+
+static svn_error_t *
+write_commit(output_t *out,
              branch_t *branch,
-             commit_t *commit,
+             commit_id_t commit,
              revision_t *rev,
              export_ctx_t *ctx,
              apr_pool_t *pool)
 {
     apr_array_header_t *changes;
+    mark_t parent, mark;
+
+    SVN_ERR(commit_cache_get_parent(&parent, ctx->commits, commit));
     changes = get_branch_changes(rev, branch);
 
-    if (changes->nelts == 0 && commit->parent) {
+    if (changes->nelts == 0 && parent) {
         // In case there is only one node in a commit and this node is
         // a root directory copied from another branch, mark this commit
         // as dummy, set copyfrom commit as its parent and reset branch to it.
-        commit->mark = commit->parent;
-        SVN_ERR(reset_branch(dst, branch, commit, pool));
+        SVN_ERR(commit_cache_set_parent_mark(ctx->commits, commit));
+        SVN_ERR(reset_branch(out, branch, parent));
     } else {
         apr_time_exp_t time_exp;
-        commit_cache_set_mark(ctx->commits, commit);
-        apr_time_exp_lt(&time_exp, rev->timestamp);
+        const mark_t *merges;
+        int nmerges;
 
-        SVN_ERR(svn_stream_printf(dst, pool, "commit %s\n", branch->refname));
-        SVN_ERR(svn_stream_printf(dst, pool, "mark :%d\n", commit->mark));
-        SVN_ERR(svn_stream_printf(dst, pool, "committer %s %ld %+.2d%.2d\n",
-                                  author_to_cstring(rev->author, pool),
-                                  apr_time_sec(rev->timestamp),
-                                  time_exp.tm_gmtoff / 3600,
-                                  (abs(time_exp.tm_gmtoff) / 60) % 60));
-        SVN_ERR(svn_stream_printf(dst, pool, "data %ld\n", rev->message->len));
-        SVN_ERR(svn_stream_printf(dst, pool, "%s\n", rev->message->data));
+        SVN_ERR(commit_cache_set_mark(ctx->commits, commit));
+        SVN_ERR(commit_cache_get_mark(&mark, ctx->commits, commit));
+        apr_time_exp_lt(&time_exp, rev->timestamp);
 
-        if (commit->parent) {
-            SVN_ERR(svn_stream_printf(dst, pool, "from :%d\n", commit->parent));
+        SVN_ERR(output_cstr(out, "commit "));
+        SVN_ERR(output_cstr(out, branch->refname));
+        SVN_ERR(output_cstr(out, "\nmark :"));
+        SVN_ERR(output_dec(out, mark));
+        SVN_ERR(output_cstr(out, "\ncommitter "));
+        SVN_ERR(output_cstr(out, author_to_cstring(rev->author, pool)));
+        SVN_ERR(output_char(out, ' '));
+        SVN_ERR(output_dec(out, apr_time_sec(rev->timestamp)));
+        SVN_ERR(output_char(out, ' '));
+        SVN_ERR(write_tz(out, time_exp.tm_gmtoff));
+        SVN_ERR(output_cstr(out, "\ndata "));
+        SVN_ERR(output_dec(out, rev->message->len));
+        SVN_ERR(output_char(out, '\n'));
+        SVN_ERR(output_cstr(out, rev->message->data));
+        SVN_ERR(output_char(out, '\n'));
+
+        if (parent) {
+            SVN_ERR(output_cstr(out, "from :"));
+            SVN_ERR(output_dec(out, parent));
+            SVN_ERR(output_char(out, '\n'));
         }
 
-        for (int i = 0; i < commit->merges->nelts; i++) {
-            mark_t merge = APR_ARRAY_IDX(commit->merges, i, mark_t);
-            SVN_ERR(svn_stream_printf(dst, pool, "merge :%d\n", merge));
+        SVN_ERR(commit_cache_get_merges(&merges, &nmerges, ctx->commits, commit));
+        for (int i = 0; i < nmerges; i++) {
+            SVN_ERR(output_cstr(out, "merge :"));
+            SVN_ERR(output_dec(out, merges[i]));
+            SVN_ERR(output_char(out, '\n'));
         }
     }
 
@@ -409,14 +535,14 @@ write_commit(svn_stream_t *dst,
         switch (change->action) {
         case svn_fs_path_change_add:
         case svn_fs_path_change_modify:
-            SVN_ERR(node_modify(dst, change->node, pool));
+            SVN_ERR(node_modify(out, change->node));
             break;
         case svn_fs_path_change_delete:
-            SVN_ERR(node_delete(dst, change->node, pool));
+            SVN_ERR(node_delete(out, change->node));
             break;
         case svn_fs_path_change_replace:
-            SVN_ERR(node_delete(dst, change->node, pool));
-            SVN_ERR(node_modify(dst, change->node, pool));
+            SVN_ERR(node_delete(out, change->node));
+            SVN_ERR(node_modify(out, change->node));
         default:
             // noop
             break;
@@ -429,10 +555,11 @@ write_commit(svn_stream_t *dst,
 }
 
 static svn_error_t *
-remove_branch(svn_stream_t *dst, branch_t *branch, apr_pool_t *pool)
+remove_branch(output_t *out, branch_t *branch)
 {
-    SVN_ERR(svn_stream_printf(dst, pool, "reset %s\n", branch->refname));
-    SVN_ERR(svn_stream_printf(dst, pool, "from %s\n", NULL_SHA1));
+    SVN_ERR(output_cstr(out, "reset "));
+    SVN_ERR(output_cstr(out, branch->refname));
+    SVN_ERR(output_cstr(out, "\nfrom " NULL_SHA1 "\n"));
 
     branch->dirty = TRUE;
 
@@ -440,7 +567,7 @@ remove_branch(svn_stream_t *dst, branch_t *branch, apr_pool_t *pool)
 }
 
 static svn_error_t *
-write_revision(svn_stream_t *dst,
+write_revision(output_t *out,
                revision_t *rev,
                export_ctx_t *ctx,
                apr_pool_t *pool)
@@ -452,26 +579,65 @@ write_revision(svn_stream_t *dst,
             apr_hash_count(rev->removes) == 0);
 
     if (skip) {
-        SVN_ERR(svn_stream_printf(dst, pool,
-                                  "progress Skipped revision %ld\n",
-                                  rev->revnum));
+        SVN_ERR(output_cstr(out, "progress Skipped revision "));
+        SVN_ERR(output_dec(out, rev->revnum));
+        SVN_ERR(output_char(out, '\n'));
         return SVN_NO_ERROR;
     }
 
     for (idx = apr_hash_first(pool, rev->removes); idx; idx = apr_hash_next(idx)) {
         branch_t *branch = apr_hash_this_val(idx);
-        SVN_ERR(remove_branch(dst, branch, pool));
+        SVN_ERR(remove_branch(out, branch));
     }
 
     for (idx = apr_hash_first(pool, rev->commits); idx; idx = apr_hash_next(idx)) {
         branch_t *branch = (branch_t *) apr_hash_this_key(idx);
-        commit_t *commit = apr_hash_this_val(idx);
-        SVN_ERR(write_commit(dst, branch, commit, rev, ctx, pool));
+        commit_id_t *commit = apr_hash_this_val(idx);
+        SVN_ERR(write_commit(out, branch, *commit, rev, ctx, pool));
+    }
+
+    SVN_ERR(output_cstr(out, "progress Imported revision "));
+    SVN_ERR(output_dec(out, rev->revnum));
+    SVN_ERR(output_char(out, '\n'));
+
+    return SVN_NO_ERROR;
+}
+
+// Sets kind of path in root. Entries of directories are kept in dirs,
+// so that checking many paths of the same directory lists it once.
+static svn_error_t *
+check_path_listed(svn_node_kind_t *kind,
+                  svn_fs_root_t *root,
+                  const char *path,
+                  apr_hash_t *dirs,
+                  apr_pool_t *pool)
+{
+    const char *dir, *name;
+    apr_hash_t *entries;
+    svn_fs_dirent_t *dirent;
+
+    if (*path == '\0') {
+        *kind = svn_node_dir;
+        return SVN_NO_ERROR;
+    }
+
+    svn_relpath_split(&dir, &name, path, pool);
+
+    entries = svn_hash_gets(dirs, dir);
+    if (entries == NULL) {
+        svn_node_kind_t dir_kind;
+
+        SVN_ERR(check_path_listed(&dir_kind, root, dir, dirs, pool));
+        if (dir_kind == svn_node_dir) {
+            SVN_ERR(svn_fs_dir_entries(&entries, root, dir, pool));
+        } else {
+            entries = apr_hash_make(pool);
+        }
+        svn_hash_sets(dirs, dir, entries);
     }
 
-    SVN_ERR(svn_stream_printf(dst, pool,
-                              "progress Imported revision %ld\n",
-                              rev->revnum));
+    dirent = svn_hash_gets(entries, name);
+    *kind = (dirent != NULL) ? dirent->kind : svn_node_none;
 
     return SVN_NO_ERROR;
 }
@@ -515,7 +681,7 @@ prepare_changes(apr_array_header_t **dst,
                   action == svn_fs_path_change_modify);
 
         if (remove) {
-            removes = tree_values(ctx->branches->tree, path, scratch_pool, scratch_pool);
+            removes = branch_storage_lookup_subbranches(ctx->branches, path, scratch_pool);
 
             for (int i = 0; i < removes->nelts; i++) {
                 branch_t *branch = APR_ARRAY_IDX(removes, i, branch_t *);
@@ -536,8 +702,9 @@ prepare_changes(apr_array_header_t **dst,
             const char *src_path = change->copyfrom_path;
             svn_fs_t *fs = svn_fs_root_fs(root);
             svn_fs_root_t *src_root;
+            apr_hash_t *dirs = apr_hash_make(scratch_pool);
             SVN_ERR(svn_fs_revision_root(&src_root, fs, change->copyfrom_rev, scratch_pool));
-            copies = tree_values(ctx->branches->tree, src_path, scratch_pool, scratch_pool);
+            copies = branch_storage_lookup_subbranches(ctx->branches, src_path, scratch_pool);
 
             for (int i = 0; i < copies->nelts; i++) {
                 const char *new_path;
@@ -546,7 +713,7 @@ prepare_changes(apr_array_header_t **dst,
                 if (branch_path_is_root(branch, path)) {
                     continue;
                 }
-                SVN_ERR(svn_fs_check_path(&kind, src_root, branch->path, scratch_pool));
+                SVN_ERR(check_path_listed(&kind, src_root, branch->path, dirs, scratch_pool));
                 if (kind == svn_node_none) {
                     continue;
                 }
@@ -572,6 +739,81 @@ prepare_changes(apr_array_header_t **dst,
     return SVN_NO_ERROR;
 }
 
+// Hashes contents of files added or modified by changes in parallel
+// and keeps them in memory, so that process_change_record() only has
+// to write them out in order.
+static svn_error_t *
+prefetch_blobs(apr_array_header_t *changes,
+               revision_t *rev,
+               export_ctx_t *ctx,
+               apr_pool_t *result_pool,
+               apr_pool_t *scratch_pool)
+{
+    apr_array_header_t *jobs;
+    apr_hash_t *seen;
+    apr_size_t total_size = 0;
+    apr_pool_t *iterpool = svn_pool_create(scratch_pool);
+
+    jobs = apr_array_make(result_pool, 0, sizeof(blob_job_t *));
+    seen = apr_hash_make(scratch_pool);
+
+    for (int i = 0; i < changes->nelts; i++) {
+        sort_item_t item = APR_ARRAY_IDX(changes, i, sort_item_t);
+        svn_fs_path_change2_t *change = item.value;
+        svn_fs_path_change_kind_t action = change->change_kind;
+        svn_checksum_t *svn_checksum;
+        svn_filesize_t size;
+        blob_job_t *job;
+
+        svn_pool_clear(iterpool);
+
+        if (change->node_kind != svn_node_file || action == svn_fs_path_change_delete) {
+            continue;
+        }
+
+        if (is_abspath_ignored(ctx, item.key)) {
+            continue;
+        }
+
+        if (branch_storage_lookup_path(ctx->branches, item.key, iterpool) == NULL) {
+            continue;
+        }
+
+        // Most files are cached already, keep only checksums of jobs.
+        SVN_ERR(svn_fs_file_checksum(&svn_checksum, svn_checksum_sha1,
+                                     rev->root, item.key, FALSE, iterpool));
+
+        if (checksum_cache_contains(ctx->blobs, svn_checksum)) {
+            continue;
+        }
+
+        if (apr_hash_get(seen, svn_checksum->digest, svn_checksum_size(svn_checksum)) != NULL) {
+            continue;
+        }
+
+        SVN_ERR(svn_fs_file_length(&size, rev->root, item.key, iterpool));
+        if (total_size + size > PREFETCH_MAX_SIZE) {
+            continue;
+        }
+        total_size += size;
+
+        job = apr_pcalloc(result_pool, sizeof(blob_job_t));
+        job->revnum = rev->revnum;
+        job->path = item.key;
+        job->svn_checksum = svn_checksum_dup(svn_checksum, result_pool);
+
+        apr_hash_set(seen, job->svn_checksum->digest, svn_checksum_size(svn_checksum), job);
+        APR_ARRAY_PUSH(jobs, blob_job_t *) = job;
+    }
+
+    svn_pool_destroy(iterpool);
+
+    SVN_ERR(hasher_run(ctx->hasher, jobs, TRUE, scratch_pool));
+    checksum_cache_prefetch(ctx->blobs, jobs, result_pool);
+
+    return SVN_NO_ERROR;
+}
+
 export_ctx_t *
 export_ctx_create(apr_pool_t *pool)
 {
@@ -583,50 +825,326 @@ export_ctx_create(apr_pool_t *pool)
     ctx->ignores = tree_create(pool);
     ctx->absignores = tree_create(pool);
     ctx->no_ignores = tree_create(pool);
+    ctx->patterns = pattern_set_create(pool);
+    ctx->copy_ignores_pool = svn_pool_create(pool);
+    ctx->copy_ignores = apr_hash_make(ctx->copy_ignores_pool);
+    ctx->copy_ignores_version = ctx->branches->version;
 
     return ctx;
 }
 
-svn_error_t *
-export_revision_range(svn_stream_t *dst,
-                      svn_fs_t *fs,
-                      svn_revnum_t lower,
-                      svn_revnum_t upper,
-                      export_ctx_t *ctx,
-                      svn_cancel_func_t cancel_func,
-                      apr_pool_t *pool)
+// Exports revisions from lower to upper, taking revision properties
+// and changed paths from reader if there is one.
+static svn_error_t *
+export_revisions(output_t *out,
+                 svn_fs_t *fs,
+                 svn_revnum_t lower,
+                 svn_revnum_t upper,
+                 reader_t *reader,
+                 export_ctx_t *ctx,
+                 svn_cancel_func_t cancel_func,
+                 apr_pool_t *pool)
 {
     apr_pool_t *rev_pool, *scratch_pool;
+    // Output position of the last checksum_cache_mark().
+    apr_uint64_t marked = 0;
 
     rev_pool = svn_pool_create(pool);
 
     for (svn_revnum_t revnum = lower; revnum <= upper; revnum++) {
         SVN_ERR(cancel_func(NULL));
         apr_array_header_t *changes, *sorted_changes;
-        apr_hash_t *fs_changes;
+        apr_hash_t *fs_changes, *revprops;
         revision_t *rev;
+        apr_uint64_t written;
 
         svn_pool_clear(rev_pool);
 
         scratch_pool = svn_pool_create(rev_pool);
 
-        SVN_ERR(get_revision(&rev, revnum, fs, ctx, rev_pool));
+        if (reader != NULL) {
+            SVN_ERR(reader_next(&revprops, &sorted_changes, reader));
+        } else {
+            SVN_ERR(svn_fs_revision_proplist(&revprops, fs, revnum, rev_pool));
+        }
+
+        SVN_ERR(get_revision(&rev, revnum, revprops, fs, ctx, rev_pool));
+
+        if (reader == NULL) {
+            // Fetch the paths changed under revision root.
+            SVN_ERR(svn_fs_paths_changed2(&fs_changes, rev->root, rev_pool));
+            sorted_changes = sort_hash(fs_changes, compare_items_as_paths, rev_pool);
+        }
 
-        // Fetch the paths changed under revision root.
-        SVN_ERR(svn_fs_paths_changed2(&fs_changes, rev->root, rev_pool));
-        sorted_changes = sort_hash(fs_changes, compare_items_as_paths, rev_pool);
         SVN_ERR(prepare_changes(&changes, sorted_changes, rev->root, ctx, rev_pool, scratch_pool));
 
+        if (ctx->hasher != NULL) {
+            SVN_ERR(prefetch_blobs(changes, rev, ctx, rev_pool, scratch_pool));
+        }
+
         for (int i = 0; i < changes->nelts; i++) {
             svn_pool_clear(scratch_pool);
             sort_item_t item = APR_ARRAY_IDX(changes, i, sort_item_t);
-            SVN_ERR(process_change_record(item.key, item.value, dst, rev, ctx, rev_pool, scratch_pool));
+            SVN_ERR(process_change_record(item.key, item.value, output_stream(out),
+                                          rev, ctx, rev_pool, scratch_pool));
+        }
+
+        checksum_cache_prefetch(ctx->blobs, NULL, rev_pool);
+
+        SVN_ERR(write_revision(out, rev, ctx, rev_pool));
+        SVN_ERR(output_flush(out));
+        checksum_cache_commit_trees(ctx->blobs);
+
+        // Persist checksums of blobs written so far, so they survive
+        // an interrupted export. While the writer thread is behind,
+        // persist those of revisions it has written since the last mark.
+        written = output_written(out);
+        if (written == output_flushed(out)) {
+            SVN_ERR(checksum_cache_flush(ctx->blobs, rev_pool));
+        } else if (written >= marked) {
+            SVN_ERR(checksum_cache_flush_marked(ctx->blobs, rev_pool));
+            checksum_cache_mark(ctx->blobs);
+            marked = output_flushed(out);
+        }
+
+        if (reader != NULL) {
+            reader_release(reader);
+        }
+    }
+
+    svn_pool_destroy(rev_pool);
+
+    return SVN_NO_ERROR;
+}
+
+svn_error_t *
+export_revision_range(output_t *out,
+                      svn_fs_t *fs,
+                      svn_revnum_t lower,
+                      svn_revnum_t upper,
+                      export_ctx_t *ctx,
+                      svn_cancel_func_t cancel_func,
+                      apr_pool_t *pool)
+{
+    reader_t *reader = NULL;
+    svn_error_t *err;
+
+    if (ctx->read_ahead > 0) {
+        SVN_ERR(reader_start(&reader, fs, lower, upper, ctx->read_ahead, pool));
+    }
+
+    err = export_revisions(out, fs, lower, upper, reader, ctx, cancel_func, pool);
+
+    // Stop the reader before any of its revisions are freed.
+    if (reader != NULL) {
+        reader_stop(reader);
+    }
+
+    SVN_ERR(err);
+
+    if (commit_cache_spilled(ctx->commits) > 0) {
+        SVN_ERR(output_cstr(out, "progress Spilled "));
+        SVN_ERR(output_dec(out, commit_cache_spilled(ctx->commits)));
+        SVN_ERR(output_cstr(out, " pages of revision marks\n"));
+    }
+
+    SVN_ERR(output_cstr(out, "done\n"));
+    SVN_ERR(output_sync(out));
+
+    return SVN_NO_ERROR;
+}
+
+// Collects files added or modified in revision, along with files
+// below copied directories, which contents are not cached yet.
+static svn_error_t *
+collect_revision_blobs(apr_array_header_t *jobs,
+                       apr_hash_t *seen,
+                       svn_fs_root_t *root,
+                       export_ctx_t *ctx,
+                       apr_pool_t *result_pool,
+                       apr_pool_t *scratch_pool)
+{
+    apr_hash_t *fs_changes;
+    apr_hash_index_t *idx;
+    apr_array_header_t *copied;
+    apr_pool_t *iterpool = svn_pool_create(scratch_pool);
+
+    SVN_ERR(svn_fs_paths_changed2(&fs_changes, root, scratch_pool));
+
+    copied = apr_array_make(scratch_pool, 0, sizeof(blob_job_t *));
+
+    for (idx = apr_hash_first(scratch_pool, fs_changes); idx; idx = apr_hash_next(idx)) {
+        svn_fs_path_change2_t *change = apr_hash_this_val(idx);
+        // Convert dirent paths to relpaths.
+        const char *path = svn_dirent_skip_ancestor("/", apr_hash_this_key(idx));
+        const char *node_path;
+        branch_t *branch;
+        svn_checksum_t *svn_checksum;
+        blob_job_t *job;
+
+        svn_pool_clear(iterpool);
+
+        if (change->change_kind == svn_fs_path_change_delete) {
+            continue;
         }
 
-        SVN_ERR(write_revision(dst, rev, ctx, rev_pool));
+        if (is_abspath_ignored(ctx, path)) {
+            continue;
+        }
+
+        branch = branch_storage_lookup_path(ctx->branches, path, iterpool);
+        if (branch == NULL) {
+            continue;
+        }
+
+        node_path = svn_relpath_skip_ancestor(branch->path, path);
+        if (node_path == NULL || is_path_ignored(ctx, path, node_path)) {
+            continue;
+        }
+
+        // Copied directories are walked at their source,
+        // the same way process_change_record() does.
+        if (change->node_kind == svn_node_dir) {
+            const char *src_path = change->copyfrom_path;
+            branch_t *src_branch = NULL;
+
+            if (change->copyfrom_known && SVN_IS_VALID_REVNUM(change->copyfrom_rev)) {
+                src_branch = branch_storage_lookup_path(ctx->branches, src_path, iterpool);
+            }
+
+            if (src_branch != NULL) {
+                const char *src_node_path = svn_relpath_skip_ancestor(src_branch->path, src_path);
+                svn_fs_root_t *src_root;
+                ignores_t ignores;
+
+                ignores.paths = get_copy_ignores(ctx, src_path, src_node_path);
+                ignores.no_ignores = tree_subtree(ctx->no_ignores, src_path);
+                ignores.patterns = ctx->patterns;
+                ignores.branch_path = src_branch->path;
+
+                SVN_ERR(svn_fs_revision_root(&src_root, svn_fs_root_fs(root),
+                                             change->copyfrom_rev, iterpool));
+                SVN_ERR(collect_tree_blobs(copied, ctx->blobs, src_root, src_path, src_path,
+                                           &ignores, result_pool, iterpool));
+            }
+            continue;
+        }
+
+        SVN_ERR(svn_fs_file_checksum(&svn_checksum, svn_checksum_sha1,
+                                     root, path, FALSE, result_pool));
+
+        job = apr_pcalloc(result_pool, sizeof(blob_job_t));
+        job->revnum = svn_fs_revision_root_revision(root);
+        job->path = apr_pstrdup(result_pool, path);
+        job->svn_checksum = svn_checksum;
+
+        APR_ARRAY_PUSH(copied, blob_job_t *) = job;
+    }
+
+    for (int i = 0; i < copied->nelts; i++) {
+        blob_job_t *job = APR_ARRAY_IDX(copied, i, blob_job_t *);
+        svn_checksum_t *svn_checksum = job->svn_checksum;
+
+        if (checksum_cache_contains(ctx->blobs, svn_checksum)) {
+            continue;
+        }
+
+        if (apr_hash_get(seen, svn_checksum->digest, svn_checksum_size(svn_checksum)) != NULL) {
+            continue;
+        }
+
+        apr_hash_set(seen, svn_checksum->digest, svn_checksum_size(svn_checksum), job);
+        APR_ARRAY_PUSH(jobs, blob_job_t *) = job;
+    }
+
+    svn_pool_destroy(iterpool);
+
+    return SVN_NO_ERROR;
+}
+
+// Hashes and writes batch of jobs, then caches their checksums.
+static svn_error_t *
+export_blobs_batch(apr_array_header_t *jobs,
+                   export_ctx_t *ctx,
+                   apr_pool_t *pool)
+{
+    SVN_ERR(hasher_run(ctx->hasher, jobs, FALSE, pool));
+
+    for (int i = 0; i < jobs->nelts; i++) {
+        blob_job_t *job = APR_ARRAY_IDX(jobs, i, blob_job_t *);
+        checksum_cache_set(ctx->blobs, job->svn_checksum, job->checksum);
+    }
+
+    SVN_ERR(checksum_cache_flush(ctx->blobs, pool));
+
+    return SVN_NO_ERROR;
+}
+
+svn_error_t *
+export_blobs(apr_array_header_t *outputs,
+             svn_fs_t *fs,
+             svn_revnum_t lower,
+             svn_revnum_t upper,
+             export_ctx_t *ctx,
+             svn_cancel_func_t cancel_func,
+             apr_pool_t *pool)
+{
+    apr_array_header_t *jobs;
+    apr_hash_t *seen;
+    apr_pool_t *batch_pool, *rev_pool;
+    svn_error_t *err;
+
+    batch_pool = svn_pool_create(pool);
+    rev_pool = svn_pool_create(pool);
+
+    jobs = apr_array_make(batch_pool, 0, sizeof(blob_job_t *));
+    seen = apr_hash_make(batch_pool);
+
+    hasher_set_outputs(ctx->hasher, outputs);
+
+    for (svn_revnum_t revnum = lower; revnum <= upper; revnum++) {
+        svn_fs_root_t *root;
+
+        err = cancel_func(NULL);
+        if (err) {
+            break;
+        }
+
+        svn_pool_clear(rev_pool);
+
+        err = svn_fs_revision_root(&root, fs, revnum, rev_pool);
+        if (err) {
+            break;
+        }
+
+        err = collect_revision_blobs(jobs, seen, root, ctx, batch_pool, rev_pool);
+        if (err) {
+            break;
+        }
+
+        if (jobs->nelts >= BLOBS_BATCH_SIZE || revnum == upper) {
+            err = export_blobs_batch(jobs, ctx, rev_pool);
+            if (err) {
+                break;
+            }
+
+            svn_pool_clear(batch_pool);
+            jobs = apr_array_make(batch_pool, 0, sizeof(blob_job_t *));
+            seen = apr_hash_make(batch_pool);
+        }
+    }
+
+    hasher_set_outputs(ctx->hasher, NULL);
+
+    SVN_ERR(err);
+
+    for (int i = 0; i < outputs->nelts; i++) {
+        svn_stream_t *output = APR_ARRAY_IDX(outputs, i, svn_stream_t *);
+        SVN_ERR(svn_stream_printf(output, pool, "done\n"));
     }
 
-    SVN_ERR(svn_stream_printf(dst, pool, "done\n"));
+    svn_pool_destroy(rev_pool);
+    svn_pool_destroy(batch_pool);
 
     return SVN_NO_ERROR;
 }
@@ -26,6 +26,8 @@
 #include "author.h"
 #include "checksum.h"
 #include "commit.h"
+#include "hasher.h"
+#include "output.h"
 #include <svn_fs.h>
 
 typedef struct
@@ -37,13 +39,25 @@ typedef struct
     tree_t *ignores;
     tree_t *absignores;
     tree_t *no_ignores;
+    // Glob and regular expression ignores.
+    pattern_set_t *patterns;
+    // Ignores of directories copied from a path keyed by the path,
+    // valid while branches version stays the same.
+    apr_hash_t *copy_ignores;
+    apr_pool_t *copy_ignores_pool;
+    apr_uint32_t copy_ignores_version;
+    // Hashes blobs of a revision in parallel, if set.
+    hasher_t *hasher;
+    // Number of revisions read ahead on a separate thread, if positive.
+    int read_ahead;
 } export_ctx_t;
 
 export_ctx_t *
 export_ctx_create(apr_pool_t *pool);
 
+// Writes fast-import stream of revisions from lower to upper into out.
 svn_error_t *
-export_revision_range(svn_stream_t *dst,
+export_revision_range(output_t *out,
                       svn_fs_t *fs,
                       svn_revnum_t lower,
                       svn_revnum_t upper,
@@ -51,4 +65,18 @@ export_revision_range(svn_stream_t *dst,
                       svn_cancel_func_t cancel_func,
                       apr_pool_t *pool);
 
+// Writes contents of files changed from lower to upper, which checksums
+// are not cached yet, as blobs only, each content once. Every hashing
+// thread writes into its own stream from array of svn_stream_t pointers,
+// so that streams can be fed to separate git fast-import processes.
+// Checksums are cached as soon as blobs are written.
+svn_error_t *
+export_blobs(apr_array_header_t *outputs,
+             svn_fs_t *fs,
+             svn_revnum_t lower,
+             svn_revnum_t upper,
+             export_ctx_t *ctx,
+             svn_cancel_func_t cancel_func,
+             apr_pool_t *pool);
+
 #endif // SVN_FAST_EXPORT_H_
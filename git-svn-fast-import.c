@@ -0,0 +1,755 @@
+/* Copyright (C) 2014 by Maxim Bublis <b@codemonkey.ru>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+// -std=c99 hides POSIX.1-2008 interfaces such as mkdtemp() and O_CLOEXEC,
+// and Linux extensions such as splice() and F_SETPIPE_SZ.
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L
+#endif
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
+#include "checksum.h"
+#include "options.h"
+#include <apr_signal.h>
+#include <apr_strings.h>
+#include <apr_time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <svn_cmdline.h>
+#include <svn_dirent_uri.h>
+#include <svn_io.h>
+#include <svn_opt.h>
+#include <svn_pools.h>
+#include <unistd.h>
+
+#if defined(__linux__) && defined(SPLICE_F_NONBLOCK)
+#define HAVE_SPLICE 1
+#endif
+
+// Size pipes are enlarged to where supported,
+// matches output buffer of svn-fast-export.
+#define PIPE_SIZE (1024 * 1024)
+
+// Maximal number of bytes moved between pipes at once.
+#define RELAY_CHUNK (64 * 1024)
+
+extern char **environ;
+
+enum
+{
+    option_incremental = SVN_OPT_FIRST_LONGOPT_ID,
+    option_no_ignore_abspath,
+    option_export_rev_marks,
+    option_import_rev_marks,
+    option_rev_marks_format,
+    option_commit_cache_size,
+    option_export_branches,
+    option_import_branches,
+    option_export_marks,
+    option_import_marks,
+    option_import_marks_if_exists,
+    option_read_ahead,
+    option_writer_thread,
+    option_blobs_only,
+    option_force,
+    option_quiet
+};
+
+static struct apr_getopt_option_t cmdline_options[] = {
+    {"help", 'h', 0, "Print this message and exit"},
+    {"revision", 'r', 1, "Set revision range."},
+    {"stdlayout", 's', 0, "Set trunk, tags, branches as the relative paths, which is SVN default."},
+    {"incremental", option_incremental, 0, "Incremental mode."},
+    {"branch", 'b', 1, "Set repository path as a branch."},
+    {"branches", 'B', 1, "Set repository path as a root for branches."},
+    {"tag", 't', 1, "Set repository path as a tag."},
+    {"tags", 'T', 1, "Set repository path as a root for tags."},
+    {"ignore-path", 'I', 1, "Ignore a path relative to branch root, or paths matching glob:pattern or re:pattern."},
+    {"ignore-abspath", 'i', 1, "Ignore repository path, or paths matching glob:pattern or re:pattern."},
+    {"no-ignore-abspath", option_no_ignore_abspath, 1, "Do not ignore repository path, or paths matching glob:pattern or re:pattern."},
+    {"authors-file", 'A', 1, "Load mapping of SVN committer names to Git commit authors."},
+    {"export-rev-marks", option_export_rev_marks, 1, "Dump SVN revision marks to file."},
+    {"export-marks", option_export_marks, 1, "Dump Git marks into file."},
+    {"export-branches", option_export_branches, 1, "Dump known branches into file."},
+    {"import-rev-marks", option_import_rev_marks, 1, "Load SVN revision marks from file."},
+    {"rev-marks-format", option_rev_marks_format, 1, "Dump SVN revision marks in text or binary format."},
+    {"commit-cache-size", option_commit_cache_size, 1, "Keep at most number of megabytes, or kilobytes if followed by K, of SVN revision marks in memory."},
+    {"import-marks", option_import_marks, 1, "Load Git marks from file."},
+    {"import-marks-if-exists", option_import_marks_if_exists, 1, "Load Git marks from file, if exists."},
+    {"import-branches", option_import_branches, 1, "Load branches from file."},
+    {"checksum-cache", 'c', 1, "Use checksum cache."},
+    {"jobs", 'j', 1, "Compute blob checksums using number of threads."},
+    {"read-ahead", option_read_ahead, 1, "Read number of revisions ahead on a separate thread."},
+    {"writer-thread", option_writer_thread, 0, "Write output on a separate thread."},
+    {"blobs-only", option_blobs_only, 0, "Import only blobs into checksum cache using one git fast-import per job."},
+    {"force", option_force, 0, "Force updating modified existing branches, even if doing so would cause commits to be lost."},
+    {"quiet", option_quiet, 0, "Disable all non-fatal output."},
+    {0, 0, 0, 0}
+};
+
+// Bytes relayed from svn-fast-export to git fast-import
+// and time spent waiting for either of them.
+typedef struct
+{
+    apr_uint64_t bytes;
+    apr_interval_time_t export_wait;
+    apr_interval_time_t import_wait;
+    apr_interval_time_t elapsed;
+} relay_stats_t;
+
+static const apr_getopt_option_t *
+find_option(int opt_id)
+{
+    const apr_getopt_option_t *opt = cmdline_options;
+
+    while (opt->optch != opt_id) {
+        opt++;
+    }
+
+    return opt;
+}
+
+static svn_error_t *
+wrap_errno(const char *msg)
+{
+    return svn_error_wrap_apr(APR_FROM_OS_ERROR(errno), "%s", msg);
+}
+
+static svn_error_t *
+set_flags(int fd, int cmd, int flags)
+{
+    int get = (cmd == F_SETFD) ? F_GETFD : F_GETFL;
+    int old = fcntl(fd, get);
+
+    if (old < 0 || fcntl(fd, cmd, old | flags) < 0) {
+        return wrap_errno("Can't set file descriptor flags");
+    }
+
+    return SVN_NO_ERROR;
+}
+
+// Enlarges pipe to hold a whole output buffer of svn-fast-export,
+// so that the exporter does not stall every 64K. Fails harmlessly
+// where not supported or beyond the system limit.
+static void
+set_pipe_size(int fd)
+{
+#if defined(__linux__) && defined(F_SETPIPE_SZ)
+    fcntl(fd, F_SETPIPE_SZ, PIPE_SIZE);
+#endif
+}
+
+static svn_error_t *
+make_pipe(int fds[2])
+{
+    if (pipe(fds) < 0) {
+        return wrap_errno("Can't create pipe");
+    }
+
+    // Children get the ends they need as standard streams only.
+    SVN_ERR(set_flags(fds[0], F_SETFD, FD_CLOEXEC));
+    SVN_ERR(set_flags(fds[1], F_SETFD, FD_CLOEXEC));
+    set_pipe_size(fds[1]);
+
+    return SVN_NO_ERROR;
+}
+
+// Spawns args[0] found in PATH with standard input and output
+// redirected to in and out, unless they are -1.
+static svn_error_t *
+spawn(pid_t *pid, apr_array_header_t *args, int in, int out)
+{
+    posix_spawn_file_actions_t actions;
+    posix_spawnattr_t attr;
+    sigset_t sigdefault;
+    int err;
+
+    APR_ARRAY_PUSH(args, const char *) = NULL;
+
+    posix_spawn_file_actions_init(&actions);
+    if (in >= 0) {
+        posix_spawn_file_actions_adddup2(&actions, in, STDIN_FILENO);
+    }
+    if (out >= 0) {
+        posix_spawn_file_actions_adddup2(&actions, out, STDOUT_FILENO);
+    }
+
+    // Signals ignored by the driver must not stay ignored by children.
+    sigemptyset(&sigdefault);
+    sigaddset(&sigdefault, SIGINT);
+    sigaddset(&sigdefault, SIGPIPE);
+    posix_spawnattr_init(&attr);
+    posix_spawnattr_setsigdefault(&attr, &sigdefault);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGDEF);
+
+    err = posix_spawnp(pid, APR_ARRAY_IDX(args, 0, const char *), &actions, &attr,
+                       (char * const *)args->elts, environ);
+
+    posix_spawnattr_destroy(&attr);
+    posix_spawn_file_actions_destroy(&actions);
+    apr_array_pop(args);
+
+    if (err != 0) {
+        return svn_error_wrap_apr(APR_FROM_OS_ERROR(err), "Can't run '%s'",
+                                  APR_ARRAY_IDX(args, 0, const char *));
+    }
+
+    return SVN_NO_ERROR;
+}
+
+// Waits for child pid to exit, or any child if pid is -1, and returns
+// its exit code, which is 128 plus signal number for killed ones.
+// Sets pid to the child exited.
+static int
+wait_child(pid_t *pid)
+{
+    int status;
+
+    while ((*pid = waitpid(*pid, &status, 0)) < 0) {
+        if (errno != EINTR) {
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (WIFEXITED(status)) {
+        return WEXITSTATUS(status);
+    }
+
+    return 128 + WTERMSIG(status);
+}
+
+static svn_boolean_t
+is_ready(int fd, short events)
+{
+    struct pollfd p = {fd, events, 0};
+
+    return poll(&p, 1, 0) > 0;
+}
+
+// Waits for src to provide data or dst to be closed by its reader,
+// which sets closed. Adds time spent to waited.
+static svn_error_t *
+wait_input(svn_boolean_t *closed, int src, int dst, apr_interval_time_t *waited)
+{
+    struct pollfd p[2] = {{src, POLLIN, 0}, {dst, 0, 0}};
+    apr_time_t start = apr_time_now();
+
+    while (poll(p, 2, -1) < 0) {
+        if (errno != EINTR) {
+            return wrap_errno("Can't poll pipe");
+        }
+    }
+
+    *waited += apr_time_now() - start;
+    *closed = (p[1].revents & (POLLERR | POLLHUP)) != 0;
+
+    return SVN_NO_ERROR;
+}
+
+// Waits for dst to take data, adds time spent to waited.
+static svn_error_t *
+wait_output(int dst, apr_interval_time_t *waited)
+{
+    struct pollfd p = {dst, POLLOUT, 0};
+    apr_time_t start = apr_time_now();
+
+    while (poll(&p, 1, -1) < 0) {
+        if (errno != EINTR) {
+            return wrap_errno("Can't poll pipe");
+        }
+    }
+
+    *waited += apr_time_now() - start;
+
+    return SVN_NO_ERROR;
+}
+
+// Moves data from src to dst until src ends or dst is closed by its
+// reader, which sets closed. Time spent waiting for src to provide
+// data or for dst to take it measures which side holds the other back.
+static svn_error_t *
+relay(svn_boolean_t *closed,
+      relay_stats_t *stats,
+      int src,
+      int dst,
+      apr_pool_t *pool)
+{
+    apr_time_t start = apr_time_now();
+    char *buf = NULL;
+    apr_size_t off = 0, len = 0;
+#ifdef HAVE_SPLICE
+    svn_boolean_t use_splice = TRUE;
+#else
+    svn_boolean_t use_splice = FALSE;
+#endif
+
+    *closed = FALSE;
+
+    SVN_ERR(set_flags(src, F_SETFL, O_NONBLOCK));
+    SVN_ERR(set_flags(dst, F_SETFL, O_NONBLOCK));
+
+    while (TRUE) {
+        ssize_t n;
+
+        if (use_splice) {
+#ifdef HAVE_SPLICE
+            // Move pages between pipes without copying them.
+            n = splice(src, NULL, dst, NULL, RELAY_CHUNK, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+            if (n > 0) {
+                stats->bytes += n;
+                continue;
+            } else if (n == 0) {
+                break;
+            } else if (errno == EINVAL) {
+                use_splice = FALSE;
+                continue;
+            } else if (errno == EAGAIN) {
+                if (is_ready(src, POLLIN)) {
+                    SVN_ERR(wait_output(dst, &stats->import_wait));
+                } else {
+                    SVN_ERR(wait_input(closed, src, dst, &stats->export_wait));
+                }
+                if (*closed) {
+                    break;
+                }
+                continue;
+            }
+#endif
+        } else if (off < len) {
+            n = write(dst, buf + off, len - off);
+            if (n >= 0) {
+                off += n;
+                stats->bytes += n;
+                continue;
+            } else if (errno == EAGAIN) {
+                SVN_ERR(wait_output(dst, &stats->import_wait));
+                continue;
+            }
+        } else {
+            if (buf == NULL) {
+                buf = apr_palloc(pool, RELAY_CHUNK);
+            }
+
+            n = read(src, buf, RELAY_CHUNK);
+            if (n > 0) {
+                off = 0;
+                len = n;
+                continue;
+            } else if (n == 0) {
+                break;
+            } else if (errno == EAGAIN) {
+                SVN_ERR(wait_input(closed, src, dst, &stats->export_wait));
+                if (*closed) {
+                    break;
+                }
+                continue;
+            }
+        }
+
+        if (errno == EINTR) {
+            continue;
+        } else if (errno == EPIPE) {
+            *closed = TRUE;
+            break;
+        }
+
+        return wrap_errno("Can't relay fast-import stream");
+    }
+
+    stats->elapsed = apr_time_now() - start;
+
+    return SVN_NO_ERROR;
+}
+
+static double
+throughput(apr_uint64_t bytes, apr_interval_time_t busy)
+{
+    if (busy <= 0) {
+        busy = 1;
+    }
+
+    return (double)bytes / (1024 * 1024) / ((double)busy / APR_USEC_PER_SEC);
+}
+
+static svn_error_t *
+print_stats(const relay_stats_t *stats, apr_pool_t *pool)
+{
+    double mbytes = (double)stats->bytes / (1024 * 1024);
+
+    SVN_ERR(svn_cmdline_fprintf(stderr, pool,
+                                "svn-fast-export: %.1f MiB at %.1f MiB/s, "
+                                "waited %.1f s for git fast-import\n",
+                                mbytes,
+                                throughput(stats->bytes, stats->elapsed - stats->import_wait),
+                                (double)stats->import_wait / APR_USEC_PER_SEC));
+    SVN_ERR(svn_cmdline_fprintf(stderr, pool,
+                                "git fast-import: %.1f MiB at %.1f MiB/s, "
+                                "waited %.1f s for svn-fast-export\n",
+                                mbytes,
+                                throughput(stats->bytes, stats->elapsed - stats->export_wait),
+                                (double)stats->export_wait / APR_USEC_PER_SEC));
+
+    return SVN_NO_ERROR;
+}
+
+// Pipes svn-fast-export into git fast-import through the driver,
+// so that either side failing is noticed by the other one.
+static svn_error_t *
+import_history(int *exit_code,
+               apr_array_header_t *export_args,
+               apr_array_header_t *import_args,
+               svn_boolean_t quiet,
+               apr_pool_t *pool)
+{
+    int export_fds[2], import_fds[2];
+    pid_t export_pid, import_pid;
+    relay_stats_t stats = {0};
+    svn_boolean_t closed;
+    int export_code, import_code;
+    svn_error_t *err;
+
+    SVN_ERR(make_pipe(export_fds));
+    SVN_ERR(make_pipe(import_fds));
+
+    SVN_ERR(spawn(&import_pid, import_args, import_fds[0], -1));
+    close(import_fds[0]);
+
+    err = spawn(&export_pid, export_args, -1, export_fds[1]);
+    close(export_fds[1]);
+    if (err) {
+        // Importer stops at the end of its input without "done".
+        close(export_fds[0]);
+        close(import_fds[1]);
+        wait_child(&import_pid);
+        return err;
+    }
+
+    err = relay(&closed, &stats, export_fds[0], import_fds[1], pool);
+
+    close(export_fds[0]);
+    close(import_fds[1]);
+
+    // Exporter would notice failed importer only on its next write,
+    // which can take a while to produce.
+    if (err || closed) {
+        kill(export_pid, SIGTERM);
+    }
+
+    export_code = wait_child(&export_pid);
+    import_code = wait_child(&import_pid);
+    SVN_ERR(err);
+
+    // Exporter killed above failed because of importer.
+    if (closed && import_code != EXIT_SUCCESS) {
+        *exit_code = import_code;
+    } else {
+        *exit_code = export_code ? export_code : import_code;
+    }
+
+    if (!quiet && *exit_code == EXIT_SUCCESS) {
+        SVN_ERR(print_stats(&stats, pool));
+    }
+
+    return SVN_NO_ERROR;
+}
+
+// Opens both ends of FIFO at path without waiting for another process.
+static svn_error_t *
+open_fifo(int fds[2], const char *path)
+{
+    if (mkfifo(path, 0600) < 0) {
+        return wrap_errno("Can't create FIFO");
+    }
+
+    fds[0] = open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if (fds[0] < 0) {
+        return wrap_errno("Can't open FIFO");
+    }
+
+    fds[1] = open(path, O_WRONLY | O_CLOEXEC);
+    if (fds[1] < 0) {
+        close(fds[0]);
+        return wrap_errno("Can't open FIFO");
+    }
+
+    // Importer reads it as usual.
+    if (fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) & ~O_NONBLOCK) < 0) {
+        close(fds[0]);
+        close(fds[1]);
+        return wrap_errno("Can't set file descriptor flags");
+    }
+    set_pipe_size(fds[1]);
+
+    return SVN_NO_ERROR;
+}
+
+// Imports blobs written by svn-fast-export into one FIFO per job,
+// each read by a separate git fast-import. Write ends of FIFOs stay
+// open until the exporter exits, so that importers neither see an end
+// of input before the exporter opens FIFOs nor wait for it after
+// a failure.
+static svn_error_t *
+import_blobs(int *exit_code,
+             apr_array_header_t *export_args,
+             apr_array_header_t *import_args,
+             int jobs,
+             apr_pool_t *pool)
+{
+    const char *tmp_dir, *prefix;
+    char *dir;
+    apr_array_header_t *fds = apr_array_make(pool, jobs, sizeof(int));
+    apr_array_header_t *pids = apr_array_make(pool, jobs, sizeof(pid_t));
+    pid_t export_pid;
+    int export_code = EXIT_SUCCESS, import_code = EXIT_SUCCESS;
+    svn_boolean_t killed = FALSE;
+    svn_error_t *err = SVN_NO_ERROR;
+
+    SVN_ERR(svn_io_temp_dir(&tmp_dir, pool));
+    dir = apr_pstrcat(pool, svn_dirent_local_style(tmp_dir, pool),
+                      "/git-svn-fast-import.XXXXXX", NULL);
+    if (mkdtemp(dir) == NULL) {
+        return wrap_errno("Can't create temporary directory");
+    }
+    prefix = apr_pstrcat(pool, dir, "/chan", NULL);
+
+    for (int i = 0; i < jobs && !err; i++) {
+        const char *path = apr_psprintf(pool, "%s.%d", prefix, i);
+        int fifo[2];
+        pid_t pid;
+
+        err = open_fifo(fifo, path);
+        if (!err) {
+            err = spawn(&pid, import_args, fifo[0], -1);
+            close(fifo[0]);
+            APR_ARRAY_PUSH(fds, int) = fifo[1];
+        }
+        if (!err) {
+            APR_ARRAY_PUSH(pids, pid_t) = pid;
+        }
+    }
+
+    if (!err) {
+        APR_ARRAY_PUSH(export_args, const char *) = "--blobs-only";
+        APR_ARRAY_PUSH(export_args, const char *) = prefix;
+        err = spawn(&export_pid, export_args, -1, -1);
+    }
+
+    // Exporter opening FIFO of a failed importer would wait forever,
+    // so importers exiting early are reaped along the way.
+    while (!err) {
+        pid_t pid = -1;
+        int code = wait_child(&pid);
+
+        if (pid == export_pid || pid < 0) {
+            export_code = code;
+            break;
+        }
+
+        for (int i = 0; i < pids->nelts; i++) {
+            if (APR_ARRAY_IDX(pids, i, pid_t) == pid) {
+                APR_ARRAY_IDX(pids, i, pid_t) = 0;
+            }
+        }
+
+        if (code != EXIT_SUCCESS && !killed) {
+            import_code = code;
+            killed = TRUE;
+            kill(export_pid, SIGTERM);
+        }
+    }
+
+    for (int i = 0; i < fds->nelts; i++) {
+        close(APR_ARRAY_IDX(fds, i, int));
+    }
+    for (int i = 0; i < jobs; i++) {
+        unlink(apr_psprintf(pool, "%s.%d", prefix, i));
+    }
+    rmdir(dir);
+
+    for (int i = 0; i < pids->nelts; i++) {
+        pid_t pid = APR_ARRAY_IDX(pids, i, pid_t);
+        int code;
+
+        if (pid == 0) {
+            continue;
+        }
+
+        code = wait_child(&pid);
+        if (code != EXIT_SUCCESS && import_code == EXIT_SUCCESS) {
+            import_code = code;
+        }
+    }
+    SVN_ERR(err);
+
+    // Exporter killed above failed because of importer.
+    if (killed) {
+        *exit_code = import_code;
+    } else {
+        *exit_code = export_code ? export_code : import_code;
+    }
+
+    return SVN_NO_ERROR;
+}
+
+static svn_error_t *
+do_main(int *exit_code, int argc, const char **argv, apr_pool_t *pool)
+{
+    apr_getopt_t *opt_parser;
+    apr_status_t apr_err;
+    apr_array_header_t *export_args = apr_array_make(pool, argc + 2, sizeof(const char *));
+    apr_array_header_t *import_args = apr_array_make(pool, 8, sizeof(const char *));
+    svn_boolean_t blobs_only = FALSE, quiet = FALSE;
+    const char *checksum_cache_path = NULL;
+    int jobs = 1;
+    svn_error_t *err;
+
+    APR_ARRAY_PUSH(export_args, const char *) = "svn-fast-export";
+    APR_ARRAY_PUSH(import_args, const char *) = "git";
+    APR_ARRAY_PUSH(import_args, const char *) = "fast-import";
+    APR_ARRAY_PUSH(import_args, const char *) = "--done";
+
+    // Parse options.
+    apr_err = apr_getopt_init(&opt_parser, pool, argc, argv);
+    if (apr_err != APR_SUCCESS) {
+        return svn_error_wrap_apr(apr_err, NULL);
+    }
+
+    while (TRUE) {
+        const apr_getopt_option_t *opt;
+        int opt_id;
+        const char *opt_arg;
+
+        // Parse the next option.
+        apr_err = apr_getopt_long(opt_parser, cmdline_options, &opt_id, &opt_arg);
+        if (APR_STATUS_IS_EOF(apr_err)) {
+            break;
+        } else if (apr_err) {
+            return svn_error_wrap_apr(apr_err, NULL);
+        }
+
+        opt = find_option(opt_id);
+
+        switch (opt_id) {
+        case 'h':
+            print_usage("git-svn-fast-import [OPTIONS] REPO", cmdline_options, pool);
+            *exit_code = EXIT_FAILURE;
+            return SVN_NO_ERROR;
+        case option_blobs_only:
+            blobs_only = TRUE;
+            break;
+        case option_quiet:
+            quiet = TRUE;
+            // Fall through.
+        case option_force:
+            APR_ARRAY_PUSH(import_args, const char *) = apr_psprintf(pool, "--%s", opt->name);
+            break;
+        case option_export_marks:
+        case option_import_marks:
+        case option_import_marks_if_exists:
+            APR_ARRAY_PUSH(import_args, const char *) = apr_psprintf(pool, "--%s=%s", opt->name, opt_arg);
+            break;
+        case 'c':
+            checksum_cache_path = opt_arg;
+            APR_ARRAY_PUSH(export_args, const char *) = "--pending-journal";
+            APR_ARRAY_PUSH(export_args, const char *) = apr_psprintf(pool, "--%s", opt->name);
+            APR_ARRAY_PUSH(export_args, const char *) = opt_arg;
+            break;
+        case 'j':
+            {
+                char *end = NULL;
+                jobs = strtol(opt_arg, &end, 10);
+                if (jobs < 1 || !end || *end) {
+                    return svn_error_create(SVN_ERR_CL_ARG_PARSING_ERROR, NULL,
+                                            "Invalid number of jobs supplied");
+                }
+            }
+            // Fall through.
+        default:
+            APR_ARRAY_PUSH(export_args, const char *) = apr_psprintf(pool, "--%s", opt->name);
+            if (opt->has_arg) {
+                APR_ARRAY_PUSH(export_args, const char *) = opt_arg;
+            }
+            break;
+        }
+    }
+
+    while (opt_parser->ind < opt_parser->argc) {
+        APR_ARRAY_PUSH(export_args, const char *) = opt_parser->argv[opt_parser->ind++];
+    }
+
+    if (blobs_only) {
+        err = import_blobs(exit_code, export_args, import_args, jobs, pool);
+    } else {
+        err = import_history(exit_code, export_args, import_args, quiet, pool);
+    }
+
+    // Checksums are journaled only once git fast-import stores their blobs.
+    if (checksum_cache_path != NULL) {
+        if (err == SVN_NO_ERROR && *exit_code == EXIT_SUCCESS) {
+            err = checksum_cache_commit_pending(checksum_cache_path, pool);
+        } else {
+            err = svn_error_compose_create(err, checksum_cache_discard_pending(checksum_cache_path, pool));
+        }
+    }
+
+    return err;
+}
+
+int
+main(int argc, const char **argv)
+{
+    apr_pool_t *pool;
+    svn_error_t *err;
+    int exit_code = EXIT_SUCCESS;
+
+    // Initialize the app.
+    if (svn_cmdline_init("git-svn-fast-import", stderr) != EXIT_SUCCESS) {
+        return EXIT_FAILURE;
+    }
+
+    // Children handle interrupts on their own, so that the driver
+    // collects their exit codes. Closed pipes are reported as errors.
+    apr_signal(SIGINT, SIG_IGN);
+    apr_signal(SIGPIPE, SIG_IGN);
+
+    // Create top-level pool. Use a separate mutexless allocator,
+    // as this app is single-threaded.
+    pool = apr_allocator_owner_get(svn_pool_create_allocator(FALSE));
+
+    err = do_main(&exit_code, argc, argv, pool);
+    if (err) {
+        exit_code = EXIT_FAILURE;
+        svn_cmdline_handle_exit_error(err, NULL, "git-svn-fast-import: ");
+    }
+
+    svn_pool_destroy(pool);
+
+    return exit_code;
+}
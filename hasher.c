@@ -0,0 +1,322 @@
+/* Copyright (C) 2015 by Maxim Bublis <b@codemonkey.ru>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "hasher.h"
+#include "node.h"
+#include "sha1.h"
+#include <apr_atomic.h>
+#include <apr_strings.h>
+#include <apr_thread_cond.h>
+#include <apr_thread_mutex.h>
+#include <apr_thread_proc.h>
+#include <svn_pools.h>
+#include <svn_repos.h>
+
+// Size of a buffer used to read file contents.
+#define HASHER_BUFFER_SIZE (64 * 1024)
+
+typedef struct
+{
+    hasher_t *hasher;
+    // Pool of a thread, uses its own allocator.
+    apr_pool_t *pool;
+    // Pool of results, cleared on every run.
+    apr_pool_t *result_pool;
+    // Pool of revision root, cleared on revision change.
+    apr_pool_t *root_pool;
+    svn_fs_t *fs;
+    svn_fs_root_t *root;
+    char *buf;
+    // Stream to write blobs into, if any.
+    svn_stream_t *output;
+    apr_thread_t *thread;
+    // Set while the thread takes part in the current run.
+    svn_boolean_t busy;
+    svn_error_t *err;
+} worker_t;
+
+struct hasher_t
+{
+    worker_t *workers;
+    int nworkers;
+    // Threads wait on cond for a run or for exit, hasher_run()
+    // waits on it for busy threads to finish.
+    apr_thread_mutex_t *mutex;
+    apr_thread_cond_t *cond;
+    int nbusy;
+    svn_boolean_t exiting;
+    // Jobs of the current run.
+    apr_array_header_t *jobs;
+    svn_boolean_t keep_content;
+    // Index of the next job to take.
+    volatile apr_uint32_t next;
+};
+
+static svn_error_t *
+hash_blob(worker_t *w, blob_job_t *job, apr_pool_t *pool)
+{
+    char hdr[64];
+    apr_size_t hdr_len;
+    sha1_ctx_t ctx;
+    svn_filesize_t size;
+    svn_stream_t *content;
+
+    if (w->root == NULL || svn_fs_revision_root_revision(w->root) != job->revnum) {
+        svn_pool_clear(w->root_pool);
+        SVN_ERR(svn_fs_revision_root(&w->root, w->fs, job->revnum, w->root_pool));
+    }
+
+    SVN_ERR(open_blob_contents(&content, &size, w->root, job->path, pool));
+
+    hdr_len = apr_snprintf(hdr, sizeof(hdr), "blob %" SVN_FILESIZE_T_FMT, size);
+    sha1_ctx_init(&ctx);
+    sha1_ctx_update(&ctx, hdr, hdr_len + 1);
+
+    if (w->output != NULL) {
+        hdr_len = apr_snprintf(hdr, sizeof(hdr), "blob\ndata %" SVN_FILESIZE_T_FMT "\n", size);
+        SVN_ERR(svn_stream_write(w->output, hdr, &hdr_len));
+    }
+
+    if (w->hasher->keep_content) {
+        svn_stringbuf_t *buf = svn_stringbuf_create_ensure(size, w->result_pool);
+        apr_size_t len = size;
+
+        SVN_ERR(svn_stream_read_full(content, buf->data, &len));
+        buf->len = len;
+        buf->data[len] = '\0';
+        sha1_ctx_update(&ctx, buf->data, buf->len);
+
+        job->content = buf;
+    } else {
+        while (TRUE) {
+            apr_size_t len = HASHER_BUFFER_SIZE;
+
+            SVN_ERR(svn_stream_read_full(content, w->buf, &len));
+            sha1_ctx_update(&ctx, w->buf, len);
+
+            if (w->output != NULL) {
+                apr_size_t wlen = len;
+                SVN_ERR(svn_stream_write(w->output, w->buf, &wlen));
+            }
+
+            if (len < HASHER_BUFFER_SIZE) {
+                break;
+            }
+        }
+    }
+
+    SVN_ERR(svn_stream_close(content));
+    job->checksum = sha1_ctx_final(&ctx, w->result_pool);
+
+    if (w->output != NULL) {
+        apr_size_t len = 1;
+        SVN_ERR(svn_stream_write(w->output, "\n", &len));
+    }
+
+    return SVN_NO_ERROR;
+}
+
+static void * APR_THREAD_FUNC
+worker_main(apr_thread_t *thread, void *data)
+{
+    worker_t *w = data;
+    hasher_t *h = w->hasher;
+    apr_pool_t *iterpool = svn_pool_create(w->pool);
+
+    apr_thread_mutex_lock(h->mutex);
+    while (TRUE) {
+        while (!w->busy && !h->exiting) {
+            apr_thread_cond_wait(h->cond, h->mutex);
+        }
+        if (!w->busy) {
+            break;
+        }
+        apr_thread_mutex_unlock(h->mutex);
+
+        while (w->err == SVN_NO_ERROR) {
+            apr_uint32_t i = apr_atomic_inc32(&h->next);
+            if (i >= (apr_uint32_t)h->jobs->nelts) {
+                break;
+            }
+
+            svn_pool_clear(iterpool);
+            w->err = hash_blob(w, APR_ARRAY_IDX(h->jobs, i, blob_job_t *), iterpool);
+        }
+
+        apr_thread_mutex_lock(h->mutex);
+        w->busy = FALSE;
+        if (--h->nbusy == 0) {
+            apr_thread_cond_broadcast(h->cond);
+        }
+    }
+    apr_thread_mutex_unlock(h->mutex);
+
+    svn_pool_destroy(iterpool);
+    apr_thread_exit(thread, APR_SUCCESS);
+
+    return NULL;
+}
+
+// Stops threads and destroys their pools.
+static apr_status_t
+hasher_cleanup(void *data)
+{
+    hasher_t *h = data;
+
+    apr_thread_mutex_lock(h->mutex);
+    h->exiting = TRUE;
+    apr_thread_cond_broadcast(h->cond);
+    apr_thread_mutex_unlock(h->mutex);
+
+    for (int i = 0; i < h->nworkers; i++) {
+        worker_t *w = &h->workers[i];
+        apr_status_t retval;
+
+        if (w->thread != NULL) {
+            apr_thread_join(&retval, w->thread);
+        }
+        if (w->pool != NULL) {
+            svn_pool_destroy(w->pool);
+        }
+    }
+
+    return APR_SUCCESS;
+}
+
+svn_error_t *
+hasher_create(hasher_t **h,
+              const char *repo_path,
+              int nworkers,
+              apr_pool_t *pool)
+{
+#if APR_HAS_THREADS
+    hasher_t *hasher = apr_pcalloc(pool, sizeof(hasher_t));
+    hasher->nworkers = nworkers;
+    hasher->workers = apr_pcalloc(pool, nworkers * sizeof(worker_t));
+
+    apr_status_t apr_err = apr_atomic_init(pool);
+    if (!apr_err) {
+        apr_err = apr_thread_mutex_create(&hasher->mutex, APR_THREAD_MUTEX_DEFAULT, pool);
+    }
+    if (!apr_err) {
+        apr_err = apr_thread_cond_create(&hasher->cond, pool);
+    }
+    if (apr_err != APR_SUCCESS) {
+        return svn_error_wrap_apr(apr_err, NULL);
+    }
+
+    // Registered after the mutex and condition, so that it runs
+    // before they are destroyed.
+    apr_pool_cleanup_register(pool, hasher, hasher_cleanup, apr_pool_cleanup_null);
+
+    for (int i = 0; i < nworkers; i++) {
+        worker_t *w = &hasher->workers[i];
+        svn_repos_t *repo;
+
+        // Every thread gets a separate mutexless allocator,
+        // so that threads never share a pool.
+        w->hasher = hasher;
+        w->pool = apr_allocator_owner_get(svn_pool_create_allocator(FALSE));
+
+        w->result_pool = svn_pool_create(w->pool);
+        w->root_pool = svn_pool_create(w->pool);
+        w->buf = apr_palloc(w->pool, HASHER_BUFFER_SIZE);
+
+        SVN_ERR(svn_repos_open3(&repo, repo_path, NULL, w->pool, w->pool));
+        w->fs = svn_repos_fs(repo);
+
+        // Threads live as long as the hasher and wait for runs.
+        apr_err = apr_thread_create(&w->thread, NULL, worker_main, w, w->pool);
+        if (apr_err != APR_SUCCESS) {
+            return svn_error_wrap_apr(apr_err, "Can't create thread");
+        }
+    }
+
+    *h = hasher;
+
+    return SVN_NO_ERROR;
+#else
+    return svn_error_create(SVN_ERR_UNSUPPORTED_FEATURE, NULL,
+                            "Threads are not supported");
+#endif
+}
+
+void
+hasher_set_outputs(hasher_t *h, apr_array_header_t *outputs)
+{
+    for (int i = 0; i < h->nworkers; i++) {
+        worker_t *w = &h->workers[i];
+        w->output = outputs ? APR_ARRAY_IDX(outputs, i, svn_stream_t *) : NULL;
+    }
+}
+
+svn_error_t *
+hasher_run(hasher_t *h,
+           apr_array_header_t *jobs,
+           svn_boolean_t keep_content,
+           apr_pool_t *pool)
+{
+    svn_error_t *err = SVN_NO_ERROR;
+    int nbusy = h->nworkers;
+
+    if (jobs->nelts == 0) {
+        return SVN_NO_ERROR;
+    }
+
+    SVN_ERR_ASSERT(!keep_content || h->workers[0].output == NULL);
+
+    h->jobs = jobs;
+    h->keep_content = keep_content;
+    apr_atomic_set32(&h->next, 0);
+
+    // Threads beyond the number of jobs would have nothing to take.
+    if (nbusy > jobs->nelts) {
+        nbusy = jobs->nelts;
+    }
+
+    for (int i = 0; i < h->nworkers; i++) {
+        svn_pool_clear(h->workers[i].result_pool);
+    }
+
+    apr_thread_mutex_lock(h->mutex);
+    for (int i = 0; i < nbusy; i++) {
+        h->workers[i].busy = TRUE;
+    }
+    h->nbusy = nbusy;
+    apr_thread_cond_broadcast(h->cond);
+
+    while (h->nbusy > 0) {
+        apr_thread_cond_wait(h->cond, h->mutex);
+    }
+    apr_thread_mutex_unlock(h->mutex);
+
+    for (int i = 0; i < nbusy; i++) {
+        worker_t *w = &h->workers[i];
+
+        err = svn_error_compose_create(err, w->err);
+        w->err = SVN_NO_ERROR;
+    }
+
+    h->jobs = NULL;
+
+    return err;
+}
@@ -0,0 +1,69 @@
+/* Copyright (C) 2015 by Maxim Bublis <b@codemonkey.ru>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef GIT_SVN_FAST_IMPORT_HASHER_H_
+#define GIT_SVN_FAST_IMPORT_HASHER_H_
+
+#include <svn_checksum.h>
+#include <svn_fs.h>
+
+// Abstract type for a pool of threads computing Git blob checksums.
+typedef struct hasher_t hasher_t;
+
+typedef struct
+{
+    // File to compute Git blob checksum of.
+    svn_revnum_t revnum;
+    const char *path;
+    // Subversion checksum of the file.
+    svn_checksum_t *svn_checksum;
+    // Git blob checksum and blob content if requested,
+    // both valid until the next hasher_run().
+    svn_checksum_t *checksum;
+    svn_stringbuf_t *content;
+} blob_job_t;
+
+// Creates a pool of nworkers threads waiting for hasher_run() until
+// pool is cleared. Every thread opens repository at repo_path on its own,
+// as FS objects must not be shared between threads.
+svn_error_t *
+hasher_create(hasher_t **h,
+              const char *repo_path,
+              int nworkers,
+              apr_pool_t *pool);
+
+// Makes every thread write blobs it hashes into its own stream
+// from array of nworkers svn_stream_t pointers as fast-import blob
+// commands without marks. Pass NULL to stop writing blobs.
+void
+hasher_set_outputs(hasher_t *h, apr_array_header_t *outputs);
+
+// Computes checksums for array of blob_job_t pointers in parallel
+// and waits for all of them. Keeps blob contents in memory
+// if keep_content is set.
+svn_error_t *
+hasher_run(hasher_t *h,
+           apr_array_header_t *jobs,
+           svn_boolean_t keep_content,
+           apr_pool_t *pool);
+
+#endif // GIT_SVN_FAST_IMPORT_HASHER_H_
@@ -0,0 +1,170 @@
+/* Copyright (C) 2014 by Maxim Bublis <b@codemonkey.ru>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "hex.h"
+#include <apr_sha1.h>
+#include <stdlib.h>
+#include <svn_checksum.h>
+#include <svn_cmdline.h>
+#include <svn_pools.h>
+
+// Distinct lines converted over and over. Lines are kept in memory,
+// reading a cache file is not measured.
+#define BENCH_LINES 4096
+#define BENCH_LINE_LEN (2 * 2 * APR_SHA1_DIGESTSIZE + 2)
+#define BENCH_DEFAULT_LINES 50000000
+
+// Number of digests converted, so that the compiler keeps conversions.
+static apr_uint64_t sink;
+
+// Parses and formats lines of a text checksum cache like it was done
+// with svn_checksum functions.
+static svn_error_t *
+bench_svn_checksum(const char *lines, apr_uint64_t nlines, apr_pool_t *pool)
+{
+    apr_pool_t *iterpool = svn_pool_create(pool);
+
+    for (apr_uint64_t i = 0; i < nlines; i++) {
+        const char *line = lines + (i % BENCH_LINES) * BENCH_LINE_LEN;
+        svn_checksum_t *svn_checksum, *git_checksum;
+
+        if (i % BENCH_LINES == 0) {
+            svn_pool_clear(iterpool);
+        }
+
+        SVN_ERR(svn_checksum_parse_hex(&svn_checksum, svn_checksum_sha1, line, iterpool));
+        SVN_ERR(svn_checksum_parse_hex(&git_checksum, svn_checksum_sha1,
+                                       line + 2 * APR_SHA1_DIGESTSIZE + 1, iterpool));
+        sink += svn_checksum_to_cstring_display(svn_checksum, iterpool)[0];
+        sink += svn_checksum_to_cstring_display(git_checksum, iterpool)[0];
+    }
+
+    svn_pool_destroy(iterpool);
+
+    return SVN_NO_ERROR;
+}
+
+// Parses and formats lines of a text checksum cache with hex codec.
+static svn_error_t *
+bench_hex(const char *lines, apr_uint64_t nlines)
+{
+    unsigned char digests[2 * APR_SHA1_DIGESTSIZE];
+    char line[BENCH_LINE_LEN];
+
+    for (apr_uint64_t i = 0; i < nlines; i++) {
+        const char *src = lines + (i % BENCH_LINES) * BENCH_LINE_LEN;
+
+        if (!hex_decode(digests, src, APR_SHA1_DIGESTSIZE) ||
+            !hex_decode(digests + APR_SHA1_DIGESTSIZE,
+                        src + 2 * APR_SHA1_DIGESTSIZE + 1, APR_SHA1_DIGESTSIZE)) {
+            return svn_error_createf(SVN_ERR_MALFORMED_FILE, NULL,
+                                     "line %" APR_UINT64_T_FMT, i);
+        }
+        hex_encode(line, digests, APR_SHA1_DIGESTSIZE);
+        hex_encode(line + 2 * APR_SHA1_DIGESTSIZE + 1, digests + APR_SHA1_DIGESTSIZE,
+                   APR_SHA1_DIGESTSIZE);
+        sink += line[0];
+    }
+
+    return SVN_NO_ERROR;
+}
+
+static svn_error_t *
+do_main(int argc, const char **argv, apr_pool_t *pool)
+{
+    apr_uint64_t nlines = BENCH_DEFAULT_LINES;
+    char *lines = apr_palloc(pool, BENCH_LINES * BENCH_LINE_LEN);
+    apr_time_t start, svn_time, portable_time, hex_time;
+
+    if (argc > 1) {
+        nlines = apr_atoi64(argv[1]);
+    }
+
+    srand(1);
+    for (int i = 0; i < BENCH_LINES; i++) {
+        unsigned char digests[2 * APR_SHA1_DIGESTSIZE];
+        char *line = lines + i * BENCH_LINE_LEN;
+
+        for (apr_size_t j = 0; j < sizeof(digests); j++) {
+            digests[j] = (unsigned char)rand();
+        }
+
+        hex_encode(line, digests, APR_SHA1_DIGESTSIZE);
+        line[2 * APR_SHA1_DIGESTSIZE] = ' ';
+        hex_encode(line + 2 * APR_SHA1_DIGESTSIZE + 1, digests + APR_SHA1_DIGESTSIZE,
+                   APR_SHA1_DIGESTSIZE);
+        line[BENCH_LINE_LEN - 1] = '\n';
+    }
+
+    start = apr_time_now();
+    SVN_ERR(bench_svn_checksum(lines, nlines, pool));
+    svn_time = apr_time_now() - start;
+
+    // Time the portable codec separately, so that the gain of SIMD codecs
+    // is not mixed with the cost of svn_checksum allocations.
+    SVN_ERR_ASSERT(hex_select_codec("portable"));
+
+    start = apr_time_now();
+    SVN_ERR(bench_hex(lines, nlines));
+    portable_time = apr_time_now() - start;
+
+    hex_initialize();
+
+    start = apr_time_now();
+    SVN_ERR(bench_hex(lines, nlines));
+    hex_time = apr_time_now() - start;
+
+    SVN_ERR(svn_cmdline_printf(pool, "%" APR_UINT64_T_FMT " checksum cache lines converted in memory\n", nlines));
+    SVN_ERR(svn_cmdline_printf(pool, "svn_checksum: %.3fs\n",
+                               (double)svn_time / APR_USEC_PER_SEC));
+    SVN_ERR(svn_cmdline_printf(pool, "hex (portable): %.3fs\n",
+                               (double)portable_time / APR_USEC_PER_SEC));
+    SVN_ERR(svn_cmdline_printf(pool, "hex (%s): %.3fs, %.2fx portable\n", hex_codec_name(),
+                               (double)hex_time / APR_USEC_PER_SEC,
+                               hex_time > 0 ? (double)portable_time / hex_time : 0.0));
+
+    return SVN_NO_ERROR;
+}
+
+int
+main(int argc, const char **argv)
+{
+    apr_pool_t *pool;
+    svn_error_t *err;
+    int exit_code = EXIT_SUCCESS;
+
+    if (svn_cmdline_init("hex-bench", stderr) != EXIT_SUCCESS) {
+        return EXIT_FAILURE;
+    }
+
+    pool = apr_allocator_owner_get(svn_pool_create_allocator(FALSE));
+
+    err = do_main(argc, argv, pool);
+    if (err) {
+        exit_code = EXIT_FAILURE;
+        svn_cmdline_handle_exit_error(err, NULL, "hex-bench: ");
+    }
+
+    svn_pool_destroy(pool);
+
+    return exit_code;
+}
@@ -0,0 +1,376 @@
+/* Copyright (C) 2014 by Maxim Bublis <b@codemonkey.ru>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "hex.h"
+#include <string.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define HEX_X86_SIMD 1
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+typedef void (*hex_encode_func_t)(char *dst,
+                                  const unsigned char *src,
+                                  apr_size_t len);
+
+typedef svn_boolean_t (*hex_decode_func_t)(unsigned char *dst,
+                                           const char *src,
+                                           apr_size_t len);
+
+typedef struct
+{
+    const char *name;
+    hex_encode_func_t encode;
+    hex_decode_func_t decode;
+    // Returns TRUE if the implementation is supported by the CPU.
+    svn_boolean_t (*supported)(void);
+} hex_impl_t;
+
+static const char hex_digits[] = "0123456789abcdef";
+
+// Returns value of hex digit c, 0xff if c is not one.
+static inline unsigned char
+hex_value(char c)
+{
+    unsigned char lc = (unsigned char)c | 0x20;
+
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+
+    if (lc >= 'a' && lc <= 'f') {
+        return lc - 'a' + 10;
+    }
+
+    return 0xff;
+}
+
+static void
+hex_encode_portable(char *dst, const unsigned char *src, apr_size_t len)
+{
+    for (apr_size_t i = 0; i < len; i++) {
+        dst[2 * i] = hex_digits[src[i] >> 4];
+        dst[2 * i + 1] = hex_digits[src[i] & 0x0f];
+    }
+}
+
+static svn_boolean_t
+hex_decode_portable(unsigned char *dst, const char *src, apr_size_t len)
+{
+    for (apr_size_t i = 0; i < len; i++) {
+        unsigned char hi = hex_value(src[2 * i]);
+        unsigned char lo = hex_value(src[2 * i + 1]);
+
+        if ((hi | lo) == 0xff) {
+            return FALSE;
+        }
+
+        dst[i] = (unsigned char)(hi << 4 | lo);
+    }
+
+    return TRUE;
+}
+
+static svn_boolean_t
+hex_portable_supported(void)
+{
+    return TRUE;
+}
+
+#ifdef HEX_X86_SIMD
+
+// Encodes 16 bytes into 32 digits.
+__attribute__((target("ssse3")))
+static inline void
+encode16_ssse3(char *dst, const unsigned char *src)
+{
+    const __m128i table = _mm_loadu_si128((const __m128i *)hex_digits);
+    const __m128i mask = _mm_set1_epi8(0x0f);
+    __m128i x = _mm_loadu_si128((const __m128i *)src);
+    __m128i hi = _mm_shuffle_epi8(table, _mm_and_si128(_mm_srli_epi16(x, 4), mask));
+    __m128i lo = _mm_shuffle_epi8(table, _mm_and_si128(x, mask));
+
+    _mm_storeu_si128((__m128i *)dst, _mm_unpacklo_epi8(hi, lo));
+    _mm_storeu_si128((__m128i *)(dst + 16), _mm_unpackhi_epi8(hi, lo));
+}
+
+// Converts 16 digits into their values, setting bits of invalid
+// ones in invalid.
+__attribute__((target("ssse3")))
+static inline __m128i
+values16_ssse3(__m128i c, __m128i *invalid)
+{
+    __m128i lc = _mm_or_si128(c, _mm_set1_epi8(0x20));
+    __m128i is_digit = _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8('0' - 1)),
+                                     _mm_cmpgt_epi8(_mm_set1_epi8('9' + 1), c));
+    __m128i is_alpha = _mm_and_si128(_mm_cmpgt_epi8(lc, _mm_set1_epi8('a' - 1)),
+                                     _mm_cmpgt_epi8(_mm_set1_epi8('f' + 1), lc));
+    __m128i digit = _mm_and_si128(_mm_sub_epi8(c, _mm_set1_epi8('0')), is_digit);
+    __m128i alpha = _mm_and_si128(_mm_sub_epi8(lc, _mm_set1_epi8('a' - 10)), is_alpha);
+
+    *invalid = _mm_or_si128(*invalid, _mm_cmpeq_epi8(_mm_or_si128(is_digit, is_alpha),
+                                                     _mm_setzero_si128()));
+
+    return _mm_or_si128(digit, alpha);
+}
+
+__attribute__((target("ssse3")))
+static void
+hex_encode_ssse3(char *dst, const unsigned char *src, apr_size_t len)
+{
+    apr_size_t i = 0;
+
+    for (; i + 16 <= len; i += 16) {
+        encode16_ssse3(dst + 2 * i, src + i);
+    }
+
+    hex_encode_portable(dst + 2 * i, src + i, len - i);
+}
+
+__attribute__((target("ssse3")))
+static svn_boolean_t
+hex_decode_ssse3(unsigned char *dst, const char *src, apr_size_t len)
+{
+    // Weights of high and low digits of every byte.
+    const __m128i weights = _mm_set1_epi16(0x0110);
+    __m128i invalid = _mm_setzero_si128();
+    apr_size_t i = 0;
+
+    for (; i + 16 <= len; i += 16) {
+        __m128i v0 = values16_ssse3(_mm_loadu_si128((const __m128i *)(src + 2 * i)), &invalid);
+        __m128i v1 = values16_ssse3(_mm_loadu_si128((const __m128i *)(src + 2 * i + 16)), &invalid);
+        __m128i bytes = _mm_packus_epi16(_mm_maddubs_epi16(v0, weights),
+                                         _mm_maddubs_epi16(v1, weights));
+
+        _mm_storeu_si128((__m128i *)(dst + i), bytes);
+    }
+
+    if (_mm_movemask_epi8(invalid) != 0) {
+        return FALSE;
+    }
+
+    return hex_decode_portable(dst + i, src + 2 * i, len - i);
+}
+
+__attribute__((target("avx2")))
+static void
+hex_encode_avx2(char *dst, const unsigned char *src, apr_size_t len)
+{
+    const __m256i table = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)hex_digits));
+    const __m256i mask = _mm256_set1_epi8(0x0f);
+    apr_size_t i = 0;
+
+    for (; i + 32 <= len; i += 32) {
+        __m256i x = _mm256_loadu_si256((const __m256i *)(src + i));
+        __m256i hi = _mm256_shuffle_epi8(table, _mm256_and_si256(_mm256_srli_epi16(x, 4), mask));
+        __m256i lo = _mm256_shuffle_epi8(table, _mm256_and_si256(x, mask));
+        // Interleaving works within 128-bit lanes, put lanes back in order.
+        __m256i a = _mm256_unpacklo_epi8(hi, lo);
+        __m256i b = _mm256_unpackhi_epi8(hi, lo);
+
+        _mm256_storeu_si256((__m256i *)(dst + 2 * i), _mm256_permute2x128_si256(a, b, 0x20));
+        _mm256_storeu_si256((__m256i *)(dst + 2 * i + 32), _mm256_permute2x128_si256(a, b, 0x31));
+    }
+
+    hex_encode_ssse3(dst + 2 * i, src + i, len - i);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i
+values32_avx2(__m256i c, __m256i *invalid)
+{
+    __m256i lc = _mm256_or_si256(c, _mm256_set1_epi8(0x20));
+    __m256i is_digit = _mm256_and_si256(_mm256_cmpgt_epi8(c, _mm256_set1_epi8('0' - 1)),
+                                        _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), c));
+    __m256i is_alpha = _mm256_and_si256(_mm256_cmpgt_epi8(lc, _mm256_set1_epi8('a' - 1)),
+                                        _mm256_cmpgt_epi8(_mm256_set1_epi8('f' + 1), lc));
+    __m256i digit = _mm256_and_si256(_mm256_sub_epi8(c, _mm256_set1_epi8('0')), is_digit);
+    __m256i alpha = _mm256_and_si256(_mm256_sub_epi8(lc, _mm256_set1_epi8('a' - 10)), is_alpha);
+
+    *invalid = _mm256_or_si256(*invalid, _mm256_cmpeq_epi8(_mm256_or_si256(is_digit, is_alpha),
+                                                           _mm256_setzero_si256()));
+
+    return _mm256_or_si256(digit, alpha);
+}
+
+__attribute__((target("avx2")))
+static svn_boolean_t
+hex_decode_avx2(unsigned char *dst, const char *src, apr_size_t len)
+{
+    const __m256i weights = _mm256_set1_epi16(0x0110);
+    __m256i invalid = _mm256_setzero_si256();
+    apr_size_t i = 0;
+
+    for (; i + 32 <= len; i += 32) {
+        __m256i v0 = values32_avx2(_mm256_loadu_si256((const __m256i *)(src + 2 * i)), &invalid);
+        __m256i v1 = values32_avx2(_mm256_loadu_si256((const __m256i *)(src + 2 * i + 32)), &invalid);
+        __m256i bytes = _mm256_packus_epi16(_mm256_maddubs_epi16(v0, weights),
+                                            _mm256_maddubs_epi16(v1, weights));
+
+        // Packing works within 128-bit lanes, put quadwords back in order.
+        _mm256_storeu_si256((__m256i *)(dst + i), _mm256_permute4x64_epi64(bytes, 0xd8));
+    }
+
+    if (_mm256_movemask_epi8(invalid) != 0) {
+        return FALSE;
+    }
+
+    return hex_decode_ssse3(dst + i, src + 2 * i, len - i);
+}
+
+static svn_boolean_t
+hex_ssse3_supported(void)
+{
+    unsigned int eax, ebx, ecx, edx;
+
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+        return FALSE;
+    }
+
+    return (ecx & (1 << 9)) != 0;
+}
+
+static svn_boolean_t
+hex_avx2_supported(void)
+{
+    unsigned int eax, ebx, ecx, edx;
+
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+        return FALSE;
+    }
+
+    // SSSE3, OSXSAVE and AVX.
+    if (!(ecx & (1 << 9)) || !(ecx & (1 << 27)) || !(ecx & (1 << 28))) {
+        return FALSE;
+    }
+
+    // Operating system saves XMM and YMM registers.
+    __asm__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    if ((eax & 0x6) != 0x6) {
+        return FALSE;
+    }
+
+    if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) {
+        return FALSE;
+    }
+
+    return (ebx & (1 << 5)) != 0;
+}
+
+#endif // HEX_X86_SIMD
+
+// Implementations in order of preference.
+static const hex_impl_t hex_impls[] = {
+#ifdef HEX_X86_SIMD
+    {"x86-avx2", hex_encode_avx2, hex_decode_avx2, hex_avx2_supported},
+    {"x86-ssse3", hex_encode_ssse3, hex_decode_ssse3, hex_ssse3_supported},
+#endif
+    {"portable", hex_encode_portable, hex_decode_portable, hex_portable_supported}
+};
+
+static const hex_impl_t *hex_impl = &hex_impls[sizeof(hex_impls) / sizeof(hex_impls[0]) - 1];
+
+void
+hex_encode(char *dst, const unsigned char *src, apr_size_t len)
+{
+    hex_impl->encode(dst, src, len);
+}
+
+svn_boolean_t
+hex_decode(unsigned char *dst, const char *src, apr_size_t len)
+{
+    return hex_impl->decode(dst, src, len);
+}
+
+const char *
+hex_codec_name(void)
+{
+    return hex_impl->name;
+}
+
+// Compares codec with the portable one on lengths covering
+// both vector loops and their tails.
+static svn_boolean_t
+hex_self_test(const hex_impl_t *impl)
+{
+    static const apr_size_t lengths[] = {0, 1, 15, 16, 20, 31, 32, 33, 63, 64, 100};
+    unsigned char data[100], decoded[100];
+    char expected[200], encoded[200];
+
+    for (apr_size_t i = 0; i < sizeof(data); i++) {
+        data[i] = (unsigned char)(i * 131 + (i >> 3));
+    }
+
+    for (apr_size_t i = 0; i < sizeof(lengths) / sizeof(lengths[0]); i++) {
+        apr_size_t len = lengths[i];
+
+        hex_encode_portable(expected, data, len);
+        impl->encode(encoded, data, len);
+        if (memcmp(expected, encoded, 2 * len) != 0) {
+            return FALSE;
+        }
+
+        if (!impl->decode(decoded, encoded, len) ||
+            memcmp(decoded, data, len) != 0) {
+            return FALSE;
+        }
+
+        // Every position must reject a character which is not a digit.
+        for (apr_size_t j = 0; j < 2 * len; j++) {
+            encoded[j] = (j % 2) ? 'g' : '/';
+            if (impl->decode(decoded, encoded, len)) {
+                return FALSE;
+            }
+            encoded[j] = expected[j];
+        }
+    }
+
+    return TRUE;
+}
+
+void
+hex_initialize(void)
+{
+    for (apr_size_t i = 0; i < sizeof(hex_impls) / sizeof(hex_impls[0]); i++) {
+        if (hex_impls[i].supported() && hex_self_test(&hex_impls[i])) {
+            hex_impl = &hex_impls[i];
+            return;
+        }
+    }
+}
+
+svn_boolean_t
+hex_select_codec(const char *name)
+{
+    for (apr_size_t i = 0; i < sizeof(hex_impls) / sizeof(hex_impls[0]); i++) {
+        if (strcmp(hex_impls[i].name, name) == 0) {
+            if (!hex_impls[i].supported() || !hex_self_test(&hex_impls[i])) {
+                return FALSE;
+            }
+            hex_impl = &hex_impls[i];
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
@@ -0,0 +1,54 @@
+/* Copyright (C) 2014 by Maxim Bublis <b@codemonkey.ru>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef GIT_SVN_FAST_IMPORT_HEX_H_
+#define GIT_SVN_FAST_IMPORT_HEX_H_
+
+#include <svn_types.h>
+
+// Selects the fastest hex codec supported by the CPU, which passes
+// a self-test against the portable one. Portable codec is used until
+// then. Must be called before any threads are started.
+void
+hex_initialize(void);
+
+// Selects codec by name, if it is supported by the CPU and passes
+// the self-test, so that benchmarks can compare codecs. Returns FALSE
+// and keeps the selected codec otherwise. Must be called before any
+// threads are started.
+svn_boolean_t
+hex_select_codec(const char *name);
+
+// Returns name of the selected codec.
+const char *
+hex_codec_name(void);
+
+// Writes len bytes of src as 2 * len lowercase hex digits into dst.
+void
+hex_encode(char *dst, const unsigned char *src, apr_size_t len);
+
+// Reads len bytes from 2 * len hex digits of src into dst,
+// digits may be of either case. Returns FALSE on invalid digits.
+svn_boolean_t
+hex_decode(unsigned char *dst, const char *src, apr_size_t len);
+
+#endif // GIT_SVN_FAST_IMPORT_HEX_H_
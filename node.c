@@ -24,6 +24,8 @@
 #include <svn_hash.h>
 #include <svn_props.h>
 
+#define SYMLINK_CONTENT_PREFIX "link"
+
 svn_error_t *
 set_node_mode(node_mode_t *mode,
               svn_fs_root_t *root,
@@ -52,3 +54,27 @@ set_node_mode(node_mode_t *mode,
 
     return SVN_NO_ERROR;
 }
+
+svn_error_t *
+open_blob_contents(svn_stream_t **content,
+                   svn_filesize_t *size,
+                   svn_fs_root_t *root,
+                   const char *path,
+                   apr_pool_t *pool)
+{
+    apr_hash_t *props;
+
+    SVN_ERR(svn_fs_node_proplist(&props, root, path, pool));
+    SVN_ERR(svn_fs_file_length(size, root, path, pool));
+    SVN_ERR(svn_fs_file_contents(content, root, path, pool));
+
+    // We need to strip a symlink marker from the beginning of a content
+    // and subtract a symlink marker length from the blob size.
+    if (svn_hash_gets(props, SVN_PROP_SPECIAL)) {
+        apr_size_t skip = sizeof(SYMLINK_CONTENT_PREFIX);
+        SVN_ERR(svn_stream_skip(*content, skip));
+        *size -= skip;
+    }
+
+    return SVN_NO_ERROR;
+}
@@ -40,13 +40,25 @@ set_node_mode(node_mode_t *mode,
               const char *path,
               apr_pool_t *pool);
 
+// Opens content of a file at path as Git blob content,
+// i.e. without symlink marker, and sets its size.
+svn_error_t *
+open_blob_contents(svn_stream_t **content,
+                   svn_filesize_t *size,
+                   svn_fs_root_t *root,
+                   const char *path,
+                   apr_pool_t *pool);
+
 typedef struct
 {
     svn_node_kind_t kind;
     node_mode_t mode;
     const char *path;
-    svn_checksum_t *checksum;
+    // Digest points into checksum cache where cached, so that
+    // cache hits take no allocations.
+    svn_checksum_t checksum;
     svn_boolean_t cached;
+    // NULL for a tree taken from checksum cache as a whole.
     apr_array_header_t *entries;
 } node_t;
 
@@ -47,9 +47,9 @@ format_option(const apr_getopt_option_t *opt,
 }
 
 void
-print_usage(const apr_getopt_option_t *options, apr_pool_t *pool)
+print_usage(const char *usage, const apr_getopt_option_t *options, apr_pool_t *pool)
 {
-    svn_error_clear(svn_cmdline_printf(pool, "usage: svn-fast-export [OPTIONS] REPO\n"));
+    svn_error_clear(svn_cmdline_printf(pool, "usage: %s\n", usage));
 
     while (options->description) {
         const char *optstr;
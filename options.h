@@ -25,8 +25,10 @@
 
 #include <apr_getopt.h>
 
+// Prints usage line followed by descriptions of options.
 void
-print_usage(const apr_getopt_option_t *options,
+print_usage(const char *usage,
+            const apr_getopt_option_t *options,
             apr_pool_t *pool);
 
 #endif // SVN_FAST_EXPORT_OPTIONS_H_
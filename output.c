@@ -0,0 +1,417 @@
+/* Copyright (C) 2014 by Maxim Bublis <b@codemonkey.ru>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "output.h"
+#include "hex.h"
+#include <apr_portable.h>
+#include <apr_sha1.h>
+#include <apr_thread_cond.h>
+#include <apr_thread_mutex.h>
+#include <apr_thread_proc.h>
+#include <string.h>
+#include <svn_pools.h>
+
+#ifdef __linux__
+#include <fcntl.h>
+#endif
+
+// Number of buffers of a threaded output: one is filled while
+// the other one is written.
+#define OUTPUT_BUFFERS 2
+
+typedef struct
+{
+    char *data;
+    apr_size_t len;
+} output_buffer_t;
+
+struct output_t
+{
+    // Destination stream, NULL if buffers are written by a thread.
+    svn_stream_t *dst;
+    svn_stream_t *stream;
+    // Buffer being filled.
+    output_buffer_t *cur;
+    char *buf;
+    apr_size_t len;
+    apr_size_t size;
+    // Number of bytes passed on by output_flush().
+    apr_uint64_t flushed;
+
+    // Writer thread state, guarded by mutex.
+    apr_file_t *file;
+    apr_pool_t *thread_pool;
+    apr_thread_t *thread;
+    apr_thread_mutex_t *mutex;
+    apr_thread_cond_t *cond;
+    output_buffer_t buffers[OUTPUT_BUFFERS];
+    // Full buffers in order of writing, the first one
+    // stays queued while being written.
+    output_buffer_t *queue[OUTPUT_BUFFERS];
+    int head;
+    int nqueued;
+    output_buffer_t *free;
+    // Number of bytes written by the thread.
+    apr_uint64_t written;
+    apr_status_t status;
+    svn_boolean_t stop;
+};
+
+static svn_error_t *
+write_handler(void *baton, const char *data, apr_size_t *len)
+{
+    return output_write(baton, data, *len);
+}
+
+output_t *
+output_create(svn_stream_t *dst, apr_size_t size, apr_pool_t *pool)
+{
+    output_t *out = apr_pcalloc(pool, sizeof(output_t));
+
+    out->dst = dst;
+    out->buf = apr_palloc(pool, size);
+    out->size = size;
+    out->stream = svn_stream_create(out, pool);
+    svn_stream_set_write(out->stream, write_handler);
+
+    return out;
+}
+
+#if APR_HAS_THREADS
+
+static void * APR_THREAD_FUNC
+writer_main(apr_thread_t *thread, void *data)
+{
+    output_t *out = data;
+
+    apr_thread_mutex_lock(out->mutex);
+
+    while (TRUE) {
+        output_buffer_t *b;
+        apr_status_t status = APR_SUCCESS;
+
+        while (out->nqueued == 0 && !out->stop) {
+            apr_thread_cond_wait(out->cond, out->mutex);
+        }
+
+        if (out->nqueued == 0) {
+            break;
+        }
+
+        b = out->queue[out->head];
+        apr_thread_mutex_unlock(out->mutex);
+
+        // Drop the rest of output after a failure, the error
+        // is reported by the next flush.
+        if (out->status == APR_SUCCESS) {
+            status = apr_file_write_full(out->file, b->data, b->len, NULL);
+        }
+
+        apr_thread_mutex_lock(out->mutex);
+        if (status != APR_SUCCESS) {
+            out->status = status;
+        }
+        out->written += b->len;
+        out->head = (out->head + 1) % OUTPUT_BUFFERS;
+        out->nqueued--;
+        b->len = 0;
+        out->free = b;
+        apr_thread_cond_broadcast(out->cond);
+    }
+
+    apr_thread_mutex_unlock(out->mutex);
+
+    apr_thread_exit(thread, APR_SUCCESS);
+
+    return NULL;
+}
+
+#endif // APR_HAS_THREADS
+
+svn_error_t *
+output_create_threaded(output_t **out,
+                       apr_file_t *file,
+                       apr_size_t size,
+                       apr_pool_t *pool)
+{
+#if APR_HAS_THREADS
+    apr_status_t apr_err;
+    output_t *o = apr_pcalloc(pool, sizeof(output_t));
+
+    o->file = file;
+    o->size = size;
+    o->stream = svn_stream_create(o, pool);
+    svn_stream_set_write(o->stream, write_handler);
+
+    for (int i = 0; i < OUTPUT_BUFFERS; i++) {
+        o->buffers[i].data = apr_palloc(pool, size);
+    }
+    o->cur = &o->buffers[0];
+    o->buf = o->cur->data;
+    o->free = &o->buffers[1];
+
+#if defined(__linux__) && defined(F_SETPIPE_SZ)
+    {
+        apr_os_file_t fd;
+
+        // Let the pipe hold a whole buffer, so that writing it does not
+        // wait for git fast-import to read every 64K. Fails harmlessly
+        // if file is not a pipe or size exceeds the system limit.
+        if (apr_os_file_get(&fd, file) == APR_SUCCESS) {
+            fcntl(fd, F_SETPIPE_SZ, (int)size);
+        }
+    }
+#endif
+
+    // The thread gets a separate mutexless allocator,
+    // so that it never shares a pool with the main thread.
+    o->thread_pool = apr_allocator_owner_get(svn_pool_create_allocator(FALSE));
+
+    apr_err = apr_thread_mutex_create(&o->mutex, APR_THREAD_MUTEX_DEFAULT, pool);
+    if (!apr_err) {
+        apr_err = apr_thread_cond_create(&o->cond, pool);
+    }
+    if (!apr_err) {
+        apr_err = apr_thread_create(&o->thread, NULL, writer_main, o, o->thread_pool);
+    }
+    if (apr_err) {
+        svn_pool_destroy(o->thread_pool);
+        return svn_error_wrap_apr(apr_err, "Can't create writer thread");
+    }
+
+    *out = o;
+
+    return SVN_NO_ERROR;
+#else
+    return svn_error_create(SVN_ERR_UNSUPPORTED_FEATURE, NULL,
+                            "Threads are not supported");
+#endif
+}
+
+svn_stream_t *
+output_stream(output_t *out)
+{
+    return out->stream;
+}
+
+svn_error_t *
+output_flush(output_t *out)
+{
+    apr_size_t len = out->len;
+    apr_status_t status;
+
+    out->flushed += len;
+
+    if (out->dst != NULL) {
+        if (len > 0) {
+            out->len = 0;
+            SVN_ERR(svn_stream_write(out->dst, out->buf, &len));
+        }
+
+        return SVN_NO_ERROR;
+    }
+
+    apr_thread_mutex_lock(out->mutex);
+
+    if (len > 0) {
+        // Queue the filled buffer and take a written one.
+        out->cur->len = len;
+        out->queue[(out->head + out->nqueued) % OUTPUT_BUFFERS] = out->cur;
+        out->nqueued++;
+        apr_thread_cond_broadcast(out->cond);
+
+        while (out->free == NULL) {
+            apr_thread_cond_wait(out->cond, out->mutex);
+        }
+        out->cur = out->free;
+        out->free = NULL;
+        out->buf = out->cur->data;
+        out->len = 0;
+    }
+
+    status = out->status;
+    apr_thread_mutex_unlock(out->mutex);
+
+    if (status != APR_SUCCESS) {
+        return svn_error_wrap_apr(status, "Can't write output");
+    }
+
+    return SVN_NO_ERROR;
+}
+
+apr_uint64_t
+output_flushed(output_t *out)
+{
+    return out->flushed;
+}
+
+apr_uint64_t
+output_written(output_t *out)
+{
+    apr_uint64_t written;
+
+    if (out->dst != NULL) {
+        return out->flushed;
+    }
+
+    apr_thread_mutex_lock(out->mutex);
+    written = out->written;
+    apr_thread_mutex_unlock(out->mutex);
+
+    return written;
+}
+
+svn_error_t *
+output_sync(output_t *out)
+{
+    SVN_ERR(output_flush(out));
+
+    if (out->dst == NULL) {
+        apr_thread_mutex_lock(out->mutex);
+        while (out->nqueued > 0) {
+            apr_thread_cond_wait(out->cond, out->mutex);
+        }
+        apr_thread_mutex_unlock(out->mutex);
+
+        // Report a failure of the last write.
+        SVN_ERR(output_flush(out));
+    }
+
+    return SVN_NO_ERROR;
+}
+
+svn_error_t *
+output_close(output_t *out)
+{
+    if (out->thread != NULL) {
+        apr_status_t retval;
+
+        apr_thread_mutex_lock(out->mutex);
+        out->stop = TRUE;
+        apr_thread_cond_broadcast(out->cond);
+        apr_thread_mutex_unlock(out->mutex);
+
+        apr_thread_join(&retval, out->thread);
+        out->thread = NULL;
+        svn_pool_destroy(out->thread_pool);
+
+        if (out->status != APR_SUCCESS) {
+            return svn_error_wrap_apr(out->status, "Can't write output");
+        }
+    }
+
+    return SVN_NO_ERROR;
+}
+
+svn_error_t *
+output_write(output_t *out, const char *data, apr_size_t len)
+{
+    while (out->len + len > out->size) {
+        apr_size_t n = out->size - out->len;
+
+        // Pass large writes through, there is no point in copying them.
+        if (out->dst != NULL) {
+            SVN_ERR(output_flush(out));
+            if (len >= out->size) {
+                out->flushed += len;
+                return svn_stream_write(out->dst, data, &len);
+            }
+            break;
+        }
+
+        // Writer thread needs data in its buffers, fill them up.
+        memcpy(out->buf + out->len, data, n);
+        out->len += n;
+        data += n;
+        len -= n;
+        SVN_ERR(output_flush(out));
+    }
+
+    memcpy(out->buf + out->len, data, len);
+    out->len += len;
+
+    return SVN_NO_ERROR;
+}
+
+svn_error_t *
+output_cstr(output_t *out, const char *str)
+{
+    return output_write(out, str, strlen(str));
+}
+
+svn_error_t *
+output_char(output_t *out, char c)
+{
+    if (out->len == out->size) {
+        SVN_ERR(output_flush(out));
+    }
+
+    out->buf[out->len++] = c;
+
+    return SVN_NO_ERROR;
+}
+
+svn_error_t *
+output_dec(output_t *out, apr_int64_t n)
+{
+    char digits[24];
+    char *p = digits + sizeof(digits);
+    // Negate in unsigned arithmetic, so that the minimal value fits.
+    apr_uint64_t u = (n < 0) ? -(apr_uint64_t)n : (apr_uint64_t)n;
+
+    do {
+        *--p = '0' + u % 10;
+        u /= 10;
+    } while (u != 0);
+
+    if (n < 0) {
+        *--p = '-';
+    }
+
+    return output_write(out, p, digits + sizeof(digits) - p);
+}
+
+svn_error_t *
+output_oct(output_t *out, apr_uint32_t n)
+{
+    char digits[12];
+    char *p = digits + sizeof(digits);
+
+    do {
+        *--p = '0' + (n & 7);
+        n >>= 3;
+    } while (n != 0);
+
+    return output_write(out, p, digits + sizeof(digits) - p);
+}
+
+svn_error_t *
+output_checksum(output_t *out, const svn_checksum_t *checksum)
+{
+    apr_size_t size = svn_checksum_size(checksum);
+    // SHA-1 digests are the largest ones Subversion has.
+    char hex[2 * APR_SHA1_DIGESTSIZE];
+
+    hex_encode(hex, checksum->digest, size);
+
+    return output_write(out, hex, 2 * size);
+}
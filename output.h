@@ -0,0 +1,100 @@
+/* Copyright (C) 2014 by Maxim Bublis <b@codemonkey.ru>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef GIT_SVN_FAST_IMPORT_OUTPUT_H_
+#define GIT_SVN_FAST_IMPORT_OUTPUT_H_
+
+#include <apr_file_io.h>
+#include <svn_checksum.h>
+#include <svn_io.h>
+
+// Abstract type for a buffer of fast-import stream, formatting
+// commands in place without allocations.
+typedef struct output_t output_t;
+
+// Creates output buffering up to size bytes before writing them into dst.
+output_t *
+output_create(svn_stream_t *dst, apr_size_t size, apr_pool_t *pool);
+
+// Creates output filling buffers of size bytes while a separate thread
+// writes previous ones into file, so that producing output does not
+// wait for its reader. Pipes are enlarged to hold a buffer where
+// supported. Must be closed with output_close().
+svn_error_t *
+output_create_threaded(output_t **out,
+                       apr_file_t *file,
+                       apr_size_t size,
+                       apr_pool_t *pool);
+
+// Returns stream writing into output, so that writes through it
+// keep their order with formatted ones.
+svn_stream_t *
+output_stream(output_t *out);
+
+svn_error_t *
+output_write(output_t *out, const char *data, apr_size_t len);
+
+svn_error_t *
+output_cstr(output_t *out, const char *str);
+
+svn_error_t *
+output_char(output_t *out, char c);
+
+// Writes n in decimal, like "%" APR_INT64_T_FMT.
+svn_error_t *
+output_dec(output_t *out, apr_int64_t n);
+
+// Writes n in octal, like "%o".
+svn_error_t *
+output_oct(output_t *out, apr_uint32_t n);
+
+// Writes digest of checksum in lowercase hexadecimal,
+// like svn_checksum_to_cstring_display().
+svn_error_t *
+output_checksum(output_t *out, const svn_checksum_t *checksum);
+
+// Passes buffered data on for writing. With a writer thread, returns
+// without waiting for it, unless all buffers are still being written.
+// Reports failures of previous writes.
+svn_error_t *
+output_flush(output_t *out);
+
+// Returns number of bytes passed on by output_flush() so far.
+apr_uint64_t
+output_flushed(output_t *out);
+
+// Returns number of bytes written so far. It is behind output_flushed()
+// while the writer thread, if any, is writing.
+apr_uint64_t
+output_written(output_t *out);
+
+// Writes all buffered data, waiting for the writer thread if any.
+svn_error_t *
+output_sync(output_t *out);
+
+// Stops the writer thread, if any, once it writes data passed on by
+// output_flush(). Data still buffered is dropped. Reports a failure
+// of the writes, if any.
+svn_error_t *
+output_close(output_t *out);
+
+#endif // GIT_SVN_FAST_IMPORT_OUTPUT_H_
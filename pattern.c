@@ -0,0 +1,690 @@
+/* Copyright (C) 2014 by Maxim Bublis <b@codemonkey.ru>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "pattern.h"
+#include <apr_hash.h>
+#include <apr_strings.h>
+#include <apr_tables.h>
+#include <svn_pools.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Patterns are compiled into a Thompson NFA, which is turned into
+// a DFA lazily: a DFA state is a set of NFA states and its transitions
+// are computed the first time they are taken. Built states are limited
+// in number, all of them are dropped once there are more.
+#define PATTERN_MAX_DFA_STATES 4096
+
+// Pseudo-symbol starting patterns matched against relative path.
+#define PATTERN_RELPATH 256
+#define PATTERN_NSYMBOLS 257
+
+typedef enum
+{
+    // Up to two transitions without consuming input.
+    nfa_split,
+    // Transition consuming a byte from a character set.
+    nfa_set,
+    // Pattern matched.
+    nfa_accept
+} nfa_kind_t;
+
+typedef struct
+{
+    nfa_kind_t kind;
+    // Next states, -1 if none.
+    int out, out1;
+    // Character set of nfa_set state.
+    int set;
+    // Label of nfa_accept state.
+    int label;
+} nfa_state_t;
+
+typedef struct
+{
+    apr_uint32_t bits[8];
+} charset_t;
+
+typedef struct
+{
+    // Sorted ids of nfa_set and nfa_accept states.
+    int *nfa_states;
+    int nnfa_states;
+    int labels;
+    // Next states by byte and PATTERN_RELPATH, -1 if not built yet.
+    int next[PATTERN_NSYMBOLS];
+} dfa_state_t;
+
+struct pattern_set_t
+{
+    apr_pool_t *pool;
+    apr_array_header_t *nfa;
+    apr_array_header_t *sets;
+    // Start states of patterns matched against repository paths
+    // and relative paths.
+    apr_array_header_t *starts;
+    apr_array_header_t *rel_starts;
+    int labels;
+    svn_stringbuf_t *source;
+    // States of DFA allocated from dfa_pool, indexed by NFA states.
+    apr_pool_t *dfa_pool;
+    apr_array_header_t *dfa;
+    apr_hash_t *dfa_idx;
+    // Number of times DFA states were dropped.
+    apr_uint32_t generation;
+    int start;
+    // Scratch space of closure computation.
+    apr_array_header_t *seeds;
+    apr_array_header_t *stack;
+    apr_array_header_t *closure;
+    apr_uint32_t *visited;
+    apr_uint32_t stamp;
+};
+
+#define NFA(ps, i) APR_ARRAY_IDX((ps)->nfa, i, nfa_state_t)
+#define DFA(ps, i) APR_ARRAY_IDX((ps)->dfa, i, dfa_state_t *)
+
+// Fragment of NFA being built, end is a split state with no transitions.
+typedef struct
+{
+    int start;
+    int end;
+} fragment_t;
+
+typedef struct
+{
+    pattern_set_t *ps;
+    const char *p;
+    const char *error;
+} parser_t;
+
+static void
+dfa_reset(pattern_set_t *ps)
+{
+    svn_pool_clear(ps->dfa_pool);
+    ps->dfa = apr_array_make(ps->dfa_pool, 0, sizeof(dfa_state_t *));
+    ps->dfa_idx = apr_hash_make(ps->dfa_pool);
+    ps->visited = apr_pcalloc(ps->dfa_pool, (ps->nfa->nelts + 1) * sizeof(apr_uint32_t));
+    ps->stamp = 0;
+    ps->start = -1;
+    ps->generation++;
+}
+
+pattern_set_t *
+pattern_set_create(apr_pool_t *pool)
+{
+    pattern_set_t *ps = apr_pcalloc(pool, sizeof(pattern_set_t));
+
+    ps->pool = pool;
+    ps->nfa = apr_array_make(pool, 0, sizeof(nfa_state_t));
+    ps->sets = apr_array_make(pool, 0, sizeof(charset_t));
+    ps->starts = apr_array_make(pool, 0, sizeof(int));
+    ps->rel_starts = apr_array_make(pool, 0, sizeof(int));
+    ps->source = svn_stringbuf_create_empty(pool);
+    ps->seeds = apr_array_make(pool, 0, sizeof(int));
+    ps->stack = apr_array_make(pool, 0, sizeof(int));
+    ps->closure = apr_array_make(pool, 0, sizeof(int));
+    ps->dfa_pool = svn_pool_create(pool);
+    dfa_reset(ps);
+
+    return ps;
+}
+
+svn_boolean_t
+pattern_is_pattern(const char *str)
+{
+    return strncmp(str, "glob:", 5) == 0 || strncmp(str, "re:", 3) == 0;
+}
+
+int
+pattern_set_labels(const pattern_set_t *ps)
+{
+    return ps->labels;
+}
+
+const svn_stringbuf_t *
+pattern_set_source(const pattern_set_t *ps)
+{
+    return ps->source;
+}
+
+static int
+nfa_add(pattern_set_t *ps, nfa_kind_t kind, int set)
+{
+    nfa_state_t *state = apr_array_push(ps->nfa);
+
+    state->kind = kind;
+    state->out = -1;
+    state->out1 = -1;
+    state->set = set;
+    state->label = 0;
+
+    return ps->nfa->nelts - 1;
+}
+
+static fragment_t
+fragment_empty(parser_t *parser)
+{
+    fragment_t f;
+
+    f.start = f.end = nfa_add(parser->ps, nfa_split, -1);
+
+    return f;
+}
+
+static fragment_t
+fragment_set(parser_t *parser, const charset_t *set)
+{
+    fragment_t f;
+
+    APR_ARRAY_PUSH(parser->ps->sets, charset_t) = *set;
+    f.start = nfa_add(parser->ps, nfa_set, parser->ps->sets->nelts - 1);
+    f.end = nfa_add(parser->ps, nfa_split, -1);
+    NFA(parser->ps, f.start).out = f.end;
+
+    return f;
+}
+
+static fragment_t
+fragment_char(parser_t *parser, unsigned char c)
+{
+    charset_t set;
+
+    memset(&set, 0, sizeof(set));
+    set.bits[c >> 5] |= 1u << (c & 31);
+
+    return fragment_set(parser, &set);
+}
+
+// Returns fragment matching any byte, but slash if slash is not set.
+static fragment_t
+fragment_any(parser_t *parser, svn_boolean_t slash)
+{
+    charset_t set;
+
+    memset(&set, 0xff, sizeof(set));
+    if (!slash) {
+        set.bits['/' >> 5] &= ~(1u << ('/' & 31));
+    }
+
+    return fragment_set(parser, &set);
+}
+
+static fragment_t
+fragment_concat(parser_t *parser, fragment_t f1, fragment_t f2)
+{
+    fragment_t f;
+
+    NFA(parser->ps, f1.end).out = f2.start;
+    f.start = f1.start;
+    f.end = f2.end;
+
+    return f;
+}
+
+static fragment_t
+fragment_alt(parser_t *parser, fragment_t f1, fragment_t f2)
+{
+    fragment_t f;
+
+    f.start = nfa_add(parser->ps, nfa_split, -1);
+    f.end = nfa_add(parser->ps, nfa_split, -1);
+    NFA(parser->ps, f.start).out = f1.start;
+    NFA(parser->ps, f.start).out1 = f2.start;
+    NFA(parser->ps, f1.end).out = f.end;
+    NFA(parser->ps, f2.end).out = f.end;
+
+    return f;
+}
+
+// Returns fragment matching f repeated, at least once if plus is set.
+static fragment_t
+fragment_repeat(parser_t *parser, fragment_t f1, svn_boolean_t plus)
+{
+    fragment_t f;
+    int loop = nfa_add(parser->ps, nfa_split, -1);
+
+    f.end = nfa_add(parser->ps, nfa_split, -1);
+    f.start = plus ? f1.start : loop;
+    NFA(parser->ps, loop).out = f1.start;
+    NFA(parser->ps, loop).out1 = f.end;
+    NFA(parser->ps, f1.end).out = loop;
+
+    return f;
+}
+
+static fragment_t
+fragment_optional(parser_t *parser, fragment_t f1)
+{
+    fragment_t f;
+
+    f.start = nfa_add(parser->ps, nfa_split, -1);
+    f.end = nfa_add(parser->ps, nfa_split, -1);
+    NFA(parser->ps, f.start).out = f1.start;
+    NFA(parser->ps, f.start).out1 = f.end;
+    NFA(parser->ps, f1.end).out = f.end;
+
+    return f;
+}
+
+// Parses character class following "[" up to and including "]".
+static fragment_t
+parse_class(parser_t *parser, svn_boolean_t glob)
+{
+    charset_t set;
+    svn_boolean_t negate = FALSE;
+    const char *p = parser->p;
+
+    memset(&set, 0, sizeof(set));
+
+    if (*p == '^' || (glob && *p == '!')) {
+        negate = TRUE;
+        p++;
+    }
+
+    // Closing bracket right after opening one is a member.
+    for (svn_boolean_t first = TRUE; first || *p != ']'; first = FALSE) {
+        unsigned char lo, hi;
+
+        if (*p == '\\' && p[1] != '\0') {
+            p++;
+        }
+        if (*p == '\0') {
+            parser->error = "unterminated character class";
+            return fragment_empty(parser);
+        }
+
+        lo = hi = (unsigned char)*p++;
+        if (*p == '-' && p[1] != ']' && p[1] != '\0') {
+            p++;
+            if (*p == '\\' && p[1] != '\0') {
+                p++;
+            }
+            hi = (unsigned char)*p++;
+        }
+
+        if (lo > hi) {
+            parser->error = "invalid character range";
+            return fragment_empty(parser);
+        }
+
+        for (unsigned c = lo; c <= hi; c++) {
+            set.bits[c >> 5] |= 1u << (c & 31);
+        }
+    }
+    parser->p = p + 1;
+
+    if (negate) {
+        for (int i = 0; i < 8; i++) {
+            set.bits[i] = ~set.bits[i];
+        }
+    }
+
+    // Globs never match slash by wildcards.
+    if (glob) {
+        set.bits['/' >> 5] &= ~(1u << ('/' & 31));
+    }
+
+    return fragment_set(parser, &set);
+}
+
+static fragment_t
+parse_glob(parser_t *parser)
+{
+    fragment_t f = fragment_empty(parser);
+
+    while (*parser->p != '\0' && parser->error == NULL) {
+        fragment_t atom;
+        const char *p = parser->p;
+
+        if (strncmp(p, "**/", 3) == 0) {
+            // Any number of leading directories, including none.
+            atom = fragment_repeat(parser, fragment_any(parser, TRUE), FALSE);
+            atom = fragment_concat(parser, atom, fragment_char(parser, '/'));
+            atom = fragment_optional(parser, atom);
+            parser->p += 3;
+        } else if (strncmp(p, "**", 2) == 0) {
+            atom = fragment_repeat(parser, fragment_any(parser, TRUE), FALSE);
+            parser->p += 2;
+        } else if (*p == '*') {
+            atom = fragment_repeat(parser, fragment_any(parser, FALSE), FALSE);
+            parser->p++;
+        } else if (*p == '?') {
+            atom = fragment_any(parser, FALSE);
+            parser->p++;
+        } else if (*p == '[') {
+            parser->p++;
+            atom = parse_class(parser, TRUE);
+        } else {
+            if (*p == '\\' && p[1] != '\0') {
+                p++;
+            }
+            atom = fragment_char(parser, *p);
+            parser->p = p + 1;
+        }
+
+        f = fragment_concat(parser, f, atom);
+    }
+
+    return f;
+}
+
+static fragment_t
+parse_regex_alt(parser_t *parser);
+
+static fragment_t
+parse_regex_atom(parser_t *parser)
+{
+    const char *p = parser->p;
+    fragment_t f;
+
+    switch (*p) {
+    case '(':
+        parser->p++;
+        f = parse_regex_alt(parser);
+        if (*parser->p != ')') {
+            parser->error = "missing )";
+            return f;
+        }
+        parser->p++;
+        return f;
+    case '[':
+        parser->p++;
+        return parse_class(parser, FALSE);
+    case '.':
+        parser->p++;
+        return fragment_any(parser, TRUE);
+    case '^':
+    case '$':
+        // Patterns are always anchored.
+        parser->p++;
+        return fragment_empty(parser);
+    case '*':
+    case '+':
+    case '?':
+        parser->error = "nothing to repeat";
+        return fragment_empty(parser);
+    case '\\':
+        if (p[1] != '\0') {
+            p++;
+        }
+        /* fall through */
+    default:
+        parser->p = p + 1;
+        return fragment_char(parser, *p);
+    }
+}
+
+static fragment_t
+parse_regex_concat(parser_t *parser)
+{
+    fragment_t f = fragment_empty(parser);
+
+    while (*parser->p != '\0' && *parser->p != '|' && *parser->p != ')' &&
+           parser->error == NULL) {
+        fragment_t atom = parse_regex_atom(parser);
+
+        while (parser->error == NULL) {
+            if (*parser->p == '*') {
+                atom = fragment_repeat(parser, atom, FALSE);
+            } else if (*parser->p == '+') {
+                atom = fragment_repeat(parser, atom, TRUE);
+            } else if (*parser->p == '?') {
+                atom = fragment_optional(parser, atom);
+            } else {
+                break;
+            }
+            parser->p++;
+        }
+
+        f = fragment_concat(parser, f, atom);
+    }
+
+    return f;
+}
+
+static fragment_t
+parse_regex_alt(parser_t *parser)
+{
+    fragment_t f = parse_regex_concat(parser);
+
+    while (*parser->p == '|' && parser->error == NULL) {
+        parser->p++;
+        f = fragment_alt(parser, f, parse_regex_concat(parser));
+    }
+
+    return f;
+}
+
+svn_error_t *
+pattern_set_add(pattern_set_t *ps, const char *pattern, int label)
+{
+    parser_t parser;
+    fragment_t f;
+    int accept;
+
+    parser.ps = ps;
+    parser.error = NULL;
+
+    if (strncmp(pattern, "glob:", 5) == 0) {
+        parser.p = pattern + 5;
+        f = parse_glob(&parser);
+    } else if (strncmp(pattern, "re:", 3) == 0) {
+        parser.p = pattern + 3;
+        f = parse_regex_alt(&parser);
+        if (parser.error == NULL && *parser.p != '\0') {
+            parser.error = "unmatched )";
+        }
+    } else {
+        parser.error = "unknown pattern kind";
+    }
+
+    if (parser.error != NULL) {
+        return svn_error_createf(SVN_ERR_INCORRECT_PARAMS, NULL,
+                                 "Invalid pattern '%s': %s",
+                                 pattern, parser.error);
+    }
+
+    accept = nfa_add(ps, nfa_accept, -1);
+    NFA(ps, accept).label = label;
+    NFA(ps, f.end).out = accept;
+
+    if (label == PATTERN_IGNORE_PATH) {
+        APR_ARRAY_PUSH(ps->rel_starts, int) = f.start;
+    } else {
+        APR_ARRAY_PUSH(ps->starts, int) = f.start;
+    }
+
+    ps->labels |= label;
+    svn_stringbuf_appendcstr(ps->source, apr_psprintf(ps->pool, "%d %s\n", label, pattern));
+
+    // States of NFA changed.
+    dfa_reset(ps);
+
+    return SVN_NO_ERROR;
+}
+
+static int
+compare_ints(const void *a, const void *b)
+{
+    int x = *(const int *)a, y = *(const int *)b;
+
+    return (x > y) - (x < y);
+}
+
+// Returns DFA state for closure of NFA states in ps->seeds, building
+// it if needed. Building a state may drop all others.
+static int
+dfa_state(pattern_set_t *ps)
+{
+    dfa_state_t *state;
+    int *idx;
+
+    // Follow split states, keeping the rest.
+    if (++ps->stamp == 0) {
+        memset(ps->visited, 0, ps->nfa->nelts * sizeof(apr_uint32_t));
+        ps->stamp = 1;
+    }
+
+    apr_array_clear(ps->closure);
+    apr_array_clear(ps->stack);
+    apr_array_cat(ps->stack, ps->seeds);
+
+    while (ps->stack->nelts > 0) {
+        int id = *(int *)apr_array_pop(ps->stack);
+        const nfa_state_t *nfa_state;
+
+        if (id < 0 || ps->visited[id] == ps->stamp) {
+            continue;
+        }
+        ps->visited[id] = ps->stamp;
+
+        nfa_state = &NFA(ps, id);
+        if (nfa_state->kind == nfa_split) {
+            APR_ARRAY_PUSH(ps->stack, int) = nfa_state->out;
+            APR_ARRAY_PUSH(ps->stack, int) = nfa_state->out1;
+        } else {
+            APR_ARRAY_PUSH(ps->closure, int) = id;
+        }
+    }
+
+    qsort(ps->closure->elts, ps->closure->nelts, sizeof(int), compare_ints);
+
+    idx = apr_hash_get(ps->dfa_idx, ps->closure->elts, ps->closure->nelts * sizeof(int));
+    if (idx != NULL) {
+        return *idx;
+    }
+
+    if (ps->dfa->nelts >= PATTERN_MAX_DFA_STATES) {
+        // Closure is kept in ps->closure, it survives the reset.
+        dfa_reset(ps);
+    }
+
+    state = apr_palloc(ps->dfa_pool, sizeof(dfa_state_t));
+    state->nfa_states = apr_pmemdup(ps->dfa_pool, ps->closure->elts,
+                                    ps->closure->nelts * sizeof(int));
+    state->nnfa_states = ps->closure->nelts;
+    state->labels = 0;
+    for (int i = 0; i < PATTERN_NSYMBOLS; i++) {
+        state->next[i] = -1;
+    }
+
+    for (int i = 0; i < state->nnfa_states; i++) {
+        const nfa_state_t *nfa_state = &NFA(ps, state->nfa_states[i]);
+        if (nfa_state->kind == nfa_accept) {
+            state->labels |= nfa_state->label;
+        }
+    }
+
+    idx = apr_palloc(ps->dfa_pool, sizeof(int));
+    *idx = ps->dfa->nelts;
+    APR_ARRAY_PUSH(ps->dfa, dfa_state_t *) = state;
+    apr_hash_set(ps->dfa_idx, state->nfa_states, state->nnfa_states * sizeof(int), idx);
+
+    return *idx;
+}
+
+// Returns DFA state following s by symbol.
+static int
+dfa_next(pattern_set_t *ps, int s, int symbol)
+{
+    const dfa_state_t *state = DFA(ps, s);
+    apr_uint32_t generation = ps->generation;
+    int next = state->next[symbol];
+
+    if (next >= 0) {
+        return next;
+    }
+
+    apr_array_clear(ps->seeds);
+
+    if (symbol == PATTERN_RELPATH) {
+        for (int i = 0; i < state->nnfa_states; i++) {
+            APR_ARRAY_PUSH(ps->seeds, int) = state->nfa_states[i];
+        }
+        apr_array_cat(ps->seeds, ps->rel_starts);
+    } else {
+        for (int i = 0; i < state->nnfa_states; i++) {
+            const nfa_state_t *nfa_state = &NFA(ps, state->nfa_states[i]);
+            const charset_t *set;
+
+            if (nfa_state->kind != nfa_set) {
+                continue;
+            }
+
+            set = &APR_ARRAY_IDX(ps->sets, nfa_state->set, charset_t);
+            if (set->bits[symbol >> 5] & (1u << (symbol & 31))) {
+                APR_ARRAY_PUSH(ps->seeds, int) = nfa_state->out;
+            }
+        }
+    }
+
+    next = dfa_state(ps);
+
+    // Remember transition unless states were dropped meanwhile.
+    if (ps->generation == generation) {
+        DFA(ps, s)->next[symbol] = next;
+    }
+
+    return next;
+}
+
+int
+pattern_set_match(pattern_set_t *ps, const char *path, const char *relpath)
+{
+    int labels = 0, s;
+
+    if (ps->starts->nelts == 0 && (relpath == NULL || ps->rel_starts->nelts == 0)) {
+        return 0;
+    }
+
+    if (ps->start < 0) {
+        apr_array_clear(ps->seeds);
+        apr_array_cat(ps->seeds, ps->starts);
+        ps->start = dfa_state(ps);
+    }
+    s = ps->start;
+
+    for (const char *p = path; ; p++) {
+        if (p == relpath) {
+            s = dfa_next(ps, s, PATTERN_RELPATH);
+        }
+
+        // Matching a parent directory matches path as well.
+        if (*p == '\0' || (*p == '/' && p > path)) {
+            labels |= DFA(ps, s)->labels;
+        }
+
+        if (*p == '\0') {
+            break;
+        }
+
+        // Nothing can match any more.
+        if (DFA(ps, s)->nnfa_states == 0 && (relpath == NULL || p >= relpath)) {
+            break;
+        }
+
+        s = dfa_next(ps, s, (unsigned char)*p);
+    }
+
+    return labels;
+}
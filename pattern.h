@@ -0,0 +1,77 @@
+/* Copyright (C) 2014 by Maxim Bublis <b@codemonkey.ru>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef GIT_SVN_FAST_IMPORT_PATTERN_H_
+#define GIT_SVN_FAST_IMPORT_PATTERN_H_
+
+#include <apr_pools.h>
+#include <svn_error.h>
+#include <svn_string.h>
+
+// Labels of patterns, a match returns a bitwise OR of them.
+enum
+{
+    // Matched against repository path.
+    PATTERN_IGNORE_ABSPATH = 1 << 0,
+    // Matched against path relative to branch root.
+    PATTERN_IGNORE_PATH = 1 << 1,
+    // Matched against repository path.
+    PATTERN_NO_IGNORE_ABSPATH = 1 << 2
+};
+
+// Set of glob and regular expression patterns compiled into a single
+// automaton, which states are built lazily while paths are matched.
+// Matching changes the automaton, so a set must not be shared
+// between threads.
+typedef struct pattern_set_t pattern_set_t;
+
+pattern_set_t *
+pattern_set_create(apr_pool_t *pool);
+
+// Tests if str is a pattern, i.e. it starts with "glob:" or "re:".
+svn_boolean_t
+pattern_is_pattern(const char *str);
+
+// Adds pattern with label to set. Globs support "*" and "?", which do
+// not match "/", "**" matching any number of directories and character
+// classes "[...]". Regular expressions support ".", "[...]", "*", "+",
+// "?", "|" and parentheses. Both are anchored at both ends.
+svn_error_t *
+pattern_set_add(pattern_set_t *ps, const char *pattern, int label);
+
+// Returns bitwise OR of labels of patterns set has.
+int
+pattern_set_labels(const pattern_set_t *ps);
+
+// Returns sources of patterns of set, so that changes of patterns
+// can be detected.
+const svn_stringbuf_t *
+pattern_set_source(const pattern_set_t *ps);
+
+// Returns labels of patterns matching path or one of its parent
+// directories in a single pass over path. PATTERN_IGNORE_PATH patterns
+// are matched against relpath, which must be a suffix of path, and are
+// skipped if relpath is NULL.
+int
+pattern_set_match(pattern_set_t *ps, const char *path, const char *relpath);
+
+#endif // GIT_SVN_FAST_IMPORT_PATTERN_H_
@@ -0,0 +1,225 @@
+/* Copyright (C) 2015 by Maxim Bublis <b@codemonkey.ru>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "reader.h"
+#include "sorts.h"
+#include <apr_thread_cond.h>
+#include <apr_thread_mutex.h>
+#include <apr_thread_proc.h>
+#include <svn_pools.h>
+
+typedef struct
+{
+    // Pool of slot contents, uses its own allocator.
+    // Cleared by the reader thread only while the slot is empty.
+    apr_pool_t *pool;
+    apr_hash_t *revprops;
+    apr_array_header_t *changes;
+    svn_error_t *err;
+    svn_boolean_t full;
+} slot_t;
+
+struct reader_t
+{
+    apr_pool_t *pool;
+    apr_thread_t *thread;
+    apr_thread_mutex_t *mutex;
+    apr_thread_cond_t *cond;
+    svn_fs_t *fs;
+    slot_t *slots;
+    int depth;
+    svn_revnum_t lower;
+    svn_revnum_t upper;
+    // Next revision to be returned by reader_next().
+    svn_revnum_t next;
+    svn_boolean_t stop;
+};
+
+static svn_error_t *
+read_revision(slot_t *slot, svn_fs_t *fs, svn_revnum_t revnum)
+{
+    apr_hash_t *changes;
+    svn_fs_root_t *root;
+
+    SVN_ERR(svn_fs_revision_proplist(&slot->revprops, fs, revnum, slot->pool));
+    SVN_ERR(svn_fs_revision_root(&root, fs, revnum, slot->pool));
+    SVN_ERR(svn_fs_paths_changed2(&changes, root, slot->pool));
+    slot->changes = sort_hash(changes, compare_items_as_paths, slot->pool);
+
+    return SVN_NO_ERROR;
+}
+
+static void * APR_THREAD_FUNC
+reader_main(apr_thread_t *thread, void *data)
+{
+    reader_t *r = data;
+
+    for (svn_revnum_t revnum = r->lower; revnum <= r->upper; revnum++) {
+        slot_t *slot = &r->slots[(revnum - r->lower) % r->depth];
+        svn_boolean_t stop;
+
+        apr_thread_mutex_lock(r->mutex);
+        while (slot->full && !r->stop) {
+            apr_thread_cond_wait(r->cond, r->mutex);
+        }
+        stop = r->stop;
+        apr_thread_mutex_unlock(r->mutex);
+
+        if (stop) {
+            break;
+        }
+
+        svn_pool_clear(slot->pool);
+        slot->err = read_revision(slot, r->fs, revnum);
+
+        apr_thread_mutex_lock(r->mutex);
+        slot->full = TRUE;
+        apr_thread_cond_broadcast(r->cond);
+        apr_thread_mutex_unlock(r->mutex);
+
+        if (slot->err) {
+            break;
+        }
+    }
+
+    apr_thread_exit(thread, APR_SUCCESS);
+
+    return NULL;
+}
+
+svn_error_t *
+reader_start(reader_t **r,
+             svn_fs_t *fs,
+             svn_revnum_t lower,
+             svn_revnum_t upper,
+             int depth,
+             apr_pool_t *pool)
+{
+#if APR_HAS_THREADS
+    apr_status_t apr_err;
+    svn_error_t *err;
+    reader_t *reader = apr_pcalloc(pool, sizeof(reader_t));
+
+    // The thread gets separate mutexless allocators,
+    // so that it never shares a pool with the main thread.
+    reader->pool = apr_allocator_owner_get(svn_pool_create_allocator(FALSE));
+    reader->depth = depth;
+    reader->lower = lower;
+    reader->upper = upper;
+    reader->next = lower;
+    reader->slots = apr_pcalloc(pool, depth * sizeof(slot_t));
+
+    for (int i = 0; i < depth; i++) {
+        reader->slots[i].pool = apr_allocator_owner_get(svn_pool_create_allocator(FALSE));
+    }
+
+    apr_err = apr_thread_mutex_create(&reader->mutex, APR_THREAD_MUTEX_DEFAULT, pool);
+    if (!apr_err) {
+        apr_err = apr_thread_cond_create(&reader->cond, pool);
+    }
+    if (apr_err) {
+        reader_stop(reader);
+        return svn_error_wrap_apr(apr_err, "Can't create reader thread");
+    }
+
+    err = svn_fs_open2(&reader->fs, svn_fs_path(fs, pool), NULL,
+                       reader->pool, reader->pool);
+    if (err) {
+        reader_stop(reader);
+        return err;
+    }
+
+    apr_err = apr_thread_create(&reader->thread, NULL, reader_main, reader, reader->pool);
+    if (apr_err) {
+        reader_stop(reader);
+        return svn_error_wrap_apr(apr_err, "Can't create reader thread");
+    }
+
+    *r = reader;
+
+    return SVN_NO_ERROR;
+#else
+    return svn_error_create(SVN_ERR_UNSUPPORTED_FEATURE, NULL,
+                            "Threads are not supported");
+#endif
+}
+
+svn_error_t *
+reader_next(apr_hash_t **revprops,
+            apr_array_header_t **changes,
+            reader_t *r)
+{
+    slot_t *slot = &r->slots[(r->next - r->lower) % r->depth];
+    svn_error_t *err;
+
+    apr_thread_mutex_lock(r->mutex);
+    while (!slot->full) {
+        apr_thread_cond_wait(r->cond, r->mutex);
+    }
+    apr_thread_mutex_unlock(r->mutex);
+
+    if (slot->err) {
+        err = slot->err;
+        slot->err = SVN_NO_ERROR;
+        return err;
+    }
+
+    *revprops = slot->revprops;
+    *changes = slot->changes;
+
+    return SVN_NO_ERROR;
+}
+
+void
+reader_release(reader_t *r)
+{
+    slot_t *slot = &r->slots[(r->next - r->lower) % r->depth];
+
+    apr_thread_mutex_lock(r->mutex);
+    slot->full = FALSE;
+    r->next++;
+    apr_thread_cond_broadcast(r->cond);
+    apr_thread_mutex_unlock(r->mutex);
+}
+
+void
+reader_stop(reader_t *r)
+{
+    if (r->thread != NULL) {
+        apr_status_t retval;
+
+        apr_thread_mutex_lock(r->mutex);
+        r->stop = TRUE;
+        apr_thread_cond_broadcast(r->cond);
+        apr_thread_mutex_unlock(r->mutex);
+
+        apr_thread_join(&retval, r->thread);
+        r->thread = NULL;
+    }
+
+    for (int i = 0; i < r->depth; i++) {
+        svn_error_clear(r->slots[i].err);
+        svn_pool_destroy(r->slots[i].pool);
+    }
+
+    svn_pool_destroy(r->pool);
+}
@@ -0,0 +1,57 @@
+/* Copyright (C) 2015 by Maxim Bublis <b@codemonkey.ru>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef GIT_SVN_FAST_IMPORT_READER_H_
+#define GIT_SVN_FAST_IMPORT_READER_H_
+
+#include <svn_fs.h>
+
+// Abstract type for a thread reading revisions ahead of the exporter.
+typedef struct reader_t reader_t;
+
+// Starts a thread reading properties and changed paths of revisions
+// from lower to upper into a ring of depth slots. The thread opens
+// filesystem at the path of fs on its own.
+svn_error_t *
+reader_start(reader_t **r,
+             svn_fs_t *fs,
+             svn_revnum_t lower,
+             svn_revnum_t upper,
+             int depth,
+             apr_pool_t *pool);
+
+// Waits for the next revision in order and sets its properties
+// and changed paths sorted as paths. Both are valid until reader_release().
+svn_error_t *
+reader_next(apr_hash_t **revprops,
+            apr_array_header_t **changes,
+            reader_t *r);
+
+// Returns slot of the revision returned by reader_next() to the thread.
+void
+reader_release(reader_t *r);
+
+// Stops the thread and frees its resources.
+void
+reader_stop(reader_t *r);
+
+#endif // GIT_SVN_FAST_IMPORT_READER_H_
@@ -0,0 +1,364 @@
+/* Copyright (C) 2015 by Maxim Bublis <b@codemonkey.ru>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "sha1.h"
+#include "utils.h"
+#include <string.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define SHA1_X86_SHANI 1
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+// Processes nblocks of 64-byte blocks of data.
+typedef void (*sha1_blocks_func_t)(apr_uint32_t *state,
+                                   const unsigned char *data,
+                                   apr_size_t nblocks);
+
+typedef struct
+{
+    const char *name;
+    sha1_blocks_func_t blocks;
+    // Returns TRUE if the implementation is supported by the CPU.
+    svn_boolean_t (*supported)(void);
+} sha1_impl_t;
+
+#define ROTL32(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
+
+static void
+sha1_blocks_portable(apr_uint32_t *state,
+                     const unsigned char *data,
+                     apr_size_t nblocks)
+{
+    apr_uint32_t w[16];
+
+    for (; nblocks > 0; nblocks--, data += SHA1_BLOCK_LEN) {
+        apr_uint32_t a = state[0], b = state[1], c = state[2];
+        apr_uint32_t d = state[3], e = state[4];
+
+        for (int i = 0; i < 80; i++) {
+            apr_uint32_t f, k, t;
+
+            // Keep only the last 16 words of the message schedule.
+            if (i < 16) {
+                w[i] = decode_uint32(data + 4 * i);
+            } else {
+                t = w[(i + 13) & 15] ^ w[(i + 8) & 15] ^ w[(i + 2) & 15] ^ w[i & 15];
+                w[i & 15] = ROTL32(t, 1);
+            }
+
+            if (i < 20) {
+                f = (b & c) | (~b & d);
+                k = 0x5a827999;
+            } else if (i < 40) {
+                f = b ^ c ^ d;
+                k = 0x6ed9eba1;
+            } else if (i < 60) {
+                f = (b & c) | (b & d) | (c & d);
+                k = 0x8f1bbcdc;
+            } else {
+                f = b ^ c ^ d;
+                k = 0xca62c1d6;
+            }
+
+            t = ROTL32(a, 5) + f + e + k + w[i & 15];
+            e = d;
+            d = c;
+            c = ROTL32(b, 30);
+            b = a;
+            a = t;
+        }
+
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+    }
+}
+
+static svn_boolean_t
+sha1_portable_supported(void)
+{
+    return TRUE;
+}
+
+#ifdef SHA1_X86_SHANI
+
+// Four rounds of SHA-NI, e_next gets the state to derive next e from.
+// Follows Intel SHA Extensions reference code.
+#define SHANI_ROUNDS(e_cur, e_next, func)                   \
+    e_next = abcd;                                          \
+    abcd = _mm_sha1rnds4_epu32(abcd, e_cur, func)
+
+__attribute__((target("sha,sse4.1")))
+static void
+sha1_blocks_shani(apr_uint32_t *state,
+                  const unsigned char *data,
+                  apr_size_t nblocks)
+{
+    const __m128i mask = _mm_set_epi64x(0x0001020304050607ULL, 0x08090a0b0c0d0e0fULL);
+    __m128i abcd, abcd_save, e0, e0_save, e1;
+    __m128i m0, m1, m2, m3;
+
+    abcd = _mm_loadu_si128((const __m128i *)state);
+    abcd = _mm_shuffle_epi32(abcd, 0x1b);
+    e0 = _mm_set_epi32(state[4], 0, 0, 0);
+
+    for (; nblocks > 0; nblocks--, data += SHA1_BLOCK_LEN) {
+        abcd_save = abcd;
+        e0_save = e0;
+
+        // Rounds 0-15 load the message.
+        m0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 0)), mask);
+        e0 = _mm_add_epi32(e0, m0);
+        SHANI_ROUNDS(e0, e1, 0);
+
+        m1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 16)), mask);
+        e1 = _mm_sha1nexte_epu32(e1, m1);
+        SHANI_ROUNDS(e1, e0, 0);
+        m0 = _mm_sha1msg1_epu32(m0, m1);
+
+        m2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 32)), mask);
+        e0 = _mm_sha1nexte_epu32(e0, m2);
+        SHANI_ROUNDS(e0, e1, 0);
+        m1 = _mm_sha1msg1_epu32(m1, m2);
+        m0 = _mm_xor_si128(m0, m2);
+
+        m3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 48)), mask);
+        e1 = _mm_sha1nexte_epu32(e1, m3);
+        m0 = _mm_sha1msg2_epu32(m0, m3);
+        SHANI_ROUNDS(e1, e0, 0);
+        m2 = _mm_sha1msg1_epu32(m2, m3);
+        m1 = _mm_xor_si128(m1, m3);
+
+        // Rounds 16-67 extend the message schedule.
+#define SHANI_SCHEDULE(e_cur, e_next, a, b, c, d, func)     \
+        e_cur = _mm_sha1nexte_epu32(e_cur, a);              \
+        b = _mm_sha1msg2_epu32(b, a);                       \
+        SHANI_ROUNDS(e_cur, e_next, func);                  \
+        d = _mm_sha1msg1_epu32(d, a);                       \
+        c = _mm_xor_si128(c, a)
+
+        SHANI_SCHEDULE(e0, e1, m0, m1, m2, m3, 0);
+        SHANI_SCHEDULE(e1, e0, m1, m2, m3, m0, 1);
+        SHANI_SCHEDULE(e0, e1, m2, m3, m0, m1, 1);
+        SHANI_SCHEDULE(e1, e0, m3, m0, m1, m2, 1);
+        SHANI_SCHEDULE(e0, e1, m0, m1, m2, m3, 1);
+        SHANI_SCHEDULE(e1, e0, m1, m2, m3, m0, 1);
+        SHANI_SCHEDULE(e0, e1, m2, m3, m0, m1, 2);
+        SHANI_SCHEDULE(e1, e0, m3, m0, m1, m2, 2);
+        SHANI_SCHEDULE(e0, e1, m0, m1, m2, m3, 2);
+        SHANI_SCHEDULE(e1, e0, m1, m2, m3, m0, 2);
+        SHANI_SCHEDULE(e0, e1, m2, m3, m0, m1, 2);
+        SHANI_SCHEDULE(e1, e0, m3, m0, m1, m2, 3);
+        SHANI_SCHEDULE(e0, e1, m0, m1, m2, m3, 3);
+#undef SHANI_SCHEDULE
+
+        // Rounds 68-79 use up the rest of the schedule.
+        e1 = _mm_sha1nexte_epu32(e1, m1);
+        m2 = _mm_sha1msg2_epu32(m2, m1);
+        SHANI_ROUNDS(e1, e0, 3);
+        m3 = _mm_xor_si128(m3, m1);
+
+        e0 = _mm_sha1nexte_epu32(e0, m2);
+        m3 = _mm_sha1msg2_epu32(m3, m2);
+        SHANI_ROUNDS(e0, e1, 3);
+
+        e1 = _mm_sha1nexte_epu32(e1, m3);
+        SHANI_ROUNDS(e1, e0, 3);
+
+        e0 = _mm_sha1nexte_epu32(e0, e0_save);
+        abcd = _mm_add_epi32(abcd, abcd_save);
+    }
+
+    abcd = _mm_shuffle_epi32(abcd, 0x1b);
+    _mm_storeu_si128((__m128i *)state, abcd);
+    state[4] = _mm_extract_epi32(e0, 3);
+}
+
+#undef SHANI_ROUNDS
+
+static svn_boolean_t
+sha1_shani_supported(void)
+{
+    unsigned int eax, ebx, ecx, edx;
+
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+        return FALSE;
+    }
+
+    // SSSE3 and SSE4.1.
+    if (!(ecx & (1 << 9)) || !(ecx & (1 << 19))) {
+        return FALSE;
+    }
+
+    if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) {
+        return FALSE;
+    }
+
+    // SHA extensions.
+    return (ebx & (1 << 29)) != 0;
+}
+
+#endif // SHA1_X86_SHANI
+
+// Implementations in order of preference.
+static const sha1_impl_t sha1_impls[] = {
+#ifdef SHA1_X86_SHANI
+    {"x86-sha", sha1_blocks_shani, sha1_shani_supported},
+#endif
+    {"portable", sha1_blocks_portable, sha1_portable_supported}
+};
+
+static const sha1_impl_t *sha1_impl = &sha1_impls[sizeof(sha1_impls) / sizeof(sha1_impls[0]) - 1];
+
+void
+sha1_ctx_init(sha1_ctx_t *ctx)
+{
+    ctx->state[0] = 0x67452301;
+    ctx->state[1] = 0xefcdab89;
+    ctx->state[2] = 0x98badcfe;
+    ctx->state[3] = 0x10325476;
+    ctx->state[4] = 0xc3d2e1f0;
+    ctx->len = 0;
+}
+
+void
+sha1_ctx_update(sha1_ctx_t *ctx, const void *data, apr_size_t len)
+{
+    const unsigned char *p = data;
+    apr_size_t used = ctx->len % SHA1_BLOCK_LEN;
+
+    ctx->len += len;
+
+    if (used > 0) {
+        apr_size_t n = SHA1_BLOCK_LEN - used;
+        if (n > len) {
+            n = len;
+        }
+
+        memcpy(ctx->buf + used, p, n);
+        p += n;
+        len -= n;
+
+        if (used + n < SHA1_BLOCK_LEN) {
+            return;
+        }
+
+        sha1_impl->blocks(ctx->state, ctx->buf, 1);
+    }
+
+    if (len >= SHA1_BLOCK_LEN) {
+        sha1_impl->blocks(ctx->state, p, len / SHA1_BLOCK_LEN);
+        p += len - len % SHA1_BLOCK_LEN;
+        len %= SHA1_BLOCK_LEN;
+    }
+
+    memcpy(ctx->buf, p, len);
+}
+
+svn_checksum_t *
+sha1_ctx_final(sha1_ctx_t *ctx, apr_pool_t *pool)
+{
+    unsigned char pad[2 * SHA1_BLOCK_LEN] = {0x80};
+    apr_size_t used = ctx->len % SHA1_BLOCK_LEN;
+    apr_size_t padlen = (used < SHA1_BLOCK_LEN - 8) ? SHA1_BLOCK_LEN - used : 2 * SHA1_BLOCK_LEN - used;
+    apr_uint64_t bits = ctx->len * 8;
+    svn_checksum_t *checksum;
+    unsigned char *digest;
+
+    // Append length in bits as 64-bit big-endian integer.
+    encode_uint64(pad + padlen - 8, bits);
+    sha1_ctx_update(ctx, pad, padlen);
+
+    checksum = svn_checksum_create(svn_checksum_sha1, pool);
+    digest = (unsigned char *)checksum->digest;
+    for (int i = 0; i < 5; i++) {
+        encode_uint32(digest + 4 * i, ctx->state[i]);
+    }
+
+    return checksum;
+}
+
+// Compares SHA-1 of data fed in chunks of various sizes with svn_checksum().
+static svn_error_t *
+sha1_self_test(svn_boolean_t *passed, apr_pool_t *pool)
+{
+    static const apr_size_t lengths[] = {0, 1, 3, 55, 56, 63, 64, 65, 119, 120, 128, 1000, 4099};
+    static const apr_size_t chunks[] = {1, 7, 64, 4099};
+    unsigned char data[4099];
+
+    for (apr_size_t i = 0; i < sizeof(data); i++) {
+        data[i] = (unsigned char)(i * 131 + (i >> 8));
+    }
+
+    for (apr_size_t i = 0; i < sizeof(lengths) / sizeof(lengths[0]); i++) {
+        svn_checksum_t *expected;
+
+        SVN_ERR(svn_checksum(&expected, svn_checksum_sha1, data, lengths[i], pool));
+
+        for (apr_size_t j = 0; j < sizeof(chunks) / sizeof(chunks[0]); j++) {
+            sha1_ctx_t ctx;
+
+            sha1_ctx_init(&ctx);
+            for (apr_size_t off = 0; off < lengths[i]; off += chunks[j]) {
+                apr_size_t n = lengths[i] - off;
+                sha1_ctx_update(&ctx, data + off, (n < chunks[j]) ? n : chunks[j]);
+            }
+
+            // svn_checksum_match() takes all-zero digests as matching
+            // anything, so compare digests themselves.
+            if (memcmp(expected->digest, sha1_ctx_final(&ctx, pool)->digest,
+                       svn_checksum_size(expected)) != 0) {
+                *passed = FALSE;
+                return SVN_NO_ERROR;
+            }
+        }
+    }
+
+    *passed = TRUE;
+
+    return SVN_NO_ERROR;
+}
+
+svn_error_t *
+sha1_initialize(apr_pool_t *pool)
+{
+    for (apr_size_t i = 0; i < sizeof(sha1_impls) / sizeof(sha1_impls[0]); i++) {
+        svn_boolean_t passed;
+
+        if (!sha1_impls[i].supported()) {
+            continue;
+        }
+
+        sha1_impl = &sha1_impls[i];
+        SVN_ERR(sha1_self_test(&passed, pool));
+        if (passed) {
+            return SVN_NO_ERROR;
+        }
+    }
+
+    return svn_error_create(SVN_ERR_CHECKSUM_MISMATCH, NULL,
+                            "SHA-1 self-test failed");
+}
@@ -0,0 +1,54 @@
+/* Copyright (C) 2015 by Maxim Bublis <b@codemonkey.ru>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef GIT_SVN_FAST_IMPORT_SHA1_H_
+#define GIT_SVN_FAST_IMPORT_SHA1_H_
+
+#include <svn_checksum.h>
+
+#define SHA1_BLOCK_LEN 64
+
+// SHA-1 context for hashing Git objects.
+typedef struct
+{
+    apr_uint32_t state[5];
+    apr_uint64_t len;
+    unsigned char buf[SHA1_BLOCK_LEN];
+} sha1_ctx_t;
+
+// Selects the fastest SHA-1 implementation supported by the CPU, which
+// passes a self-test against svn_checksum(). Portable implementation is
+// used until then. Must be called before any threads are started.
+svn_error_t *
+sha1_initialize(apr_pool_t *pool);
+
+void
+sha1_ctx_init(sha1_ctx_t *ctx);
+
+void
+sha1_ctx_update(sha1_ctx_t *ctx, const void *data, apr_size_t len);
+
+// Returns SHA-1 checksum of the data passed to ctx.
+svn_checksum_t *
+sha1_ctx_final(sha1_ctx_t *ctx, apr_pool_t *pool);
+
+#endif // GIT_SVN_FAST_IMPORT_SHA1_H_
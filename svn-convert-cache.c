@@ -0,0 +1,136 @@
+/* Copyright (C) 2015 by Maxim Bublis <b@codemonkey.ru>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "checksum.h"
+#include "hex.h"
+#include "options.h"
+#include <svn_cmdline.h>
+#include <svn_dirent_uri.h>
+#include <svn_pools.h>
+#include <svn_utf.h>
+
+static struct apr_getopt_option_t cmdline_options[] = {
+    {"help", 'h', 0, "Print this message and exit"},
+    {"format", 'f', 1, "Set output format: binary (default) or text."},
+    {0, 0, 0, 0}
+};
+
+static svn_error_t *
+do_main(int *exit_code, int argc, const char **argv, apr_pool_t *pool)
+{
+    apr_getopt_t *opt_parser;
+    apr_status_t apr_err;
+    const char *src_path = NULL, *dst_path = NULL;
+    checksum_cache_format_t format = checksum_cache_format_binary;
+    checksum_cache_t *cache;
+
+    // Pick hex codec for checksums.
+    hex_initialize();
+
+    // Parse options.
+    apr_err = apr_getopt_init(&opt_parser, pool, argc, argv);
+    if (apr_err != APR_SUCCESS) {
+        return svn_error_wrap_apr(apr_err, NULL);
+    }
+
+    while (TRUE) {
+        int opt_id;
+        const char *opt_arg;
+
+        // Parse the next option.
+        apr_err = apr_getopt_long(opt_parser, cmdline_options, &opt_id, &opt_arg);
+        if (APR_STATUS_IS_EOF(apr_err)) {
+            break;
+        } else if (apr_err) {
+            return svn_error_wrap_apr(apr_err, NULL);
+        }
+
+        switch (opt_id) {
+        case 'f':
+            if (strcmp(opt_arg, "binary") == 0) {
+                format = checksum_cache_format_binary;
+            } else if (strcmp(opt_arg, "text") == 0) {
+                format = checksum_cache_format_text;
+            } else {
+                return svn_error_createf(SVN_ERR_CL_ARG_PARSING_ERROR, NULL,
+                                         "Unknown format '%s'", opt_arg);
+            }
+            break;
+        case 'h':
+            print_usage("svn-convert-cache [OPTIONS] SRC DST", cmdline_options, pool);
+            *exit_code = EXIT_FAILURE;
+            return SVN_NO_ERROR;
+        }
+    }
+
+    // Get the source and destination paths.
+    if (opt_parser->ind < opt_parser->argc) {
+        SVN_ERR(svn_utf_cstring_to_utf8(&src_path, opt_parser->argv[opt_parser->ind++], pool));
+        src_path = svn_dirent_internal_style(src_path, pool);
+    }
+
+    if (opt_parser->ind < opt_parser->argc) {
+        SVN_ERR(svn_utf_cstring_to_utf8(&dst_path, opt_parser->argv[opt_parser->ind++], pool));
+        dst_path = svn_dirent_internal_style(dst_path, pool);
+    }
+
+    if (src_path == NULL || dst_path == NULL) {
+        svn_error_clear(svn_cmdline_fprintf(stderr, pool, "Source and destination paths required\n"));
+        *exit_code = EXIT_FAILURE;
+        return SVN_NO_ERROR;
+    }
+
+    cache = checksum_cache_create(pool);
+
+    SVN_ERR(checksum_cache_load_path(cache, src_path, pool));
+    checksum_cache_set_format(cache, format);
+    SVN_ERR(checksum_cache_dump_path(cache, dst_path, pool));
+
+    return SVN_NO_ERROR;
+}
+
+int
+main(int argc, const char **argv)
+{
+    apr_pool_t *pool;
+    svn_error_t *err;
+    int exit_code = EXIT_SUCCESS;
+
+    // Initialize the app.
+    if (svn_cmdline_init("svn-convert-cache", stderr) != EXIT_SUCCESS) {
+        return EXIT_FAILURE;
+    }
+
+    // Create top-level pool. Use a separate mutexless allocator,
+    // as this app is single-threaded.
+    pool = apr_allocator_owner_get(svn_pool_create_allocator(FALSE));
+
+    err = do_main(&exit_code, argc, argv, pool);
+    if (err) {
+        exit_code = EXIT_FAILURE;
+        svn_cmdline_handle_exit_error(err, NULL, "svn-convert-cache: ");
+    }
+
+    svn_pool_destroy(pool);
+
+    return exit_code;
+}
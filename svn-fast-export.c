@@ -21,15 +21,22 @@
  */
 
 #include "export.h"
+#include "hex.h"
 #include "options.h"
+#include "sha1.h"
 #include <apr_signal.h>
+#include <apr_strings.h>
 #include <svn_cmdline.h>
 #include <svn_dirent_uri.h>
+#include <svn_io.h>
 #include <svn_opt.h>
 #include <svn_pools.h>
 #include <svn_repos.h>
 #include <svn_utf.h>
 
+// Size of buffer of fast-import stream.
+#define OUTPUT_BUFFER_SIZE (1024 * 1024)
+
 // A flag to see if the process has been cancelled.
 static volatile sig_atomic_t cancelled = FALSE;
 
@@ -69,7 +76,13 @@ enum
     option_export_rev_marks,
     option_import_rev_marks,
     option_export_branches,
-    option_import_branches
+    option_import_branches,
+    option_read_ahead,
+    option_blobs_only,
+    option_rev_marks_format,
+    option_commit_cache_size,
+    option_writer_thread,
+    option_pending_journal
 };
 
 static struct apr_getopt_option_t cmdline_options[] = {
@@ -81,15 +94,22 @@ static struct apr_getopt_option_t cmdline_options[] = {
     {"branches", 'B', 1, "Set repository path as a root for branches."},
     {"tag", 't', 1, "Set repository path as a tag."},
     {"tags", 'T', 1, "Set repository path as a root for tags."},
-    {"ignore-path", 'I', 1, "Ignore a path relative to branch root."},
-    {"ignore-abspath", 'i', 1, "Ignore repository path."},
-    {"no-ignore-abspath", option_no_ignore_abspath, 1, "Do not ignore repository path."},
+    {"ignore-path", 'I', 1, "Ignore a path relative to branch root, or paths matching glob:pattern or re:pattern."},
+    {"ignore-abspath", 'i', 1, "Ignore repository path, or paths matching glob:pattern or re:pattern."},
+    {"no-ignore-abspath", option_no_ignore_abspath, 1, "Do not ignore repository path, or paths matching glob:pattern or re:pattern."},
     {"authors-file", 'A', 1, ""},
     {"export-rev-marks", option_export_rev_marks, 1, ""},
     {"import-rev-marks", option_import_rev_marks, 1, ""},
+    {"rev-marks-format", option_rev_marks_format, 1, "Set format of exported revision marks."},
+    {"commit-cache-size", option_commit_cache_size, 1, "Limit memory used by revision marks to number of megabytes, or kilobytes if followed by K."},
     {"export-branches", option_export_branches, 1, ""},
     {"import-branches", option_import_branches, 1, ""},
     {"checksum-cache", 'c', 1, "Use checksum cache."},
+    {"pending-journal", option_pending_journal, 0, "Journal checksums into pending files to be committed once git fast-import succeeds."},
+    {"jobs", 'j', 1, "Compute blob checksums using number of threads."},
+    {"read-ahead", option_read_ahead, 1, "Read number of revisions ahead on a separate thread."},
+    {"writer-thread", option_writer_thread, 0, "Write output on a separate thread."},
+    {"blobs-only", option_blobs_only, 1, "Write only blobs into one stream per job at PREFIX.0, PREFIX.1, ..."},
     {0, 0, 0, 0}
 };
 
@@ -137,7 +157,7 @@ do_main(int *exit_code, int argc, const char **argv, apr_pool_t *pool)
     svn_opt_revision_t start_revision, end_revision;
     svn_error_t *err;
     svn_fs_t *fs;
-    svn_stream_t *output;
+    output_t *out;
     svn_revnum_t lower = SVN_INVALID_REVNUM, upper = SVN_INVALID_REVNUM;
     svn_revnum_t youngest;
     svn_repos_t *repo;
@@ -150,14 +170,27 @@ do_main(int *exit_code, int argc, const char **argv, apr_pool_t *pool)
     // Path to a file where marks should be exported/imported.
     const char *export_marks_path = NULL, *import_marks_path = NULL;
     const char *export_branches_path = NULL, *import_branches_path = NULL;
+    // Format of exported marks, defaults to the format of imported ones.
+    int rev_marks_format = -1;
     const char *checksum_cache_path = NULL;
+    svn_boolean_t pending_journal = FALSE;
     svn_boolean_t incremental = FALSE;
+    int jobs = 1;
+    // Prefix of paths to write blob streams into.
+    const char *blobs_prefix = NULL;
+    svn_boolean_t writer_thread = FALSE;
 
     export_ctx_t *ctx = export_ctx_create(pool);
 
     // Initialize the FS library.
     SVN_ERR(svn_fs_initialize(pool));
 
+    // Pick SHA-1 implementation for Git objects.
+    SVN_ERR(sha1_initialize(pool));
+
+    // Pick hex codec for checksums.
+    hex_initialize();
+
     start_revision.kind = svn_opt_revision_unspecified;
     end_revision.kind = svn_opt_revision_unspecified;
 
@@ -197,20 +230,37 @@ do_main(int *exit_code, int argc, const char **argv, apr_pool_t *pool)
             break;
         case 'b':
         case 't':
-            branch_storage_add_branch(ctx->branches, branch_refname_from_path(opt_arg, pool), opt_arg, pool);
+            {
+                // Branch paths are split while exporting, which
+                // requires them to be canonical.
+                const char *path = svn_relpath_canonicalize(opt_arg, pool);
+                branch_storage_add_branch(ctx->branches, branch_refname_from_path(path, pool), path, pool);
+            }
             break;
         case 'B':
         case 'T':
-            branch_storage_add_prefix(ctx->branches, opt_arg, FALSE, pool);
+            branch_storage_add_prefix(ctx->branches, svn_relpath_canonicalize(opt_arg, pool), FALSE, pool);
             break;
         case 'i':
-            tree_insert(ctx->absignores, opt_arg, opt_arg, pool);
+            if (pattern_is_pattern(opt_arg)) {
+                SVN_ERR(pattern_set_add(ctx->patterns, opt_arg, PATTERN_IGNORE_ABSPATH));
+            } else {
+                tree_insert(ctx->absignores, opt_arg, opt_arg);
+            }
             break;
         case 'I':
-            tree_insert(ctx->ignores, opt_arg, opt_arg, pool);
+            if (pattern_is_pattern(opt_arg)) {
+                SVN_ERR(pattern_set_add(ctx->patterns, opt_arg, PATTERN_IGNORE_PATH));
+            } else {
+                tree_insert(ctx->ignores, opt_arg, opt_arg);
+            }
             break;
         case option_no_ignore_abspath:
-            tree_insert(ctx->no_ignores, opt_arg, opt_arg, pool);
+            if (pattern_is_pattern(opt_arg)) {
+                SVN_ERR(pattern_set_add(ctx->patterns, opt_arg, PATTERN_NO_IGNORE_ABSPATH));
+            } else {
+                tree_insert(ctx->no_ignores, opt_arg, opt_arg);
+            }
             break;
         case 'A':
             authors_path = opt_arg;
@@ -224,6 +274,32 @@ do_main(int *exit_code, int argc, const char **argv, apr_pool_t *pool)
         case option_import_rev_marks:
             import_marks_path = opt_arg;
             break;
+        case option_rev_marks_format:
+            if (strcmp(opt_arg, "binary") == 0) {
+                rev_marks_format = commit_cache_format_binary;
+            } else if (strcmp(opt_arg, "text") == 0) {
+                rev_marks_format = commit_cache_format_text;
+            } else {
+                return svn_error_createf(SVN_ERR_CL_ARG_PARSING_ERROR, NULL,
+                                         "Unknown revision marks format '%s'", opt_arg);
+            }
+            break;
+        case option_commit_cache_size:
+            {
+                char *end = NULL;
+                long size = strtol(opt_arg, &end, 10);
+                apr_size_t unit = 1024 * 1024;
+                if (end && *end == 'K') {
+                    unit = 1024;
+                    end++;
+                }
+                if (size < 1 || !end || *end) {
+                    return svn_error_create(SVN_ERR_CL_ARG_PARSING_ERROR, NULL,
+                                            "Invalid commit cache size supplied");
+                }
+                commit_cache_set_memory_limit(ctx->commits, (apr_size_t)size * unit);
+            }
+            break;
         case option_export_branches:
             export_branches_path = opt_arg;
             break;
@@ -233,8 +309,37 @@ do_main(int *exit_code, int argc, const char **argv, apr_pool_t *pool)
         case 'c':
             checksum_cache_path = opt_arg;
             break;
+        case 'j':
+            {
+                char *end = NULL;
+                jobs = strtol(opt_arg, &end, 10);
+                if (jobs < 1 || !end || *end) {
+                    return svn_error_create(SVN_ERR_CL_ARG_PARSING_ERROR, NULL,
+                                            "Invalid number of jobs supplied");
+                }
+            }
+            break;
+        case option_read_ahead:
+            {
+                char *end = NULL;
+                ctx->read_ahead = strtol(opt_arg, &end, 10);
+                if (ctx->read_ahead < 0 || !end || *end) {
+                    return svn_error_create(SVN_ERR_CL_ARG_PARSING_ERROR, NULL,
+                                            "Invalid number of revisions to read ahead supplied");
+                }
+            }
+            break;
+        case option_blobs_only:
+            blobs_prefix = opt_arg;
+            break;
+        case option_writer_thread:
+            writer_thread = TRUE;
+            break;
+        case option_pending_journal:
+            pending_journal = TRUE;
+            break;
         case 'h':
-            print_usage(cmdline_options, pool);
+            print_usage("svn-fast-export [OPTIONS] REPO", cmdline_options, pool);
             *exit_code = EXIT_FAILURE;
             return SVN_NO_ERROR;
         }
@@ -291,13 +396,64 @@ do_main(int *exit_code, int argc, const char **argv, apr_pool_t *pool)
 
     if (checksum_cache_path != NULL) {
         SVN_ERR(checksum_cache_load_path(ctx->blobs, checksum_cache_path, pool));
+        SVN_ERR(checksum_cache_load_trees(ctx->blobs, checksum_cache_path, FALSE, pool));
+        SVN_ERR(checksum_cache_open_journal(ctx->blobs, checksum_cache_path, pending_journal, pool));
     }
 
-    SVN_ERR(svn_stream_for_stdout(&output, pool));
+    if (jobs > 1 || blobs_prefix != NULL) {
+        SVN_ERR(hasher_create(&ctx->hasher, repo_path, jobs, pool));
+    }
 
     setup_signal_handlers();
 
-    err = export_revision_range(output, fs, lower, upper, ctx, check_cancel, pool);
+    if (blobs_prefix != NULL) {
+        apr_array_header_t *outputs = apr_array_make(pool, jobs, sizeof(svn_stream_t *));
+
+        for (int i = 0; i < jobs; i++) {
+            apr_file_t *fd;
+            const char *path = apr_psprintf(pool, "%s.%d", blobs_prefix, i);
+
+            // Paths may be named pipes read by git fast-import.
+            SVN_ERR(svn_io_file_open(&fd, path, APR_WRITE | APR_CREATE | APR_TRUNCATE | APR_BUFFERED,
+                                     APR_OS_DEFAULT, pool));
+            APR_ARRAY_PUSH(outputs, svn_stream_t *) = svn_stream_from_aprfile2(fd, FALSE, pool);
+        }
+
+        err = export_blobs(outputs, fs, lower, upper, ctx, check_cancel, pool);
+
+        for (int i = 0; i < jobs; i++) {
+            err = svn_error_compose_create(err, svn_stream_close(APR_ARRAY_IDX(outputs, i, svn_stream_t *)));
+        }
+
+        if (checksum_cache_path != NULL) {
+            err = svn_error_compose_create(err, checksum_cache_close(ctx->blobs, checksum_cache_path, pool));
+        }
+
+        return err;
+    }
+
+    if (writer_thread) {
+        apr_file_t *file;
+
+        apr_err = apr_file_open_stdout(&file, pool);
+        if (apr_err != APR_SUCCESS) {
+            return svn_error_wrap_apr(apr_err, "Can't open stdout");
+        }
+
+        SVN_ERR(output_create_threaded(&out, file, OUTPUT_BUFFER_SIZE, pool));
+    } else {
+        svn_stream_t *output;
+
+        SVN_ERR(svn_stream_for_stdout(&output, pool));
+        out = output_create(output, OUTPUT_BUFFER_SIZE, pool);
+    }
+
+    err = export_revision_range(out, fs, lower, upper, ctx, check_cancel, pool);
+    err = svn_error_compose_create(err, output_close(out));
+
+    if (rev_marks_format >= 0) {
+        commit_cache_set_format(ctx->commits, rev_marks_format);
+    }
 
     if (export_marks_path != NULL) {
         err = svn_error_compose_create(err, commit_cache_dump_path(ctx->commits, export_marks_path, pool));
@@ -308,7 +464,7 @@ do_main(int *exit_code, int argc, const char **argv, apr_pool_t *pool)
     }
 
     if (checksum_cache_path != NULL) {
-        err = svn_error_compose_create(err, checksum_cache_dump_path(ctx->blobs, checksum_cache_path, pool));
+        err = svn_error_compose_create(err, checksum_cache_close(ctx->blobs, checksum_cache_path, pool));
     }
 
     return err;
@@ -327,7 +483,8 @@ main(int argc, const char **argv)
     }
 
     // Create top-level pool. Use a separate mutexless allocator,
-    // as this app is single-threaded.
+    // as it is used by the main thread only, hashing and reader
+    // threads have allocators of their own.
     pool = apr_allocator_owner_get(svn_pool_create_allocator(FALSE));
 
     err = do_main(&exit_code, argc, argv, pool);
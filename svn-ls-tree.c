@@ -21,9 +21,13 @@
  */
 
 #include "checksum.h"
+#include "hasher.h"
+#include "hex.h"
 #include "node.h"
 #include "options.h"
+#include "sha1.h"
 #include "tree.h"
+#include <apr_sha1.h>
 #include <svn_cmdline.h>
 #include <svn_dirent_uri.h>
 #include <svn_hash.h>
@@ -38,8 +42,9 @@ static struct apr_getopt_option_t cmdline_options[] = {
     {NULL, 'r', 0, "Recurse into sub-trees"},
     {NULL, 't', 0, "Show tree entries even when going to recurse them. Has no effect if -r was not passed. -d implies -t."},
     {"root", 'R', 1, "Set path as root directory."},
-    {"ignore-path", 'I', 1, "Ignore path relative to root."},
+    {"ignore-path", 'I', 1, "Ignore path relative to root, or paths matching glob:pattern or re:pattern."},
     {"checksum-cache", 'c', 1, "Use checksum cache."},
+    {"jobs", 'j', 1, "Compute blob checksums using number of threads."},
     {0, 0, 0, 0}
 };
 
@@ -53,27 +58,29 @@ print_entries(apr_array_header_t *entries,
 {
     for (int i = 0; i < entries->nelts; i++) {
         node_t *node = &APR_ARRAY_IDX(entries, i, node_t);
+        char hex[2 * APR_SHA1_DIGESTSIZE + 1];
+
+        hex[2 * APR_SHA1_DIGESTSIZE] = '\0';
 
         if (node->kind == svn_node_dir) {
-            // Skip empty directories.
-            if (node->entries->nelts == 0) {
+            // Skip empty directories. Trees taken from cache have no entries
+            // unless listed recursively, but only non-empty ones are cached.
+            if (node->entries != NULL && node->entries->nelts == 0) {
                 continue;
             }
             if (show_trees) {
+                hex_encode(hex, node->checksum.digest, APR_SHA1_DIGESTSIZE);
                 SVN_ERR(svn_cmdline_printf(pool, "%06o tree %s\t%s\n",
-                                           node->mode,
-                                           svn_checksum_to_cstring_display(node->checksum, pool),
-                                           node->path));
+                                           node->mode, hex, node->path));
             }
             if (recurse) {
                 SVN_ERR(print_entries(node->entries, root_path, trees_only,
                                       recurse, show_trees, pool));
             }
         } else if (!trees_only) {
+            hex_encode(hex, node->checksum.digest, APR_SHA1_DIGESTSIZE);
             SVN_ERR(svn_cmdline_printf(pool, "%06o blob %s\t%s\n",
-                                       node->mode,
-                                       svn_checksum_to_cstring_display(node->checksum, pool),
-                                       node->path));
+                                       node->mode, hex, node->path));
         }
     }
 
@@ -88,19 +95,32 @@ print_tree(svn_fs_root_t *root,
            svn_boolean_t recurse,
            svn_boolean_t show_trees,
            checksum_cache_t *cache,
-           tree_t *ignores,
+           hasher_t *hasher,
+           const ignores_t *ignores,
            apr_pool_t *pool)
 {
     apr_array_header_t *entries;
     const char *abspath = svn_relpath_join(root_path, path, pool);
     svn_boolean_t from_cache;
-    svn_checksum_t *checksum;
+    svn_checksum_t checksum;
     svn_stream_t *dummy = svn_stream_empty(pool);
 
-    SVN_ERR(set_tree_checksum(&checksum, &from_cache, &entries,
-                              dummy, cache, root, abspath,
-                              root_path, NULL, ignores,
-                              pool, pool));
+    // Hash blobs in parallel first, then build trees from their checksums.
+    if (hasher != NULL) {
+        apr_array_header_t *jobs = apr_array_make(pool, 0, sizeof(blob_job_t *));
+
+        SVN_ERR(collect_tree_blobs(jobs, cache, root, abspath, root_path,
+                                   ignores, pool, pool));
+        SVN_ERR(hasher_run(hasher, jobs, FALSE, pool));
+        checksum_cache_prefetch(cache, jobs, pool);
+    }
+
+    SVN_ERR(list_tree_checksum(&checksum, &from_cache, &entries,
+                               dummy, cache, root, abspath,
+                               root_path, NULL, ignores, recurse,
+                               pool, pool));
+    checksum_cache_prefetch(cache, NULL, pool);
+
     SVN_ERR(print_entries(entries, root_path, trees_only, recurse, show_trees, pool));
 
     return SVN_NO_ERROR;
@@ -110,8 +130,10 @@ static svn_error_t *
 do_main(int *exit_code, int argc, const char **argv, apr_pool_t *pool)
 {
     apr_array_header_t *relative_ignores;
-    tree_t *ignores;
+    tree_t *ignored_paths;
+    ignores_t ignores;
     checksum_cache_t *cache;
+    hasher_t *hasher = NULL;
     apr_getopt_t *opt_parser;
     apr_status_t apr_err;
     const char *path = NULL, *repo_path = NULL, *root_path = "";
@@ -121,14 +143,25 @@ do_main(int *exit_code, int argc, const char **argv, apr_pool_t *pool)
     svn_fs_root_t *root;
     svn_repos_t *repo;
     svn_revnum_t revnum = SVN_INVALID_REVNUM;
+    int jobs = 1;
 
     relative_ignores = apr_array_make(pool, 0, sizeof(const char *));
-    ignores = tree_create(pool);
+    ignored_paths = tree_create(pool);
+    ignores.paths = ignored_paths;
+    ignores.no_ignores = NULL;
+    ignores.patterns = pattern_set_create(pool);
+    ignores.branch_path = NULL;
     cache = checksum_cache_create(pool);
 
     // Initialize the FS library.
     SVN_ERR(svn_fs_initialize(pool));
 
+    // Pick SHA-1 implementation for Git objects.
+    SVN_ERR(sha1_initialize(pool));
+
+    // Pick hex codec for checksums.
+    hex_initialize();
+
     // Parse options.
     apr_err = apr_getopt_init(&opt_parser, pool, argc, argv);
     if (apr_err != APR_SUCCESS) {
@@ -166,8 +199,19 @@ do_main(int *exit_code, int argc, const char **argv, apr_pool_t *pool)
         case 'c':
             checksum_cache_path = opt_arg;
             break;
+        case 'j':
+            {
+                char *end = NULL;
+                jobs = strtol(opt_arg, &end, 10);
+                if (jobs < 1 || !end || *end) {
+                    return svn_error_create(SVN_ERR_CL_ARG_PARSING_ERROR,
+                                            NULL,
+                                            "Invalid number of jobs supplied");
+                }
+            }
+            break;
         case 'h':
-            print_usage(cmdline_options, pool);
+            print_usage("svn-ls-tree [OPTIONS] REPO [REV [PATH]]", cmdline_options, pool);
             *exit_code = EXIT_FAILURE;
             return SVN_NO_ERROR;
         }
@@ -175,8 +219,19 @@ do_main(int *exit_code, int argc, const char **argv, apr_pool_t *pool)
 
     for (int i = 0; i < relative_ignores->nelts; i++) {
         const char *ignored_path = APR_ARRAY_IDX(relative_ignores, i, const char *);
+        if (pattern_is_pattern(ignored_path)) {
+            SVN_ERR(pattern_set_add(ignores.patterns, ignored_path, PATTERN_IGNORE_PATH));
+            continue;
+        }
         ignored_path = svn_relpath_join(root_path, ignored_path, pool);
-        tree_insert(ignores, ignored_path, ignored_path, pool);
+        tree_insert(ignored_paths, ignored_path, ignored_path);
+    }
+
+    // Patterns are matched against paths relative to root.
+    if (pattern_set_labels(ignores.patterns) != 0) {
+        ignores.branch_path = root_path;
+    } else {
+        ignores.patterns = NULL;
     }
 
     // Get the repository path.
@@ -229,11 +284,16 @@ do_main(int *exit_code, int argc, const char **argv, apr_pool_t *pool)
 
     if (checksum_cache_path != NULL) {
         SVN_ERR(checksum_cache_load_path(cache, checksum_cache_path, pool));
+        SVN_ERR(checksum_cache_load_trees(cache, checksum_cache_path, recurse, pool));
+    }
+
+    if (jobs > 1) {
+        SVN_ERR(hasher_create(&hasher, repo_path, jobs, pool));
     }
 
     SVN_ERR(print_tree(root, root_path, path, trees_only, recurse,
                        (!recurse || trees_only || show_trees),
-                       cache, ignores, pool));
+                       cache, hasher, &ignores, pool));
 
     return SVN_NO_ERROR;
 }
@@ -251,7 +311,8 @@ main(int argc, const char **argv)
     }
 
     // Create top-level pool. Use a separate mutexless allocator,
-    // as this app is single-threaded.
+    // as it is used by the main thread only, hashing threads
+    // have allocators of their own.
     pool = apr_allocator_owner_get(svn_pool_create_allocator(FALSE));
 
     err = do_main(&exit_code, argc, argv, pool);
@@ -33,6 +33,18 @@ test_expect_success 'Import dump into Git' '
 	git-svn-fast-import ../repo)
 '
 
+test_expect_success 'Report throughput of export and import' '
+(cd repo.git &&
+	git-svn-fast-import --force ../repo 2>../stats.txt) &&
+grep "^svn-fast-export: .* MiB/s, waited .* for git fast-import$" stats.txt &&
+grep "^git fast-import: .* MiB/s, waited .* for svn-fast-export$" stats.txt
+'
+
+test_expect_success 'Failure on missing repository' '
+(cd repo.git &&
+	test_must_fail git-svn-fast-import ../missing)
+'
+
 cat > authors.txt <<EOF
 author1 = A U Thor <author@example.com>
 EOF
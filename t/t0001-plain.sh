@@ -413,4 +413,110 @@ test_expect_success 'Restore revision author property' '
 	svn propset svn:author --revprop -r HEAD author1)
 '
 
+test_expect_success 'Export using multiple threads' '
+svn-fast-export repo >expect &&
+svn-fast-export -j 4 repo >actual &&
+test_cmp expect actual
+'
+
+test_expect_success 'Export reading revisions ahead' '
+svn-fast-export repo >expect &&
+svn-fast-export --read-ahead 2 repo >actual &&
+test_cmp expect actual
+'
+
+test_expect_success 'Export writing output on a separate thread' '
+svn-fast-export repo >expect &&
+svn-fast-export --writer-thread repo >actual &&
+test_cmp expect actual
+'
+
+test_expect_success 'Convert checksum cache into binary format' '
+svn-convert-cache --format text cache.txt cache.all &&
+svn-convert-cache cache.txt cache.bin &&
+svn-convert-cache --format text cache.bin cache.out &&
+sort cache.all >expect &&
+sort cache.out >actual &&
+test_cmp expect actual
+'
+
+test_expect_success 'List tree using binary checksum cache' '
+svn-ls-tree -r repo HEAD >expect &&
+svn-ls-tree -r --checksum-cache cache.bin repo HEAD >actual &&
+test_cmp expect actual
+'
+
+test_expect_success 'List tree using multiple threads' '
+svn-ls-tree -r -t repo HEAD >expect &&
+svn-ls-tree -r -t -j 4 repo HEAD >actual &&
+test_cmp expect actual
+'
+
+test_expect_success 'List tree using tree checksum cache' '
+test -s cache.txt.trees &&
+rm -f expect actual &&
+for rev in $(seq 1 $(svnlook youngest repo)); do
+	svn-ls-tree -r -t -I data repo $rev >>expect &&
+	svn-ls-tree -r -t -I data --checksum-cache cache.txt repo $rev >>actual ||
+	return 1
+done &&
+test_cmp expect actual
+'
+
+test_expect_success 'List tree using planted tree checksum' '
+cp cache.txt.trees cache.txt.trees.orig &&
+test_when_finished "mv cache.txt.trees.orig cache.txt.trees" &&
+sed "/^[0-9a-f]/s/^[0-9a-f]*/0123456789abcdef0123456789abcdef01234567/" \
+	cache.txt.trees.orig >cache.txt.trees &&
+rm -f actual &&
+for rev in $(seq 1 $(svnlook youngest repo)); do
+	svn-ls-tree -r -t -I data --checksum-cache cache.txt repo $rev >>actual ||
+	return 1
+done &&
+grep "tree 0123456789abcdef0123456789abcdef01234567" actual
+'
+
+test_expect_success 'Import blobs only' '
+rm -rf blobs.git &&
+git init blobs.git &&
+(cd repo.git &&
+	git ls-tree -r master | cut -f1 | cut -d" " -f3 | sort -u) >expect &&
+(cd blobs.git &&
+	git-svn-fast-import --checksum-cache ../blobs.cache -j 2 --blobs-only ../repo &&
+	git cat-file --batch-check="%(objectname)" <../expect >../actual) &&
+test_cmp expect actual &&
+! test -f blobs.cache.journal.pending
+'
+
+test_expect_success 'Export with checksum cache of blobs only import' '
+svn-fast-export --checksum-cache blobs.cache repo >stream &&
+! grep "^blob$" stream
+'
+
+test_expect_success 'Failed import does not journal checksums' '
+rm -rf failed.git failed.cache* &&
+git init failed.git &&
+(cd failed.git &&
+	test_must_fail git-svn-fast-import --checksum-cache ../failed.cache --import-marks ../missing ../repo) &&
+! test -f failed.cache.journal.pending &&
+! test -f failed.cache.trees.pending &&
+svn-fast-export --checksum-cache failed.cache repo >stream &&
+grep "^blob$" stream
+'
+
+test_expect_success 'Export with ignore patterns' '
+svn-fast-export -I data repo >expect &&
+svn-fast-export -I "re:d(at|ot)a" repo >actual &&
+test_cmp expect actual &&
+svn-fast-export -i data/bigfile -i data/bigfile2 repo >expect &&
+svn-fast-export -i "glob:**/big*" repo >actual &&
+test_cmp expect actual
+'
+
+test_expect_success 'List tree with ignore patterns' '
+svn-ls-tree -r -I data repo HEAD >expect &&
+svn-ls-tree -r -I "glob:d?t[a-z]" repo HEAD >actual &&
+test_cmp expect actual
+'
+
 test_done
@@ -1101,6 +1101,28 @@ test_expect_success 'Validate branches copied recursively' '
 
 test_tick
 
+test_expect_success 'Commit two tags of unchanged trunk' '
+(cd repo.svn &&
+	svn cp trunk tags/release-2.0 &&
+	svn_commit "New tag" &&
+	svn update &&
+	svn cp trunk tags/release-2.0.1 &&
+	svn_commit "Another tag of the same tree")
+'
+
+test_export_import
+
+test_expect_success 'Compare trees of tags of unchanged trunk' '
+(cd repo.git &&
+	git rev-parse master^{tree} >expect &&
+	git rev-parse tags--release-2.0^{tree} >actual &&
+	test_cmp expect actual &&
+	git rev-parse tags--release-2.0.1^{tree} >actual &&
+	test_cmp expect actual)
+'
+
+test_tick
+
 test_expect_success 'Remove all branches and tags' '
 (cd repo.svn &&
 	svn rm branches &&
@@ -1121,4 +1143,43 @@ test_expect_success 'Validate branches and tags removed' '
 	test_cmp ../expect actual)
 '
 
+export_args="--stdlayout --incremental -B branches-2 -b branches/some-feature/sub-branch -b branches/old-feature/sub-branch -t tags/some-feature-before-remove/sub-branch --import-branches branches.txt"
+
+test_expect_success 'Convert revision marks into binary format' '
+svn-fast-export $export_args --import-rev-marks rev-marks.txt --rev-marks-format binary --export-rev-marks rev-marks.bin repo >/dev/null &&
+svn-fast-export $export_args --import-rev-marks rev-marks.bin --rev-marks-format text --export-rev-marks rev-marks.out repo >/dev/null &&
+test_cmp rev-marks.txt rev-marks.out
+'
+
+test_tick
+
+test_expect_success 'Commit file modify after binary revision marks' '
+(cd repo.svn &&
+	echo "/* EOF */" >>trunk/main.c &&
+	svn_commit "Modify file again")
+'
+
+test_expect_success 'Append new commits to binary revision marks' '
+svn-fast-export $export_args --import-rev-marks rev-marks.txt --export-rev-marks rev-marks.txt repo >expect &&
+svn-fast-export $export_args --import-rev-marks rev-marks.bin --export-rev-marks rev-marks.bin repo >actual &&
+test_cmp expect actual &&
+svn-fast-export $export_args --import-rev-marks rev-marks.bin --rev-marks-format text --export-rev-marks rev-marks.out repo >/dev/null &&
+test_cmp rev-marks.txt rev-marks.out
+'
+
+test_expect_success 'Export branches given by non-canonical paths' '
+svn-fast-export --stdlayout -B branches-2 -b branches/some-feature/sub-branch repo >expect &&
+svn-fast-export --stdlayout -B branches-2/ -b branches/some-feature/sub-branch/ repo >actual &&
+test_cmp expect actual
+'
+
+test_expect_success 'Export with limited commit cache size' '
+svn-fast-export --stdlayout --export-rev-marks rev-marks.full repo >expect &&
+svn-fast-export --stdlayout --commit-cache-size 1K --export-rev-marks rev-marks.limited repo >output &&
+grep "^progress Spilled [1-9][0-9]* pages of revision marks$" output &&
+grep -v "^progress Spilled " output >actual &&
+test_cmp expect actual &&
+test_cmp rev-marks.full rev-marks.limited
+'
+
 test_done
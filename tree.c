@@ -21,176 +21,297 @@
  */
 
 #include "tree.h"
-#include <svn_hash.h>
-#include <svn_path.h>
+#include <apr_strings.h>
 
 tree_t *
 tree_create(apr_pool_t *pool)
 {
     tree_t *t = apr_pcalloc(pool, sizeof(tree_t));
     t->pool = pool;
-    t->nodes = apr_hash_make(pool);
+    t->nodes = apr_array_make(pool, 0, sizeof(tree_node_t));
     t->value = NULL;
 
     return t;
 }
 
-void
-tree_copy(tree_t **dst, const tree_t *src, apr_pool_t *pool)
+// Returns the next component of path starting at *pos and sets len
+// to its length, returns NULL at the end of path.
+static const char *
+path_next(const char *path, apr_size_t *pos, apr_size_t *len)
 {
-    apr_hash_index_t *idx;
-    tree_t *t = tree_create(pool);
-    t->value = src->value;
+    const char *name;
+
+    if (*pos == 0 && path[0] == '/') {
+        *pos = 1;
+        *len = 1;
+        return path;
+    }
 
-    for (idx = apr_hash_first(pool, src->nodes); idx; idx = apr_hash_next(idx)) {
-        const char *key = apr_hash_this_key(idx);
-        const tree_t *val = apr_hash_this_val(idx);
-        tree_t *subtree;
+    while (path[*pos] == '/') {
+        ++*pos;
+    }
 
-        tree_copy(&subtree, val, pool);
-        svn_hash_sets(t->nodes, apr_pstrdup(t->pool, key), subtree);
+    if (path[*pos] == '\0') {
+        return NULL;
     }
 
-    *dst = t;
+    name = path + *pos;
+    *len = strcspn(name, "/");
+    *pos += *len;
+
+    return name;
 }
 
-void
-tree_merge(tree_t **dst, const tree_t *t1, const tree_t *t2, apr_pool_t *pool)
+static int
+compare_names(const char *name1, apr_size_t len1, const char *name2, apr_size_t len2)
 {
-    apr_hash_index_t *idx;
+    int cmp = memcmp(name1, name2, len1 < len2 ? len1 : len2);
 
-    if (t1 == NULL && t2 == NULL) {
-        return;
+    if (cmp != 0) {
+        return cmp;
+    }
+
+    return (len1 > len2) - (len1 < len2);
+}
+
+// Returns position of the first child of t not less than name.
+static int
+tree_lower_bound(const tree_t *t, const char *name, apr_size_t len)
+{
+    int lo = 0, hi = t->nodes->nelts;
+
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        const tree_node_t *node = &APR_ARRAY_IDX(t->nodes, mid, tree_node_t);
+        if (compare_names(node->name, node->len, name, len) < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    return lo;
+}
+
+static tree_t *
+tree_child(const tree_t *t, const char *name, apr_size_t len)
+{
+    int pos = tree_lower_bound(t, name, len);
+    const tree_node_t *node;
+
+    if (pos == t->nodes->nelts) {
+        return NULL;
+    }
+
+    node = &APR_ARRAY_IDX(t->nodes, pos, tree_node_t);
+    if (node->len != len || memcmp(node->name, name, len) != 0) {
+        return NULL;
     }
 
+    return node->tree;
+}
+
+void
+tree_copy(tree_t **dst, const tree_t *src, apr_pool_t *pool)
+{
+    tree_t *t = apr_pmemdup(pool, src, sizeof(tree_t));
+    t->pool = pool;
+
+    *dst = t;
+}
+
+static tree_t *
+merge_nodes(const tree_t *t1, const tree_t *t2, apr_pool_t *pool)
+{
+    int i = 0, j = 0;
+    tree_t *t;
+
     if (t1 == NULL) {
-        tree_copy(dst, t2, pool);
-        return;
+        return (tree_t *) t2;
     }
 
-    if (t2 == NULL) {
-        tree_copy(dst, t1, pool);
-        return;
+    // Share a side when the other one adds nothing to it.
+    if (t2 == NULL || t1 == t2 ||
+        (t2->nodes->nelts == 0 && (t1->value != NULL || t2->value == NULL))) {
+        return (tree_t *) t1;
+    }
+
+    if (t1->nodes->nelts == 0 && t1->value == NULL) {
+        return (tree_t *) t2;
     }
 
-    tree_t *t = tree_create(pool);
+    t = tree_create(pool);
     t->value = t1->value != NULL ? t1->value : t2->value;
 
-    for (idx = apr_hash_first(pool, t1->nodes); idx; idx = apr_hash_next(idx)) {
-        const char *key1 = apr_hash_this_key(idx);
-        const tree_t *val1 = apr_hash_this_val(idx);
-        const tree_t *val2 = svn_hash_gets(t2->nodes, key1);
-        tree_t *subtree;
-        tree_merge(&subtree, val1, val2, pool);
+    // Both children arrays are sorted, so merge them in one pass.
+    while (i < t1->nodes->nelts || j < t2->nodes->nelts) {
+        const tree_node_t *node1 = NULL, *node2 = NULL;
+        tree_node_t *node = apr_array_push(t->nodes);
+        int cmp;
 
-        svn_hash_sets(t->nodes, apr_pstrdup(t->pool, key1), subtree);
+        if (i < t1->nodes->nelts) {
+            node1 = &APR_ARRAY_IDX(t1->nodes, i, tree_node_t);
+        }
+        if (j < t2->nodes->nelts) {
+            node2 = &APR_ARRAY_IDX(t2->nodes, j, tree_node_t);
+        }
+
+        if (node1 == NULL) {
+            cmp = 1;
+        } else if (node2 == NULL) {
+            cmp = -1;
+        } else {
+            cmp = compare_names(node1->name, node1->len, node2->name, node2->len);
+        }
+
+        // Names are shared along with subtrees they come from.
+        *node = cmp <= 0 ? *node1 : *node2;
+        node->tree = merge_nodes(cmp <= 0 ? node1->tree : NULL,
+                                 cmp >= 0 ? node2->tree : NULL, pool);
+
+        i += cmp <= 0;
+        j += cmp >= 0;
     }
 
-    for (idx = apr_hash_first(pool, t2->nodes); idx; idx = apr_hash_next(idx)) {
-        const char *key2 = apr_hash_this_key(idx);
-        const tree_t *val2 = apr_hash_this_val(idx);
-        const tree_t *val1 = svn_hash_gets(t1->nodes, key2);
+    return t;
+}
 
-        if (val1 == NULL) {
-            tree_t *subtree;
-            tree_copy(&subtree, val2, pool);
+void
+tree_merge(tree_t **dst, const tree_t *t1, const tree_t *t2, apr_pool_t *pool)
+{
+    if (t1 == NULL && t2 == NULL) {
+        return;
+    }
+
+    *dst = merge_nodes(t1, t2, pool);
+}
+
+// Returns t1 with the given value and without values set in t2 below it.
+// Returns t1 itself if nothing changes, so that only nodes along paths
+// of t2 are allocated.
+static tree_t *
+diff_nodes(const tree_t *t1, const tree_t *t2, const void *value, apr_pool_t *pool)
+{
+    apr_array_header_t *nodes = NULL;
+    tree_t *t;
+
+    for (int i = 0; i < t1->nodes->nelts; i++) {
+        const tree_node_t *node1 = &APR_ARRAY_IDX(t1->nodes, i, tree_node_t);
+        const tree_t *val2 = tree_child(t2, node1->name, node1->len);
+        tree_t *subtree = node1->tree;
+
+        if (val2 != NULL) {
+            subtree = diff_nodes(node1->tree, val2,
+                                 val2->value == NULL ? node1->tree->value : NULL,
+                                 pool);
+        }
+
+        if (nodes == NULL && subtree != node1->tree) {
+            nodes = apr_array_make(pool, t1->nodes->nelts, sizeof(tree_node_t));
+            for (int j = 0; j < i; j++) {
+                APR_ARRAY_PUSH(nodes, tree_node_t) = APR_ARRAY_IDX(t1->nodes, j, tree_node_t);
+            }
+        }
 
-            svn_hash_sets(t->nodes, apr_pstrdup(t->pool, key2), subtree);
+        if (nodes != NULL) {
+            tree_node_t *node = apr_array_push(nodes);
+            *node = *node1;
+            node->tree = subtree;
         }
     }
 
-    *dst = t;
+    if (nodes == NULL && value == t1->value) {
+        return (tree_t *) t1;
+    }
+
+    t = apr_palloc(pool, sizeof(tree_t));
+    t->pool = pool;
+    t->nodes = nodes != NULL ? nodes : t1->nodes;
+    t->value = value;
+
+    return t;
 }
 
 void
 tree_diff(tree_t **dst, const tree_t *t1, const tree_t *t2, apr_pool_t *pool)
 {
-    apr_hash_index_t *idx;
-    tree_t *t = tree_create(pool);
-
     if (t1 == NULL) {
-        *dst = t;
+        *dst = tree_create(pool);
         return;
     }
 
     if (t2 == NULL) {
-        tree_copy(dst, t1, pool);
+        *dst = (tree_t *) t1;
         return;
     }
 
-    for (idx = apr_hash_first(pool, t1->nodes); idx; idx = apr_hash_next(idx)) {
-        const char *key1 = apr_hash_this_key(idx);
-        const tree_t *val1 = apr_hash_this_val(idx);
-        const tree_t *val2 = svn_hash_gets(t2->nodes, key1);
-
-        tree_t *subtree;
-        tree_diff(&subtree, val1, val2, pool);
-
-        if (val2 == NULL || val2->value == NULL) {
-            subtree->value = val1->value;
-        }
-
-        svn_hash_sets(t->nodes, apr_pstrdup(t->pool, key1), subtree);
-    }
-
-    *dst = t;
+    *dst = diff_nodes(t1, t2, NULL, pool);
 }
 
 void
-tree_insert(tree_t *t,
-            const char *path,
-            const void *value,
-            apr_pool_t *pool)
+tree_insert(tree_t *t, const char *path, const void *value)
 {
-    apr_array_header_t *components = svn_path_decompose(path, pool);
+    const char *name;
+    apr_size_t pos = 0, len;
+
+    while ((name = path_next(path, &pos, &len)) != NULL) {
+        int i = tree_lower_bound(t, name, len);
+        tree_node_t *node = NULL;
+
+        if (i < t->nodes->nelts) {
+            node = &APR_ARRAY_IDX(t->nodes, i, tree_node_t);
+            if (node->len != len || memcmp(node->name, name, len) != 0) {
+                node = NULL;
+            }
+        }
 
-    for (int i = 0; i < components->nelts; i++) {
-        const char *key = APR_ARRAY_IDX(components, i, const char *);
-        tree_t *subtree = svn_hash_gets(t->nodes, key);
+        if (node == NULL) {
+            apr_array_push(t->nodes);
+            memmove(t->nodes->elts + (i + 1) * t->nodes->elt_size,
+                    t->nodes->elts + i * t->nodes->elt_size,
+                    (t->nodes->nelts - i - 1) * t->nodes->elt_size);
 
-        if (subtree == NULL) {
-            subtree = tree_create(t->pool);
-            svn_hash_sets(t->nodes, apr_pstrdup(t->pool, key), subtree);
+            node = &APR_ARRAY_IDX(t->nodes, i, tree_node_t);
+            node->name = apr_pstrmemdup(t->pool, name, len);
+            node->len = len;
+            node->tree = tree_create(t->pool);
         }
 
-        t = subtree;
+        t = node->tree;
     }
 
     t->value = value;
 }
 
 const void *
-tree_match(const tree_t *t, const char *path, apr_pool_t *pool)
+tree_match(const tree_t *t, const char *path)
 {
     const void *value = t->value;
-    apr_array_header_t *components = svn_path_decompose(path, pool);
-
-    for (int i = 0; i < components->nelts; i++) {
-        const char *key = APR_ARRAY_IDX(components, i, const char *);
-        tree_t *subtree = svn_hash_gets(t->nodes, key);
+    const char *name;
+    apr_size_t pos = 0, len;
 
-        if (subtree == NULL) {
+    while ((name = path_next(path, &pos, &len)) != NULL) {
+        t = tree_child(t, name, len);
+        if (t == NULL) {
             break;
         }
 
-        if (subtree->value != NULL) {
-            value = subtree->value;
+        if (t->value != NULL) {
+            value = t->value;
         }
-
-        t = subtree;
     }
 
     return value;
 }
 
 const tree_t *
-tree_subtree(const tree_t *t, const char *path, apr_pool_t *pool)
+tree_subtree(const tree_t *t, const char *path)
 {
-    apr_array_header_t *components = svn_path_decompose(path, pool);
+    const char *name;
+    apr_size_t pos = 0, len;
 
-    for (int i = 0; i < components->nelts; i++) {
-        const char *key = APR_ARRAY_IDX(components, i, const char *);
-        t = svn_hash_gets(t->nodes, key);
+    while ((name = path_next(path, &pos, &len)) != NULL) {
+        t = tree_child(t, name, len);
         if (t == NULL) {
             break;
         }
@@ -211,7 +332,7 @@ tree_values(const tree_t *t,
     values = apr_array_make(result_pool, 0, sizeof(void *));
     queue = apr_array_make(scratch_pool, 0, sizeof(tree_t *));
 
-    subtree = tree_subtree(t, path, scratch_pool);
+    subtree = tree_subtree(t, path);
     if (subtree == NULL) {
         return values;
     }
@@ -219,15 +340,14 @@ tree_values(const tree_t *t,
     APR_ARRAY_PUSH(queue, const tree_t *) = subtree;
 
     while (queue->nelts) {
-        apr_hash_index_t *idx;
         const tree_t *node = *((const tree_t **)apr_array_pop(queue));
 
         if (node->value != NULL) {
             APR_ARRAY_PUSH(values, const void *) = node->value;
         }
 
-        for (idx = apr_hash_first(scratch_pool, node->nodes); idx; idx = apr_hash_next(idx)) {
-            APR_ARRAY_PUSH(queue, const tree_t *) = apr_hash_this_val(idx);
+        for (int i = 0; i < node->nodes->nelts; i++) {
+            APR_ARRAY_PUSH(queue, const tree_t *) = APR_ARRAY_IDX(node->nodes, i, tree_node_t).tree;
         }
     }
 
@@ -23,40 +23,59 @@
 #ifndef GIT_SVN_FAST_IMPORT_TREE_H_
 #define GIT_SVN_FAST_IMPORT_TREE_H_
 
-#include <apr_hash.h>
 #include <apr_tables.h>
 #include <apr_pools.h>
 
+typedef struct tree_t tree_t;
+
+// Child of a tree node, named by a single path component.
 typedef struct
+{
+    const char *name;
+    apr_size_t len;
+    tree_t *tree;
+} tree_node_t;
+
+// Path trie. Root of an absolute path is a component of its own,
+// like in svn_path_decompose().
+struct tree_t
 {
     apr_pool_t *pool;
-    apr_hash_t *nodes;
+    // Children sorted by name.
+    apr_array_header_t *nodes;
     const void *value;
-} tree_t;
+};
 
 tree_t *
 tree_create(apr_pool_t *pool);
 
+// Copies root node of src, sharing its children. Only the value of
+// the copy can be changed.
 void
 tree_copy(tree_t **dst, const tree_t *src, apr_pool_t *pool);
 
+// Sets dst to the union of t1 and t2, preferring values of t1.
+// Result shares unchanged subtrees with t1 and t2 and must not be
+// modified, see tree_copy().
 void
 tree_merge(tree_t **dst, const tree_t *t1, const tree_t *t2, apr_pool_t *pool);
 
+// Sets dst to t1 without values set in t2. Result shares unchanged
+// subtrees with t1 and must not be modified, see tree_copy().
 void
 tree_diff(tree_t **dst, const tree_t *t1, const tree_t *t2, apr_pool_t *pool);
 
 void
-tree_insert(tree_t *t,
-            const char *path,
-            const void *value,
-            apr_pool_t *pool);
+tree_insert(tree_t *t, const char *path, const void *value);
 
+// Returns value of the longest prefix of path having one, walking
+// path in place without allocations.
 const void *
-tree_match(const tree_t *t, const char *path, apr_pool_t *pool);
+tree_match(const tree_t *t, const char *path);
 
+// Returns subtree at path, NULL if there is none.
 const tree_t *
-tree_subtree(const tree_t *t, const char *path, apr_pool_t *pool);
+tree_subtree(const tree_t *t, const char *path);
 
 apr_array_header_t *
 tree_values(const tree_t *t,
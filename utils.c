@@ -42,3 +42,34 @@ cstring_rskip_whitespace(const char *src)
 
     return src;
 }
+
+apr_uint32_t
+decode_uint32(const unsigned char *buf)
+{
+    return ((apr_uint32_t)buf[0] << 24) |
+           ((apr_uint32_t)buf[1] << 16) |
+           ((apr_uint32_t)buf[2] << 8) |
+           (apr_uint32_t)buf[3];
+}
+
+apr_uint64_t
+decode_uint64(const unsigned char *buf)
+{
+    return ((apr_uint64_t)decode_uint32(buf) << 32) | decode_uint32(buf + 4);
+}
+
+void
+encode_uint32(unsigned char *buf, apr_uint32_t val)
+{
+    buf[0] = (unsigned char)(val >> 24);
+    buf[1] = (unsigned char)(val >> 16);
+    buf[2] = (unsigned char)(val >> 8);
+    buf[3] = (unsigned char)val;
+}
+
+void
+encode_uint64(unsigned char *buf, apr_uint64_t val)
+{
+    encode_uint32(buf, (apr_uint32_t)(val >> 32));
+    encode_uint32(buf + 4, (apr_uint32_t)val);
+}
@@ -23,10 +23,25 @@
 #ifndef SVN_FAST_EXPORT_UTILS_H_
 #define SVN_FAST_EXPORT_UTILS_H_
 
+#include <apr.h>
+
 const char *
 cstring_skip_whitespace(const char *src);
 
 const char *
 cstring_rskip_whitespace(const char *src);
 
+// Big-endian integers of binary files.
+apr_uint32_t
+decode_uint32(const unsigned char *buf);
+
+apr_uint64_t
+decode_uint64(const unsigned char *buf);
+
+void
+encode_uint32(unsigned char *buf, apr_uint32_t val);
+
+void
+encode_uint64(unsigned char *buf, apr_uint64_t val);
+
 #endif // SVN_FAST_EXPORT_UTILS_H_